@@ -0,0 +1,126 @@
+#include "http/json_binding.hpp"
+#include "utils/benchmark.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <tao/json.hpp>
+#include <vector>
+
+// JSON bodies of 2 KB and 20 KB: the tao::json::value DOM against the typed binding. Parsing
+// builds the struct from the text, serialization writes the struct into a reused buffer.
+
+namespace {
+
+  struct Item {
+    std::string sku;
+    std::string title;
+    int32_t quantity{0};
+    double price{0};
+    std::optional<std::string> note;
+
+    static constexpr auto json_fields = std::make_tuple(
+        routine::http::json_field("sku", &Item::sku),
+        routine::http::json_field("title", &Item::title),
+        routine::http::json_field("quantity", &Item::quantity),
+        routine::http::json_field("price", &Item::price),
+        routine::http::json_field("note", &Item::note));
+  };
+
+  struct Order {
+    uint64_t id{0};
+    std::string customer;
+    bool is_paid{false};
+    std::vector<Item> items;
+
+    static constexpr auto json_fields = std::make_tuple(
+        routine::http::json_field("id", &Order::id),
+        routine::http::json_field("customer", &Order::customer),
+        routine::http::json_field("paid", &Order::is_paid),
+        routine::http::json_field("items", &Order::items));
+  };
+
+  Order make_order(size_t items) {
+    Order order{.id = 1234567, .customer = "customer@example.com", .is_paid = true};
+    for (size_t i = 0; i < items; ++i)
+      order.items.push_back({.sku = "SKU-" + std::to_string(100000 + i),
+                             .title = "Item number " + std::to_string(i),
+                             .quantity = static_cast<int32_t>(i % 7 + 1),
+                             .price = 9.99 + i,
+                             .note = i % 3 ? std::nullopt : std::optional<std::string>("gift")});
+    return order;
+  }
+
+  // Previous path: DOM of the whole body, then fields copied out of it
+  Order dom_parse(const std::string& text) {
+    auto value = tao::json::from_string(text);
+    Order order;
+    order.id = value.at("id").as<uint64_t>();
+    order.customer = value.at("customer").get_string();
+    order.is_paid = value.at("paid").get_boolean();
+    for (const auto& element : value.at("items").get_array()) {
+      Item item;
+      item.sku = element.at("sku").get_string();
+      item.title = element.at("title").get_string();
+      item.quantity = element.at("quantity").as<int32_t>();
+      item.price = element.at("price").as<double>();
+      if (auto note = element.find("note"); note && note->is_string())
+        item.note = note->get_string();
+      order.items.push_back(std::move(item));
+    }
+    return order;
+  }
+
+  std::string dom_serialize(const Order& order) {
+    tao::json::value items = tao::json::empty_array;
+    for (const auto& item : order.items)
+      items.get_array().push_back({{"sku", item.sku},
+                                   {"title", item.title},
+                                   {"quantity", item.quantity},
+                                   {"price", item.price},
+                                   {"note", item.note ? tao::json::value(*item.note)
+                                                      : tao::json::value(tao::json::null)}});
+    tao::json::value value = {{"id", order.id},
+                              {"customer", order.customer},
+                              {"paid", order.is_paid},
+                              {"items", std::move(items)}};
+    return tao::json::to_string(value);
+  }
+
+} // namespace
+
+int main() {
+  auto logger = spdlog::stdout_color_mt("Benchmark");
+  spdlog::stdout_color_mt("Http");
+
+  for (size_t items : {20, 200}) {
+    Order order = make_order(items);
+    std::string text = routine::http::to_json(order);
+    size_t iterations = 2000000 / text.size() * 10;
+    logger->info("Order with {} items, {} bytes", items, text.size());
+
+    size_t sink = 0;
+    routine::utils::benchmark(
+        "parse DOM      ", [&] { sink += dom_parse(text).items.size(); }, iterations);
+    routine::utils::benchmark(
+        "parse binding  ",
+        [&] { sink += routine::http::from_json<Order>(text).items.size(); }, iterations);
+
+    std::string buffer;
+    routine::utils::benchmark(
+        "serialize DOM  ", [&] { sink += dom_serialize(order).size(); }, iterations);
+    routine::utils::benchmark(
+        "serialize typed",
+        [&] {
+          buffer.clear();
+          routine::http::to_json(buffer, order);
+          sink += buffer.size();
+        },
+        iterations);
+
+    logger->debug("{}", sink);
+  }
+  return 0;
+}
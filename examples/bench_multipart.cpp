@@ -0,0 +1,97 @@
+#include "http/multipart.hpp"
+#include "utils/benchmark.hpp"
+#include "utils/simd.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <span>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <string_view>
+
+// Upload of 16 MB of binary data in a multipart/form-data body, read from the socket in
+// 64 KB windows: the previous path (the whole body buffered, then the parts cut out with
+// std::string_view::find) against the streaming parser with scalar and SIMD delimiter search.
+// The part is a form field with a raised limit, so the disk does not take part in the run
+
+namespace {
+
+  constexpr std::string_view boundary{"----WebKitFormBoundary7MA4YWxkTrZu0gW"};
+
+  std::string make_body(size_t size) {
+    std::mt19937 random(42);
+    std::string data(size, '\0');
+    std::ranges::generate(data, [&random] { return static_cast<char>(random()); });
+
+    std::string body;
+    body.append("--").append(boundary).append("\r\n");
+    body.append("Content-Disposition: form-data; name=\"title\"\r\n\r\nUpload\r\n");
+    body.append("--").append(boundary).append("\r\n");
+    body.append("Content-Disposition: form-data; name=\"data\"\r\n");
+    body.append("Content-Type: application/octet-stream\r\n\r\n");
+    body.append(data).append("\r\n--").append(boundary).append("--\r\n");
+    return body;
+  }
+
+  // Previous path: the body in one buffer, the handler looks for the delimiters itself
+  size_t buffered_parse(const std::string& body) {
+    std::string buffered;
+    for (size_t i = 0; i < body.size(); i += routine::http::MultipartBody::window_size)
+      buffered.append(body, i, routine::http::MultipartBody::window_size);
+
+    std::string delimiter = std::string("\r\n--").append(boundary);
+    std::string_view view(buffered);
+    size_t parsed = 0;
+    for (size_t position = view.find(delimiter); position != std::string_view::npos;) {
+      size_t next = view.find(delimiter, position + delimiter.size());
+      if (next == std::string_view::npos) break;
+      std::string part(view.substr(position, next - position));
+      parsed += part.size();
+      position = next;
+    }
+    return parsed;
+  }
+
+  size_t streaming_parse(const std::string& body) {
+    routine::http::MultipartBody multipart(
+        boundary, routine::http::MultipartOptions{.max_field_size = 64 * 1024 * 1024});
+    for (size_t i = 0; i < body.size();) {
+      auto window = multipart.prepare(body.size() - i);
+      std::copy_n(body.data() + i, window.size(), window.data());
+      multipart.commit(window.size());
+      i += window.size();
+    }
+    multipart.finish();
+    return multipart.parts().size();
+  }
+
+} // namespace
+
+int main() {
+  auto logger = spdlog::stdout_color_mt("Benchmark");
+  spdlog::stdout_color_mt("Http");
+
+  std::string body = make_body(16 * 1024 * 1024);
+  constexpr size_t iterations = 50;
+  double megabytes = static_cast<double>(body.size()) / (1024 * 1024);
+  logger->info("Body of {:.1f} MB", megabytes);
+
+  size_t sink = 0;
+  size_t rps = routine::utils::benchmark(
+      "buffered + find ", [&] { sink += buffered_parse(body); }, iterations);
+  logger->info("{:.0f} MB/s", rps * megabytes);
+
+  using routine::utils::simd::Level;
+  for (auto [level, title] : {std::pair{Level::Scalar, "streaming scalar"},
+                              std::pair{Level::Avx2, "streaming avx2  "}}) {
+    if (!routine::utils::simd::force_level(level)) continue;
+    rps = routine::utils::benchmark(
+        title, [&] { sink += streaming_parse(body); }, iterations);
+    logger->info("{:.0f} MB/s", rps * megabytes);
+  }
+
+  logger->debug("{}", sink);
+  return 0;
+}
@@ -0,0 +1,131 @@
+#include "http/request.hpp"
+#include "http/route_handler.hpp"
+#include "utils/benchmark.hpp"
+#include "utils/utils.hpp"
+
+#include <algorithm>
+#include <format>
+#include <memory>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Route lookup with 1k and 10k registered routes: the previous router (unordered_map of static
+// paths, then a tree of unordered_map nodes over split_string segments) against the compiled
+// radix tree. Half of the routes are static, half have a path parameter.
+
+namespace {
+
+  class EmptyHandler final : public routine::http::RequestHandler {
+  public:
+    routine::http::Response_ptr process_request(routine::http::Request_ptr) override {
+      return nullptr;
+    }
+  };
+
+  // Previous RouteHandler implementation
+  class LegacyRouter {
+    using Handler_creator = routine::http::RouteHandler::Handler_creator;
+
+    struct ResourceHandler {
+      std::unique_ptr<Handler_creator> resource;
+      std::unordered_map<std::string, ResourceHandler> nodes;
+    };
+
+  public:
+    void add_handler(const std::string& path, Handler_creator creator) {
+      auto creator_ptr = std::make_unique<Handler_creator>(std::move(creator));
+      if (path.find('{') == std::string::npos) {
+        static_handlers_[routine::utils::format_path(path)] = std::move(creator_ptr);
+        return;
+      }
+
+      ResourceHandler* node = &dynamic_handlers_;
+      for (const auto& key : routine::utils::split_string<std::string>(path, '/', 4))
+        node = &node->nodes[key];
+      node->resource = std::move(creator_ptr);
+    }
+
+    routine::http::RequestHandler_ptr route(routine::http::Request& request) {
+      if (auto it = static_handlers_.find(std::string(request.path()));
+          it != static_handlers_.end())
+        return (*it->second)();
+
+      ResourceHandler* node = &dynamic_handlers_;
+      for (const auto& key : routine::utils::split_string<std::string>(request.path(), '/', 4)) {
+        auto it = node->nodes.find(key);
+        if (it == node->nodes.end()) {
+          it = std::find_if(node->nodes.begin(), node->nodes.end(),
+                            [](const auto& pair) { return pair.first[0] == '{'; });
+          if (it == node->nodes.end()) return nullptr;
+          request.path_params().emplace(it->first.substr(1, it->first.size() - 2), key);
+        }
+        node = &it->second;
+      }
+      return node->resource ? (*node->resource)() : nullptr;
+    }
+
+  private:
+    ResourceHandler dynamic_handlers_;
+    std::unordered_map<std::string, std::unique_ptr<Handler_creator>> static_handlers_;
+  };
+
+  std::string route_path(size_t i) {
+    return i % 2 == 0 ? std::format("/api/v1/service{}/resource{}/items", i % 97, i)
+                      : std::format("/api/v1/service{}/resource{}/{{id}}/details", i % 97, i);
+  }
+
+  std::string request_path(size_t i) {
+    return i % 2 == 0 ? route_path(i)
+                      : std::format("/api/v1/service{}/resource{}/{}/details", i % 97, i, i * 7);
+  }
+
+  void run(size_t routes) {
+    auto handler = std::make_shared<EmptyHandler>();
+    auto creator = [handler] { return handler; };
+
+    LegacyRouter legacy;
+    routine::http::RouteHandler router;
+    for (size_t i = 0; i < routes; ++i) {
+      legacy.add_handler(route_path(i), creator);
+      router.add_handler(route_path(i), creator);
+    }
+    router.compile();
+
+    // a sample of requests spread over the whole table
+    std::vector<routine::http::Request_ptr> requests;
+    for (size_t i = 0; i < routes; i += routes / 256)
+      requests.push_back(routine::http::make_request(
+          std::format("GET {} HTTP/1.1\r\nHost: localhost\r\n\r\n", request_path(i))));
+
+    size_t next = 0;
+    auto lookup = [&](auto route) {
+      auto& request = *requests[next++ % requests.size()];
+      request.path_params().clear();
+      if (!route(request)) spdlog::get("Benchmark")->error("Route not found");
+    };
+
+    routine::utils::benchmark(
+        std::format("{:>5} routes # legacy", routes),
+        [&] { lookup([&](auto& request) { return legacy.route(request) != nullptr; }); },
+        1000000);
+    routine::utils::benchmark(
+        std::format("{:>5} routes # radix ", routes),
+        [&] { lookup([&](auto& request) { return router.route(request).handler != nullptr; }); },
+        1000000);
+  }
+
+} // namespace
+
+int main() {
+  spdlog::stdout_color_mt("Benchmark");
+  spdlog::stdout_color_mt("Http");
+  spdlog::stdout_color_mt("Router")->set_level(spdlog::level::warn);
+
+  run(1000);
+  run(10000);
+
+  return 0;
+}
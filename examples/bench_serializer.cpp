@@ -0,0 +1,81 @@
+#include "http/response.hpp"
+#include "utils/benchmark.hpp"
+#include "utils/utils.hpp"
+
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+#include <sstream>
+#include <string>
+
+// Serialization of a small JSON response: the previous std::ostringstream path against
+// http::Serializer writing into a reused output buffer.
+
+namespace {
+
+  const std::string json_body = R"({"id":42,"name":"routine","tags":["http","asio"],"ok":true})";
+
+  // Previous Response::prepare_response implementation
+  std::string legacy_prepare_response(routine::http::Status status,
+                                      routine::http::Headers& headers,
+                                      const routine::http::I_BodyStorage& body) {
+    using routine::http::Header;
+    namespace utils = routine::http::utils;
+
+    if (!headers.contains(Header::Server)) headers.insert(Header::Server, "RoutineHttpLibrary");
+    headers.set(Header::Date, utils::cached_http_date());
+    if (!headers.contains(Header::Content_Type)) headers.insert(Header::Content_Type, "text/plain");
+    headers.set(Header::Content_Length, std::to_string(body.size()));
+
+    std::ostringstream stream;
+    stream << utils::status_line(status);
+    for (auto& header : headers)
+      stream << header.as_string() << "\r\n";
+
+    stream << "\r\n";
+    stream << body.as_string();
+
+    return stream.str();
+  }
+
+} // namespace
+
+int main() {
+  auto logger = spdlog::stdout_color_mt("Benchmark");
+  spdlog::stdout_color_mt("Http");
+
+  auto make_response = [] {
+    return routine::http::Response(routine::http::Status::Ok,
+                                   {{"Content-Type", "application/json"},
+                                    {"Cache-Control", "no-cache"}},
+                                   json_body);
+  };
+
+  auto legacy_response = make_response();
+  auto response = make_response();
+  std::string buffer;
+
+  logger->info("Response {} bytes (body {} bytes)", response.prepare_response().size(),
+               json_body.size());
+
+  size_t sink = 0;
+  routine::utils::benchmark(
+      "ostringstream",
+      [&] {
+        sink += legacy_prepare_response(legacy_response.status(), legacy_response.headers(),
+                                        *legacy_response.body())
+                    .size();
+      },
+      1000000);
+
+  routine::utils::benchmark(
+      "serializer   ",
+      [&] {
+        buffer.clear();
+        response.serialize(buffer);
+        sink += buffer.size();
+      },
+      1000000);
+
+  logger->debug("{}", sink);
+  return 0;
+}
@@ -1,5 +1,6 @@
 #include "http/body_storage.hpp"
 #include "http/headers.hpp"
+#include "http/json_binding.hpp"
 #include "http/response.hpp"
 #include "http/types.hpp"
 #include "net/acceptor.hpp"
@@ -18,6 +19,8 @@ class DynamicEchoHandler final : public routine::http::RequestHandler {
 public:
   // DONT FORGET TO SPECIFY THE PATH OF RESOURCE HANDLER
   inline static const std::string path{"/api/echo/{argumet}/hello"};
+  // stateless, one instance serves all requests
+  static constexpr auto lifetime = routine::http::HandlerLifetime::Singleton;
 
   routine::http::Response_ptr process_request(routine::http::Request_ptr request) override {
     auto logger = spdlog::get("Http");
@@ -31,10 +34,18 @@ public:
   }
 };
 
+// Request body bound to a struct, parsed without building a tao::json::value
+struct EchoMessage {
+  std::string message;
+  static constexpr auto json_fields =
+      std::make_tuple(routine::http::json_field("message", &EchoMessage::message));
+};
+
 class StaticEchoHandler final : public routine::http::RequestHandler {
 public:
   // DONT FORGET TO SPECIFY THE PATH OF RESOURCE HANDLER
   inline static const std::string path{"/api/echo"};
+  static constexpr auto lifetime = routine::http::HandlerLifetime::Singleton;
 
   routine::http::Response_ptr prepare_request(routine::http::Request_ptr request) override {
     request->body() = std::make_unique<routine::http::JsonBody>();
@@ -42,20 +53,17 @@ public:
   }
 
   routine::http::Response_ptr process_request(routine::http::Request_ptr request) override {
-    // cast to JsonBody from interface
-    auto body = dynamic_cast<routine::http::JsonBody*>(request->body().get());
-    assert(body != nullptr && "Body is nullptr"); // for example only. Dont use assert here!
-
-    // make empty response
-    auto response = std::make_unique<routine::http::Response>(
-        routine::http::Status::Ok, routine::http::Headers{},
-        std::make_shared<routine::http::MemoryBody>());
+    // for example only. Dont use assert here!
+    assert(request->body() != nullptr && "Body is nullptr");
 
+    // echo back as {"message": "..."}, serialized straight into the output buffer
     try {
-      (*response->body()) = body ? body->json().at("message").get_string() : "No body contained";
-    } catch (const std::exception& e) { (*response->body()) = "No message"; }
-
-    return response;
+      auto message = routine::http::from_json<EchoMessage>(*request->body());
+      return routine::http::make_json_response(routine::http::Status::Ok, std::move(message));
+    } catch (const std::exception& e) {
+      return std::make_shared<routine::http::Response>(routine::http::Status::Bad_Request,
+                                                       routine::http::Headers{}, "No message");
+    }
   }
 };
 
@@ -1,9 +1,19 @@
 #pragma once
 
+#include "http/types.hpp"
+#include "utils/memory_budget.hpp"
+#include <atomic>
 #include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <tao/json.hpp>
 #include <tao/json/forward.hpp>
+#include <variant>
 #include <vector>
 
 #ifdef USE_BOOST_ASIO
@@ -15,26 +25,82 @@ using namespace boost;
 
 namespace routine::http {
 
-  enum class StorageType { None, Memory, File, Json };
+  enum class StorageType { None, Memory, File, Json, Multipart };
+
+  // Producer of a body in pieces, see I_BodyStorage::make_chunks()
+  class I_BodyChunks {
+  public:
+    // Append the next piece of about 'size_hint' bytes to 'buffer'. false after the last one
+    virtual bool next(std::string& buffer, size_t size_hint) = 0;
+
+    // Length of the whole body if it is known before it is produced. Such bodies are sent
+    // with Content-Length instead of chunked, a body which ends short of it closes the
+    // connection
+    virtual std::optional<uint64_t> size() const { return std::nullopt; }
+
+    virtual ~I_BodyChunks() = default;
+  };
 
   class I_BodyStorage {
-    // TODO # add move&copy write methods
   public:
     virtual void operator=(const std::string& str) = 0;
 
     virtual void write(const std::vector<uint8_t>& buffer) = 0;
     virtual void write(asio::streambuf& buffer) = 0;
     virtual void write(const std::string& buffer) = 0;
+    // Storages which can adopt the string take it without copying
     virtual void write(std::string&& buffer) = 0;
+    virtual void write(std::vector<uint8_t>&& buffer) { write(buffer); }
+    virtual void write(std::span<const uint8_t> bytes) {
+      write(std::string(reinterpret_cast<const char*>(bytes.data()), bytes.size()));
+    }
+
+    // Copy of the body, prefer span() or for_each_segment()
     virtual std::vector<uint8_t> read() const = 0;
     virtual size_t size() const = 0;
     virtual std::string as_string() const = 0;
 
+    // The body as one contiguous view, valid until the next write. Empty if the storage does
+    // not keep the bytes in memory
+    virtual std::span<const uint8_t> span() const { return {}; }
+
+    // Bytes of the body in order without copying, piece by piece
+    virtual void for_each_segment(
+        const std::function<void(std::span<const uint8_t>)>& callback) const {
+      std::string bytes = as_string();
+      if (!bytes.empty())
+        callback({reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size()});
+    }
+
+    // Space for up to 'size' bytes at the end of the body, so the socket is read straight
+    // into the storage. commit() appends the bytes written to it. Empty if not supported
+    virtual std::span<uint8_t> prepare(size_t size) { return {}; }
+    virtual void commit(size_t size) {}
+
+    // Charge a body of 'size' more bytes to the memory budget before it is read, false if
+    // the budget cannot hold it. Storages which do not keep the body in memory accept any size
+    virtual bool reserve(size_t size) { return true; }
+
+    // Called by the session after the last byte of a request body. A status other than Ok
+    // answers the request instead of the handler
+    virtual Status finish() { return Status::Ok; }
+
+    // Append the body to the output buffer
+    virtual void append_to(std::string& buffer) const { buffer.append(as_string()); }
+
+    // Producer of a body too large to be written at once, nullptr to send it whole. Such
+    // responses go out with Transfer-Encoding: chunked, the next piece is produced when the
+    // previous one is sent
+    virtual std::unique_ptr<I_BodyChunks> make_chunks() const { return nullptr; }
+
     virtual StorageType get_type() const { return StorageType::None; }
 
     virtual ~I_BodyStorage() = default;
   };
 
+  // Chain of segments: moved-in strings and vectors are adopted as segments, small writes
+  // and bytes read from the socket go to blocks at the end of the chain. span() joins the
+  // chain into one segment once. The allocated segments are charged to the memory budget
   class MemoryBody final : public I_BodyStorage {
   public:
     void operator=(const std::string& str) override;
@@ -43,58 +109,192 @@ namespace routine::http {
     void write(asio::streambuf& buffer) override;
     void write(const std::string& buffer) override;
     void write(std::string&& buffer) override;
+    void write(std::vector<uint8_t>&& buffer) override;
+    void write(std::span<const uint8_t> bytes) override;
     std::vector<uint8_t> read() const override;
     size_t size() const override;
     std::string as_string() const override;
+    std::span<const uint8_t> span() const override;
+    void for_each_segment(
+        const std::function<void(std::span<const uint8_t>)>& callback) const override;
+    std::span<uint8_t> prepare(size_t size) override;
+    void commit(size_t size) override;
+    bool reserve(size_t size) override;
+    void append_to(std::string& buffer) const override;
 
     const uint8_t* data() const;
 
     StorageType get_type() const override { return StorageType::Memory; }
 
   private:
-    std::vector<uint8_t> data_;
+    // Bytes written in place, 'size' of 'capacity' are used
+    struct Block {
+      std::unique_ptr<uint8_t[]> data;
+      size_t size{0};
+      size_t capacity{0};
+    };
+    using Segment = std::variant<std::string, std::vector<uint8_t>, Block>;
+
+    static std::span<const uint8_t> bytes_of(const Segment& segment) noexcept;
+
+    // Block at the end of the chain with at least 'size' free bytes
+    Block& tail_block(size_t size);
+
+    // Charge the larger of the allocated and the reserved bytes
+    void account() const;
+
+    // smaller moved-in buffers are copied, so small writes do not grow the chain
+    static constexpr size_t adopt_size = 1024;
+    static constexpr size_t block_size = 16 * 1024;
+
+  private:
+    mutable std::vector<Segment> segments_;
+    size_t size_{0};
+    mutable size_t allocated_{0}; // bytes of the segments
+    size_t reserved_{0};
+    mutable routine::utils::MemoryCharge charge_;
   };
 
+  // Body in an anonymous temporary file, removed with the body, so large uploads do not
+  // stay in memory. Reads go to the disk, responses are sent in chunks read from the file.
+  // I/O errors throw std::system_error
   class FileBody final : public I_BodyStorage {
   public:
+    static constexpr size_t read_chunk_size = 64 * 1024;
+
+    // File in the system temporary directory
+    FileBody();
+    explicit FileBody(const std::filesystem::path& directory);
+    ~FileBody() override;
+
+    FileBody(const FileBody&) = delete;
+    FileBody& operator=(const FileBody&) = delete;
+
     void operator=(const std::string& str) override;
 
     void write(const std::vector<uint8_t>& buffer) override;
     void write(asio::streambuf& buffer) override;
     void write(const std::string& buffer) override;
     void write(std::string&& buffer) override;
+    void write(std::span<const uint8_t> bytes) override;
     std::vector<uint8_t> read() const override;
     size_t size() const override;
     std::string as_string() const override;
+    void for_each_segment(
+        const std::function<void(std::span<const uint8_t>)>& callback) const override;
+    void append_to(std::string& buffer) const override;
+    std::unique_ptr<I_BodyChunks> make_chunks() const override;
 
-    const uint8_t* data() const;
+    // Give the file a name, readable by the owner only. Linked in place if 'path' is on the
+    // same filesystem and does not exist, copied otherwise. A linked file shares the content
+    // with the body, so the body is not written after that
+    void save(const std::filesystem::path& path) const;
+
+    // Read up to 'size' bytes at 'offset', returns the count
+    size_t read_at(uint64_t offset, uint8_t* data, size_t size) const;
 
     StorageType get_type() const override { return StorageType::File; }
 
   private:
-    std::vector<uint8_t> data_;
+    int fd_{-1};
+    uint64_t size_{0};
   };
 
+  // Read-only body of 'length' bytes at 'offset' of an open file, read with pread() while it
+  // is sent with Content-Length. The descriptor is shared by the bodies of one file and
+  // closed with the last of them. A file truncated on disk ends the body early instead of
+  // faulting like a mapping would. Writes throw std::logic_error, I/O errors
+  // std::system_error
+  class FileRangeBody final : public I_BodyStorage {
+  public:
+    // Take ownership of 'fd', it is closed with the last copy of the pointer
+    static std::shared_ptr<const int> share_descriptor(int fd);
+
+    FileRangeBody(std::shared_ptr<const int> fd, uint64_t offset, uint64_t length)
+        : fd_(std::move(fd)), offset_(offset), length_(length) {}
+
+    void operator=(const std::string& str) override;
+
+    void write(const std::vector<uint8_t>& buffer) override;
+    void write(asio::streambuf& buffer) override;
+    void write(const std::string& buffer) override;
+    void write(std::string&& buffer) override;
+    std::vector<uint8_t> read() const override;
+    size_t size() const override;
+    std::string as_string() const override;
+    void for_each_segment(
+        const std::function<void(std::span<const uint8_t>)>& callback) const override;
+    void append_to(std::string& buffer) const override;
+    std::unique_ptr<I_BodyChunks> make_chunks() const override;
+
+    // Read up to 'size' bytes at 'offset' of the range, returns the count
+    size_t read_at(uint64_t offset, uint8_t* data, size_t size) const;
+
+    StorageType get_type() const override { return StorageType::File; }
+
+  private:
+    std::shared_ptr<const int> fd_;
+    uint64_t offset_{0};
+    uint64_t length_{0};
+  };
+
+  // JSON text kept as received and parsed on the first json() call, so requests are parsed
+  // by the CPU worker and handlers which pass the payload on never parse it.
+  // Constructed from a value it is a response body serialized straight into the output
+  // buffer, values over chunked_size bytes are sent in chunks while they are serialized.
+  // The text is charged to the memory budget
   class JsonBody final : public I_BodyStorage {
   public:
+    static constexpr size_t chunked_size = 64 * 1024;
+
+    JsonBody() = default;
+    explicit JsonBody(tao::json::value value);
+
     void operator=(const std::string& str) override;
 
     void write(const std::vector<uint8_t>& buffer) override;
     void write(asio::streambuf& buffer) override;
     void write(const std::string& buffer) override;
     void write(std::string&& buffer) override;
+    void write(std::span<const uint8_t> bytes) override;
     std::vector<uint8_t> read() const override;
     size_t size() const override;
     std::string as_string() const override;
+    std::span<const uint8_t> span() const override;
+    void for_each_segment(
+        const std::function<void(std::span<const uint8_t>)>& callback) const override;
+    std::span<uint8_t> prepare(size_t size) override;
+    void commit(size_t size) override;
+    bool reserve(size_t size) override;
+    void append_to(std::string& buffer) const override;
+    std::unique_ptr<I_BodyChunks> make_chunks() const override;
 
     const uint8_t* data() const;
 
     StorageType get_type() const override { return StorageType::Json; }
 
+    // Parsed body, null if the text is not valid JSON. Writes drop the parsed value
     const tao::json::value& json() const;
 
+    // Text of the body as written, empty for bodies made of a value
+    std::string_view raw() const noexcept { return raw_; }
+    bool has_text() const noexcept { return has_text_; }
+
+  private:
+    // Writes replace the value of a body made of a value
+    void drop_value();
+
+    // Charge the larger of the text capacity and the reserved bytes
+    void account();
+
   private:
-    tao::json::value data_;
+    std::string raw_;
+    size_t prepared_{0}; // size of 'raw_' before prepare()
+    mutable std::optional<tao::json::value> value_;
+    bool has_text_{true};
+    mutable std::atomic<size_t> value_size_{static_cast<size_t>(-1)}; // counted once
+    size_t reserved_{0};
+    routine::utils::MemoryCharge charge_;
   };
 
 } // namespace routine::http
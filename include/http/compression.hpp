@@ -0,0 +1,137 @@
+#pragma once
+
+#include "http/headers.hpp"
+#include "http/request.hpp"
+#include "http/response.hpp"
+#include "http/types.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace routine::http {
+
+  // Content codings of response and request bodies
+  enum class Encoding : uint8_t {
+    Identity,
+    Gzip,
+    Brotli,
+    Zstd,
+  };
+
+  // Number of codings. Keep in sync with the last routine::http::Encoding value
+  inline constexpr size_t encoding_count = static_cast<size_t>(Encoding::Zstd) + 1;
+
+  // Set of codings, bit per Encoding
+  constexpr uint8_t encoding_bit(Encoding encoding) noexcept {
+    return static_cast<uint8_t>(1u << static_cast<size_t>(encoding));
+  }
+
+  // Codings the library is built with: USE_ZLIB, USE_BROTLI, USE_ZSTD
+  uint8_t supported_encodings() noexcept;
+
+  // Content-Encoding token of the coding
+  std::string_view to_string(Encoding encoding) noexcept;
+
+  struct CompressionPolicy {
+    uint8_t encodings{supported_encodings()}; // Identity alone disables compression
+    size_t min_size{1024};                    // smaller bodies are sent as is
+    double max_ratio{0.9}; // compressed bodies larger than max_ratio of the input are dropped
+    int gzip_level{6};
+    int brotli_level{5};
+    int zstd_level{3};
+  };
+
+  // Coding of 'encodings' preferred by Accept-Encoding (RFC 7231 5.3.4), Identity if none is
+  // acceptable. Equal q-values prefer brotli, then zstd, then gzip
+  Encoding negotiate(std::string_view accept_encoding, uint8_t encodings) noexcept;
+
+  // Text, JSON, XML, JavaScript, SVG and WebAssembly. Media formats are compressed already
+  bool is_compressible(std::string_view content_type) noexcept;
+
+  // Compress with a context of the current thread, which is reused between calls. nullopt if
+  // the coding is not built in or the result is larger than max_ratio of 'data'
+  std::optional<std::string> compress(Encoding encoding, std::string_view data,
+                                      const CompressionPolicy& policy);
+
+  // Compressed copy of a dynamic response in the coding accepted by the request. 'response'
+  // itself if nothing is accepted, or its body is small, incompressible or encoded already.
+  // Static responses and file bodies are returned as is
+  Response_ptr compress_response(const Response_ptr& response, Request& request,
+                                 const CompressionPolicy& policy);
+
+  // Pre-serialized 200 in one coding with its ETag and 304
+  struct Representation {
+    Response_ptr response;
+    Response_ptr not_modified;
+    std::string etag;
+  };
+  using Representations = std::array<Representation, encoding_count>;
+
+  // Identity 200 and every coding of 'policy' which pays off, compressed once. 'headers' must
+  // contain ETag, compressed codings get the ETag with a suffix of the coding. 304 responses
+  // carry ETag and 'validators' of the headers
+  Representations make_representations(Headers headers, std::string body,
+                                       const CompressionPolicy& policy,
+                                       std::initializer_list<Header> validators);
+
+  // Representation for Accept-Encoding of the request, the identity one is always present
+  const Representation& select_representation(const Representations& representations,
+                                              Request& request);
+
+  // Request bodies in Content-Encoding are decoded while they are read from the socket.
+  // Decoding stops with 413 once the output passes max_size, or max_ratio of the input read
+  // so far, so a small body cannot expand into gigabytes
+  struct DecompressionPolicy {
+    uint8_t encodings{supported_encodings()}; // Identity alone passes encoded bodies as is
+    size_t max_size{16 * 1024 * 1024};        // bytes of a decoded body
+    double max_ratio{100};                    // decoded bytes per encoded byte
+  };
+
+  // Coding of a Content-Encoding value. "deflate" is decoded as gzip, whose decoder detects
+  // the zlib header. nullopt for unknown or stacked codings
+  std::optional<Encoding> parse_encoding(std::string_view content_encoding) noexcept;
+
+  // Streaming decoder of one body. Not thread-safe
+  class Decompressor {
+  public:
+    // Decoded piece, valid until the callback returns
+    using Output = std::function<void(std::string_view)>;
+
+    // 'encoding' must be built in, see supported_encodings()
+    Decompressor(Encoding encoding, const DecompressionPolicy& policy);
+    ~Decompressor();
+
+    Decompressor(const Decompressor&) = delete;
+    Decompressor& operator=(const Decompressor&) = delete;
+
+    // Decode the next bytes of the body and pass the output to 'output'. false on malformed
+    // input or exceeded limits, the decoder must not be used after that
+    bool write(std::string_view input, const Output& output);
+
+    // End of the body. false if the coded stream is truncated
+    bool finish();
+
+    // Bad_Request for malformed input, Payload_Too_Large for exceeded limits, Ok otherwise
+    Status status() const noexcept { return status_; }
+
+  private:
+    bool emit(const char* data, size_t size, const Output& output);
+    bool fail(Status status) noexcept;
+
+  private:
+    struct Stream;
+    std::unique_ptr<Stream> stream_;
+    DecompressionPolicy policy_;
+    size_t encoded_{0};
+    size_t decoded_{0};
+    bool is_finished_{false};
+    Status status_{Status::Ok};
+  };
+
+} // namespace routine::http
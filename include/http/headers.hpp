@@ -1,122 +1,84 @@
 #pragma once
 
 #include "http/types.hpp"
+#include "utils/small_vector.hpp"
 #include "utils/utils.hpp"
-#include <concepts>
+#include <array>
+#include <format>
+#include <forward_list>
+#include <initializer_list>
+#include <memory_resource>
+#include <optional>
 #include <string>
-#include <unordered_set>
+#include <string_view>
 
 namespace routine::http {
   class Request;
   class Response;
 
+  // Non-owning view of a single header. The memory is owned by http::Headers
   class HeaderField {
   public:
-    using key_type = std::string;
-    using value_type = std::string;
+    HeaderField(std::string_view key, std::string_view value = {})
+        : key_(key), value_(value), id_(utils::header_from_string(key)) {}
 
-    template <typename KeyT>
-      requires std::constructible_from<key_type, KeyT>
-    HeaderField(KeyT&& key) : key_(std::forward<KeyT>(key)), value_("") {}
-
-    template <typename KeyT, typename ValueT>
-      requires std::constructible_from<key_type, KeyT> &&
-                   std::constructible_from<value_type, ValueT>
-    HeaderField(KeyT&& key, ValueT&& value)
-        : key_(std::forward<KeyT>(key)), value_(std::forward<ValueT>(value)) {}
-
-    template <typename ValueT>
-      requires std::constructible_from<value_type, ValueT>
-    HeaderField(routine::http::Header key, ValueT&& value)
-        : key_(routine::http::utils::to_string(key)), value_(std::forward<ValueT>(value)) {}
-
-    HeaderField(HeaderField&&) noexcept = default;
-    HeaderField& operator=(HeaderField&&) noexcept = default;
-    HeaderField(const HeaderField&) = default;
+    HeaderField(routine::http::Header key, std::string_view value = {})
+        : key_(utils::to_string(key)), value_(value), id_(key) {}
 
   public:
-    // Compare both 'key' fields of HeaderField
+    // Compare both 'value' fields of HeaderField
     bool operator==(const HeaderField& other) const { return other.value() == this->value(); }
 
-    // Compare ValueT with HeaderField::value()
-    template <typename ValueT>
-      requires std::constructible_from<value_type, ValueT>
-    bool operator==(ValueT&& other) const {
-      return other == this->value();
-    }
-
-    // Assign ValueT to HeaderField::value()
-    template <typename ValueT>
-      requires std::constructible_from<value_type, ValueT>
-    const HeaderField& operator=(ValueT&& value) const {
-      value_ = std::forward<ValueT>(value);
-      return *this;
-    }
+    // Compare string with HeaderField::value()
+    bool operator==(std::string_view other) const { return other == this->value(); }
 
-    operator std::string() const { return value_; }
+    operator std::string() const { return std::string(value_); }
 
   public:
-    // Get Header name
-    const std::string& key() const { return key_; }
+    // Get Header name (lowercase)
+    std::string_view key() const { return key_; }
     // Get value
-    std::string& value() const { return value_; }
+    std::string_view value() const { return value_; }
+    // Get well-known header id or Header::None
+    routine::http::Header id() const { return id_; }
 
     // Get string as format "Key: Value"
     std::string as_string() const { return std::format("{}: {}", key_, value_); }
 
-    // Assign new value to HeaderField::value()
-    template <typename ValueT>
-      requires std::constructible_from<value_type, ValueT>
-    void set_value(ValueT&& value) const {
-      value_ = std::forward<ValueT>(value);
-    }
-
   private:
-    key_type key_;
-    mutable value_type value_;
-  };
-
-  namespace utils {
+    std::string_view key_;
+    std::string_view value_;
+    routine::http::Header id_;
 
-    struct HeaderFieldHash {
-      using is_transparent = void;
-
-      size_t operator()(const routine::http::HeaderField& object) const {
-        return std::hash<std::string_view>{}(object.key());
-      }
-
-      size_t operator()(std::string_view key) const { return std::hash<std::string_view>{}(key); }
-    };
-
-    struct HeaderFieldEqual {
-      using is_transparent = void;
-
-      bool operator()(const HeaderField& left, const HeaderField& right) const {
-        return left.key() == right.key();
-      }
-
-      bool operator()(const HeaderField& left, std::string right) const {
-        return left.key() == right;
-      }
+    friend class Headers;
+  };
 
-      bool operator()(std::string left, const HeaderField& right) const {
-        return left == right.key();
-      }
-    };
-  } // namespace utils
 } // namespace routine::http
 
 namespace routine::http {
 
+  // Flat headers container. Fields are stored in insertion order in a small inline vector,
+  // well-known headers are additionally indexed by routine::http::Header for O(1) lookups.
+  // Parsed fields are views into the raw message head, so parsing does not allocate
   class Headers {
   public:
-    using container =
-        std::unordered_set<HeaderField, utils::HeaderFieldHash, utils::HeaderFieldEqual>;
+    using container = routine::utils::SmallVector<HeaderField, 16>;
 
   public:
     Headers() = default;
-    Headers(const std::string& raw);
+    // Storage of the raw head and copied strings is allocated from 'resource'
+    explicit Headers(std::pmr::memory_resource* resource);
+    Headers(std::string_view raw);
     Headers(std::istringstream& stream);
+    Headers(std::initializer_list<std::pair<std::string_view, std::string_view>> fields);
+
+    Headers(const Headers& other);
+    Headers(Headers&& other) noexcept;
+    Headers& operator=(const Headers& other);
+    // Headers from different memory resources are copied on move
+    Headers& operator=(Headers&& other);
+
+    std::pmr::memory_resource* resource() const noexcept { return raw_.get_allocator().resource(); }
 
     // return the HeaderField& or throw exception if key is not found
     const HeaderField& at(std::string_view key) const;
@@ -142,20 +104,30 @@ namespace routine::http {
     // return the HeaderField& or create new HeaderField and return it
     const HeaderField& operator[](routine::http::Header key) noexcept;
 
+    // return the HeaderField* or nullptr if key is not found
+    const HeaderField* find(std::string_view key) const noexcept;
+    const HeaderField* find(routine::http::Header key) const noexcept;
+
     bool contains(std::string_view key) const noexcept;
 
     bool contains(routine::http::Header key) const noexcept;
 
-    void insert(HeaderField&& header);
+    // Append a header. Key and value are copied into the container
     void insert(const HeaderField& header);
+    void insert(std::string_view key, std::string_view value);
+    void insert(routine::http::Header key, std::string_view value);
+
+    void insert(std::pair<std::string_view, std::string_view>&& pair);
 
-    template <typename KeyT, typename ValueT>
-    void insert(KeyT&& key, ValueT&& value) {
-      headers_.emplace(std::forward<HeaderField::key_type>(key),
-                       std::forward<HeaderField::value_type>(value));
-    }
+    // Replace the value of existing header or append a new one
+    void set(std::string_view key, std::string_view value);
+    void set(routine::http::Header key, std::string_view value);
 
-    void insert(std::pair<HeaderField::key_type, HeaderField::value_type>&& pair);
+    void erase(std::string_view key) noexcept;
+    void erase(routine::http::Header key) noexcept;
+
+    size_t size() const noexcept;
+    bool empty() const noexcept;
 
     void clear() noexcept;
 
@@ -169,13 +141,43 @@ namespace routine::http {
     container::const_iterator cend() const noexcept;
 
   private:
-    void init_from_stream(std::istringstream& stream);
+    // Copy the raw message head and parse header lines starting at 'offset'
+    void init_from_raw(std::string_view raw, size_t offset);
+
+    // Parse "Key: Value\r\n" lines until the empty line. Lines are views into 'raw_'
+    void init_from_string(std::string_view input);
+
+    // index of the header in 'fields_' or fields_.size()
+    size_t index_of(std::string_view key) const noexcept;
+    size_t index_of(routine::http::Header key) const noexcept;
+
+    // Append field, views must already point to memory owned by this container
+    HeaderField& push(HeaderField field);
+
+    // Copy string into owned storage
+    std::string_view store(std::string_view string);
+
+    // Copy field views that are not owned by this container
+    HeaderField adopt(const HeaderField& field, const Headers& source);
+
+    // Copy all fields of 'other' into the own memory resource
+    void assign(const Headers& other);
+
+    void reindex() noexcept;
 
   private:
-    container headers_;
+    std::pmr::string raw_;
+    container fields_;
+    // index + 1 in 'fields_', 0 if absent. 32 bits, a field past 65535 must not wrap to 0
+    std::array<uint32_t, header_count> slots_{};
+    std::pmr::forward_list<std::pmr::string> storage_; // nodes are stable, views stay valid on move
 
     friend http::Request;
     friend http::Response;
   };
 
+  // Content-Length of a message, RFC 9110 8.6: a single field of digits only. std::nullopt if
+  // the field is absent, repeated, not a number or overflows, such bodies cannot be framed
+  std::optional<size_t> parse_content_length(const Headers& headers) noexcept;
+
 } // namespace routine::http
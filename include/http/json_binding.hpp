@@ -0,0 +1,538 @@
+#pragma once
+
+#include "http/body_storage.hpp"
+#include "http/headers.hpp"
+#include "http/response.hpp"
+#include "http/types.hpp"
+#include "utils/memory_budget.hpp"
+#include "utils/perfect_hash.hpp"
+#include "utils/small_vector.hpp"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tao/json.hpp>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace routine::http {
+
+  // Member of a struct bound to a key of a JSON object
+  template <typename T, typename M>
+  struct JsonField {
+    std::string_view name; // written as is, must not need escaping
+    M T::*member;
+  };
+
+  template <typename T, typename M>
+  consteval JsonField<T, M> json_field(std::string_view name, M T::*member) {
+    return {name, member};
+  }
+
+  // Struct bound to a JSON object by its static 'json_fields' tuple:
+  //   struct Message {
+  //     std::string text;
+  //     std::vector<int64_t> ids;
+  //     static constexpr auto json_fields = std::make_tuple(
+  //         http::json_field("text", &Message::text), http::json_field("ids", &Message::ids));
+  //   };
+  // Fields may be bool, numbers, std::string, std::optional, std::vector and bound structs
+  template <typename T>
+  concept JsonBound = requires { T::json_fields; };
+
+  namespace detail {
+
+    template <typename T>
+    struct is_optional : std::false_type {};
+    template <typename T>
+    struct is_optional<std::optional<T>> : std::true_type {};
+
+    template <typename T>
+    struct is_vector : std::false_type {};
+    template <typename T, typename A>
+    struct is_vector<std::vector<T, A>> : std::true_type {};
+
+    template <typename T>
+    inline constexpr auto json_field_names = std::apply(
+        [](const auto&... field) {
+          return std::array<std::string_view, sizeof...(field)>{field.name...};
+        },
+        T::json_fields);
+
+    template <typename T>
+    inline constexpr auto json_field_hash = routine::utils::make_perfect_hash(json_field_names<T>);
+
+    struct JsonOps;
+
+    // Value the next event is written to, skipped if 'ops' is nullptr
+    struct JsonSlot {
+      void* target{nullptr};
+      const JsonOps* ops{nullptr};
+    };
+
+    // Event handlers of one C++ type. Null keeps the value as is
+    struct JsonOps {
+      std::string_view kind;
+      void (*null)(void* target);
+      void (*boolean)(void* target, bool value);
+      void (*signed_number)(void* target, int64_t value);
+      void (*unsigned_number)(void* target, uint64_t value);
+      void (*double_number)(void* target, double value);
+      void (*string)(void* target, std::string&& value);
+      void (*begin)(void* target, bool is_array);              // start of an array or object
+      JsonSlot (*element)(void* target);                      // arrays: new element
+      JsonSlot (*member)(void* target, std::string_view key); // objects: field of the key
+    };
+
+    [[noreturn]] inline void json_mismatch(std::string_view kind, std::string_view expected) {
+      throw std::invalid_argument(std::format("JSON: {} where {} is expected", kind, expected));
+    }
+
+    template <typename T>
+    const JsonOps& json_ops();
+
+    template <typename T>
+    JsonSlot json_slot(T& value) {
+      return {&value, &json_ops<T>()};
+    }
+
+    template <typename T>
+    constexpr std::string_view json_kind() {
+      if constexpr (std::is_same_v<T, bool>)
+        return "boolean";
+      else if constexpr (std::is_arithmetic_v<T>)
+        return "number";
+      else if constexpr (std::is_same_v<T, std::string>)
+        return "string";
+      else if constexpr (is_optional<T>::value)
+        return json_kind<typename T::value_type>();
+      else if constexpr (is_vector<T>::value)
+        return "array";
+      else
+        return "object";
+    }
+
+    template <typename T>
+    const JsonOps& json_ops() {
+      using Integer = std::conditional_t<std::is_integral_v<T>, T, int>;
+
+      static constexpr JsonOps ops{
+          .kind = json_kind<T>(),
+          .null =
+              [](void* target) {
+                if constexpr (is_optional<T>::value) static_cast<T*>(target)->reset();
+              },
+          .boolean =
+              [](void* target, bool value) {
+                if constexpr (std::is_same_v<T, bool>)
+                  *static_cast<T*>(target) = value;
+                else if constexpr (is_optional<T>::value)
+                  json_ops<typename T::value_type>().boolean(&static_cast<T*>(target)->emplace(),
+                                                             value);
+                else
+                  json_mismatch("boolean", json_kind<T>());
+              },
+          .signed_number =
+              [](void* target, int64_t value) {
+                if constexpr (std::is_integral_v<T> && !std::is_same_v<T, bool>) {
+                  if (!std::in_range<Integer>(value))
+                    json_mismatch("integer out of range", json_kind<T>());
+                  *static_cast<T*>(target) = static_cast<T>(value);
+                } else if constexpr (std::is_floating_point_v<T>)
+                  *static_cast<T*>(target) = static_cast<T>(value);
+                else if constexpr (is_optional<T>::value)
+                  json_ops<typename T::value_type>().signed_number(
+                      &static_cast<T*>(target)->emplace(), value);
+                else
+                  json_mismatch("number", json_kind<T>());
+              },
+          .unsigned_number =
+              [](void* target, uint64_t value) {
+                if constexpr (std::is_integral_v<T> && !std::is_same_v<T, bool>) {
+                  if (!std::in_range<Integer>(value))
+                    json_mismatch("integer out of range", json_kind<T>());
+                  *static_cast<T*>(target) = static_cast<T>(value);
+                } else if constexpr (std::is_floating_point_v<T>)
+                  *static_cast<T*>(target) = static_cast<T>(value);
+                else if constexpr (is_optional<T>::value)
+                  json_ops<typename T::value_type>().unsigned_number(
+                      &static_cast<T*>(target)->emplace(), value);
+                else
+                  json_mismatch("number", json_kind<T>());
+              },
+          .double_number =
+              [](void* target, double value) {
+                if constexpr (std::is_floating_point_v<T>)
+                  *static_cast<T*>(target) = static_cast<T>(value);
+                else if constexpr (is_optional<T>::value)
+                  json_ops<typename T::value_type>().double_number(
+                      &static_cast<T*>(target)->emplace(), value);
+                else
+                  json_mismatch("fraction", json_kind<T>());
+              },
+          .string =
+              [](void* target, std::string&& value) {
+                if constexpr (std::is_same_v<T, std::string>)
+                  *static_cast<T*>(target) = std::move(value);
+                else if constexpr (is_optional<T>::value)
+                  json_ops<typename T::value_type>().string(&static_cast<T*>(target)->emplace(),
+                                                            std::move(value));
+                else
+                  json_mismatch("string", json_kind<T>());
+              },
+          .begin =
+              [](void* target, bool is_array) {
+                if constexpr (is_vector<T>::value) {
+                  if (!is_array) json_mismatch("object", json_kind<T>());
+                  static_cast<T*>(target)->clear();
+                } else if constexpr (JsonBound<T>) {
+                  if (is_array) json_mismatch("array", json_kind<T>());
+                } else if constexpr (is_optional<T>::value) {
+                  json_ops<typename T::value_type>().begin(&static_cast<T*>(target)->emplace(),
+                                                           is_array);
+                } else {
+                  json_mismatch(is_array ? "array" : "object", json_kind<T>());
+                }
+              },
+          // optionals are engaged by begin()
+          .element = [](void* target) -> JsonSlot {
+            if constexpr (is_vector<T>::value)
+              return json_slot(static_cast<T*>(target)->emplace_back());
+            else if constexpr (is_optional<T>::value)
+              return json_ops<typename T::value_type>().element(&**static_cast<T*>(target));
+            else
+              json_mismatch("array", json_kind<T>());
+          },
+          .member = [](void* target, std::string_view key) -> JsonSlot {
+            if constexpr (JsonBound<T>) {
+              size_t index = json_field_hash<T>.find(key);
+              if (index == decltype(json_field_hash<T>)::npos || json_field_names<T>[index] != key)
+                return {}; // unknown keys are skipped
+
+              JsonSlot slot;
+              auto& value = *static_cast<T*>(target);
+              std::apply(
+                  [&](const auto&... field) {
+                    size_t i = 0;
+                    ((i++ == index ? (slot = json_slot(value.*field.member), 0) : 0), ...);
+                  },
+                  T::json_fields);
+              return slot;
+            } else if constexpr (is_optional<T>::value) {
+              return json_ops<typename T::value_type>().member(&**static_cast<T*>(target), key);
+            } else {
+              json_mismatch("object", json_kind<T>());
+            }
+          },
+      };
+      return ops;
+    }
+
+    // tao::json events consumer writing into the bound value
+    class JsonBinder {
+    public:
+      explicit JsonBinder(JsonSlot root) : root_(root) {}
+
+      void null() {
+        if (auto slot = next(); slot.ops) slot.ops->null(slot.target);
+      }
+      void boolean(bool value) {
+        if (auto slot = next(); slot.ops) slot.ops->boolean(slot.target, value);
+      }
+      void number(int64_t value) {
+        if (auto slot = next(); slot.ops) slot.ops->signed_number(slot.target, value);
+      }
+      void number(uint64_t value) {
+        if (auto slot = next(); slot.ops) slot.ops->unsigned_number(slot.target, value);
+      }
+      void number(double value) {
+        if (auto slot = next(); slot.ops) slot.ops->double_number(slot.target, value);
+      }
+      void string(std::string&& value) {
+        if (auto slot = next(); slot.ops) slot.ops->string(slot.target, std::move(value));
+      }
+      void string(std::string_view value) { string(std::string(value)); }
+
+      void begin_array(size_t = 0) { begin(true); }
+      void element() {}
+      void end_array(size_t = 0) { frames_.pop_back(); }
+
+      void begin_object(size_t = 0) { begin(false); }
+      void key(std::string_view name) {
+        auto& frame = frames_.back();
+        frame.value =
+            frame.container.ops ? frame.container.ops->member(frame.container.target, name)
+                                : JsonSlot{};
+      }
+      void key(std::string&& name) { key(std::string_view(name)); }
+      void member() {}
+      void end_object(size_t = 0) { frames_.pop_back(); }
+
+    private:
+      void begin(bool is_array) {
+        auto slot = next();
+        if (slot.ops) slot.ops->begin(slot.target, is_array);
+        frames_.push_back({slot, {}, is_array});
+      }
+
+      // Slot of the value which starts with the current event
+      JsonSlot next() {
+        if (frames_.empty()) return root_;
+        auto& frame = frames_.back();
+        if (!frame.is_array) return frame.value;
+        return frame.container.ops ? frame.container.ops->element(frame.container.target)
+                                   : JsonSlot{};
+      }
+
+      struct Frame {
+        JsonSlot container;
+        JsonSlot value; // objects: field of the last key
+        bool is_array;
+      };
+
+      JsonSlot root_;
+      routine::utils::SmallVector<Frame, 16> frames_;
+    };
+
+    // Output that only counts bytes, for Content-Length before the body is written
+    struct JsonCounter {
+      size_t size{0};
+      void append(std::string_view bytes) noexcept { size += bytes.size(); }
+      void push_back(char) noexcept { ++size; }
+    };
+
+    template <typename Output>
+    void write_json_string(Output& output, std::string_view string) {
+      static constexpr char hex[] = "0123456789abcdef";
+      output.push_back('"');
+      size_t start = 0;
+      for (size_t i = 0; i < string.size(); ++i) {
+        auto c = static_cast<unsigned char>(string[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        output.append(string.substr(start, i - start));
+        start = i + 1;
+        switch (c) {
+          case '"':
+            output.append("\\\"");
+            break;
+          case '\\':
+            output.append("\\\\");
+            break;
+          case '\n':
+            output.append("\\n");
+            break;
+          case '\r':
+            output.append("\\r");
+            break;
+          case '\t':
+            output.append("\\t");
+            break;
+          default:
+            const char escape[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+            output.append(std::string_view(escape, sizeof(escape)));
+        }
+      }
+      output.append(string.substr(start));
+      output.push_back('"');
+    }
+
+    template <typename Output, typename T>
+    void write_json(Output& output, const T& value) {
+      if constexpr (std::is_same_v<T, bool>) {
+        output.append(value ? "true" : "false");
+      } else if constexpr (std::is_arithmetic_v<T>) {
+        if constexpr (std::is_floating_point_v<T>)
+          if (!std::isfinite(value)) {
+            output.append("null");
+            return;
+          }
+        char digits[32];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        output.append(std::string_view(digits, result.ptr - digits));
+      } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+        write_json_string(output, value);
+      } else if constexpr (is_optional<T>::value) {
+        if (value)
+          write_json(output, *value);
+        else
+          output.append("null");
+      } else if constexpr (is_vector<T>::value) {
+        output.push_back('[');
+        for (size_t i = 0; i < value.size(); ++i) {
+          if (i > 0) output.push_back(',');
+          write_json(output, value[i]);
+        }
+        output.push_back(']');
+      } else {
+        static_assert(JsonBound<T>, "type is not bound to JSON, see routine::http::JsonBound");
+        output.push_back('{');
+        std::apply(
+            [&](const auto&... field) {
+              bool is_first = true;
+              ((output.append(is_first ? "\"" : ",\""), is_first = false,
+                output.append(field.name), output.append("\":"),
+                write_json(output, value.*field.member)),
+               ...);
+            },
+            T::json_fields);
+        output.push_back('}');
+      }
+    }
+
+  } // namespace detail
+
+  // Parse JSON text into 'value' without building a tao::json::value. Keys missing from the
+  // text keep their values, unknown keys are skipped. Throws std::invalid_argument for values
+  // of another type and the tao::json parse errors for malformed text
+  template <typename T>
+  void from_json(std::string_view text, T& value) {
+    detail::JsonBinder binder(detail::json_slot(value));
+    tao::json::events::from_string(binder, text);
+  }
+
+  template <typename T>
+  T from_json(std::string_view text) {
+    T value{};
+    from_json(text, value);
+    return value;
+  }
+
+  // Parse a request body: the text of JsonBody and MemoryBody is read in place
+  template <typename T>
+  T from_json(const I_BodyStorage& body) {
+    if (auto json = dynamic_cast<const JsonBody*>(&body)) return from_json<T>(json->raw());
+    if (auto memory = dynamic_cast<const MemoryBody*>(&body))
+      return from_json<T>(
+          std::string_view(reinterpret_cast<const char*>(memory->data()), memory->size()));
+    return from_json<T>(std::string_view(body.as_string()));
+  }
+
+  // Append the JSON text of 'value' to 'buffer'
+  template <typename T>
+  void to_json(std::string& buffer, const T& value) {
+    detail::write_json(buffer, value);
+  }
+
+  template <typename T>
+  std::string to_json(const T& value) {
+    std::string result;
+    detail::write_json(result, value);
+    return result;
+  }
+
+  // Bytes of to_json() output, computed without writing it
+  template <typename T>
+  size_t json_size(const T& value) {
+    detail::JsonCounter counter;
+    detail::write_json(counter, value);
+    return counter.size;
+  }
+
+  // Body holding a bound value. It is serialized straight into the output buffer of the
+  // session, the size is counted beforehand without allocation. Written pieces of a request
+  // body are collected and parsed in finish(), malformed JSON answers 400
+  template <typename T>
+  class TypedJsonBody final : public I_BodyStorage {
+  public:
+    TypedJsonBody() = default;
+    explicit TypedJsonBody(T value) : value_(std::move(value)) {}
+
+    void operator=(const std::string& str) override {
+      release_text();
+      value_ = from_json<T>(str);
+    }
+
+    void write(const std::vector<uint8_t>& buffer) override {
+      text_.append(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+      account();
+    }
+    void write(asio::streambuf& buffer) override {
+      text_.append(static_cast<const char*>(buffer.data().data()), buffer.size());
+      buffer.consume(buffer.size());
+      account();
+    }
+    void write(const std::string& buffer) override {
+      text_.append(buffer);
+      account();
+    }
+    void write(std::string&& buffer) override {
+      if (text_.empty())
+        text_ = std::move(buffer);
+      else
+        text_.append(buffer);
+      account();
+    }
+    void write(std::span<const uint8_t> bytes) override {
+      text_.append(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+      account();
+    }
+
+    bool reserve(size_t size) override {
+      if (!charge_.try_resize(std::max(charge_.bytes(), text_.size() + size))) return false;
+      reserved_ = text_.size() + size;
+      return true;
+    }
+
+    Status finish() override {
+      if (text_.empty()) return Status::Ok;
+      Status status = Status::Ok;
+      try {
+        value_ = from_json<T>(text_);
+      } catch (const std::exception&) {
+        status = Status::Bad_Request;
+      }
+      release_text();
+      return status;
+    }
+
+    std::vector<uint8_t> read() const override {
+      std::string text = as_string();
+      return std::vector<uint8_t>(text.begin(), text.end());
+    }
+    size_t size() const override { return json_size(value_); }
+    std::string as_string() const override { return to_json(value_); }
+    void append_to(std::string& buffer) const override { to_json(buffer, value_); }
+
+    T& value() noexcept { return value_; }
+    const T& value() const noexcept { return value_; }
+
+  private:
+    // Charge the larger of the text capacity and the reserved bytes, as JsonBody does
+    void account() { charge_.resize(std::max(text_.capacity(), reserved_)); }
+
+    void release_text() {
+      text_ = std::string{};
+      reserved_ = 0;
+      charge_.resize(0);
+    }
+
+  private:
+    T value_{};
+    std::string text_; // request body until finish()
+    size_t reserved_{0};
+    routine::utils::MemoryCharge charge_;
+  };
+
+  // Response with a TypedJsonBody and "Content-Type: application/json" unless 'headers'
+  // have another one
+  template <typename T>
+  Response_ptr make_json_response(Status status, T value, Headers headers = {}) {
+    if (!headers.contains(Header::Content_Type))
+      headers.insert(Header::Content_Type, "application/json");
+    return std::make_shared<Response>(status, std::move(headers),
+                                      std::make_shared<TypedJsonBody<T>>(std::move(value)));
+  }
+
+} // namespace routine::http
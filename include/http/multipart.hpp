@@ -0,0 +1,144 @@
+#pragma once
+
+#include "http/body_storage.hpp"
+#include "http/request.hpp"
+#include "http/types.hpp"
+#include "utils/memory_budget.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace routine::http {
+
+  // Part of a multipart/form-data body. Form fields are kept in a MemoryBody, files in a
+  // FileBody on the disk
+  struct MultipartPart {
+    std::string name;         // "name" of Content-Disposition
+    std::string filename;     // "filename" of Content-Disposition, empty for form fields
+    std::string content_type; // "text/plain" if absent
+    bool is_file{false};      // the part has a filename, even an empty one
+    std::unique_ptr<I_BodyStorage> body;
+  };
+
+  struct MultipartOptions {
+    std::filesystem::path directory;  // of the file parts, the system temporary one if empty
+    size_t max_field_size{1024 * 1024}; // bytes of a form field, fields are held in memory
+    size_t max_header_size{8 * 1024};   // headers of a part
+    size_t max_parts{1000};
+  };
+
+  // Incremental parser of multipart/form-data (RFC 7578). Bytes are fed as they arrive in
+  // pieces of any size. The delimiter is searched with the SIMD kernels, bytes of a part go
+  // to its body as they are parsed, only a possible delimiter split between two writes is
+  // held back. A complete part is passed to the callback
+  class MultipartParser {
+  public:
+    using Part_callback = std::function<void(MultipartPart&&)>;
+
+    MultipartParser(std::string_view boundary, MultipartOptions options,
+                    Part_callback callback);
+
+    // Parse the next bytes of the body. false once it is malformed or over the limits, the
+    // rest is ignored
+    bool write(std::span<const uint8_t> bytes);
+
+    // End of the body. false if the final delimiter was not seen
+    bool finish();
+
+    // Bad_Request for a malformed body, Payload_Too_Large over the limits,
+    // Internal_Server_Error if a file part cannot be written
+    Status status() const noexcept { return status_; }
+
+    // Boundary of a "multipart/form-data; boundary=..." Content-Type, nullopt for other types
+    // or an invalid boundary (RFC 2046 5.1.1)
+    static std::optional<std::string> boundary_of(std::string_view content_type);
+
+  private:
+    enum class State : uint8_t { Preamble, Boundary, Headers, Data, Done, Failed };
+
+    // Bytes of 'data' consumed, the rest is kept until the next write
+    size_t parse(std::string_view data);
+
+    // Part of the headers block, false if they are malformed
+    bool begin_part(std::string_view headers);
+    void append(std::string_view bytes);
+    void fail(Status status);
+
+  private:
+    std::string delimiter_; // CRLF "--" boundary
+    MultipartOptions options_;
+    Part_callback callback_;
+    std::string pending_; // bytes held back between writes
+    std::optional<MultipartPart> part_;
+    size_t parts_{0};
+    State state_{State::Preamble};
+    Status status_{Status::Ok};
+  };
+
+  // Request body parsed while it is read from the socket: a handler sets it in
+  // prepare_request() and gets the parts in process_request(). With a callback the parts are
+  // passed on as they complete, on the IO thread, instead of being collected. Malformed
+  // bodies are answered with 400 and bodies over the limits with 413 before the handler.
+  // The raw body is not kept, as_string() and read() are empty. Only the window and the form
+  // fields are charged to the memory budget
+  class MultipartBody final : public I_BodyStorage {
+  public:
+    // bytes read from the socket at once
+    static constexpr size_t window_size = 64 * 1024;
+
+    explicit MultipartBody(std::string_view boundary, MultipartOptions options = {});
+    MultipartBody(std::string_view boundary, MultipartOptions options,
+                  MultipartParser::Part_callback callback);
+
+    MultipartBody(const MultipartBody&) = delete;
+    MultipartBody& operator=(const MultipartBody&) = delete;
+
+    void operator=(const std::string& str) override;
+
+    void write(const std::vector<uint8_t>& buffer) override;
+    void write(asio::streambuf& buffer) override;
+    void write(const std::string& buffer) override;
+    void write(std::string&& buffer) override;
+    void write(std::span<const uint8_t> bytes) override;
+    std::vector<uint8_t> read() const override { return {}; }
+    size_t size() const override { return size_; }
+    std::string as_string() const override { return {}; }
+    std::span<uint8_t> prepare(size_t size) override;
+    void commit(size_t size) override;
+    Status finish() override;
+
+    // Parts in the order of the body, without a callback
+    std::vector<MultipartPart>& parts() { return parts_; }
+
+    // First part named 'name', nullptr if there is none
+    MultipartPart* find(std::string_view name);
+
+    StorageType get_type() const override { return StorageType::Multipart; }
+
+  private:
+    // the parser collects parts into 'parts_' or passes them to the callback
+    MultipartParser make_parser();
+
+  private:
+    std::string boundary_;
+    MultipartOptions options_;
+    MultipartParser::Part_callback callback_;
+    MultipartParser parser_;
+    std::vector<MultipartPart> parts_;
+    std::unique_ptr<uint8_t[]> window_;
+    routine::utils::MemoryCharge window_charge_;
+    size_t size_{0}; // bytes parsed
+  };
+
+  // MultipartBody for a multipart/form-data request, nullptr for other content types
+  std::unique_ptr<MultipartBody> make_multipart_body(Request& request,
+                                                     MultipartOptions options = {});
+
+} // namespace routine::http
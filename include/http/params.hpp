@@ -1,12 +1,14 @@
 #pragma once
 
+#include "utils/small_vector.hpp"
 #include <charconv>
+#include <forward_list>
+#include <memory_resource>
 #include <optional>
 #include <string>
 #include <string_view>
 #include <strings.h>
 #include <type_traits>
-#include <unordered_map>
 
 namespace routine::http { // namespace utils
 
@@ -15,17 +17,14 @@ namespace routine::http { // namespace utils
     class Field {
     public:
       Field() = default;
-      explicit Field(std::string value) : value_(std::move(value)) {}
-
-      Field(Field&&) = default;
-      Field(const Field&) = default;
+      explicit Field(std::string_view value) : value_(value) {}
 
       std::string_view value() const { return value_; }
 
       template <typename T>
       std::optional<T> as() const noexcept {
         if constexpr (std::is_same_v<T, std::string>) {
-          return value_;
+          return std::string(value_);
         } else if constexpr (std::is_same_v<T, std::string_view>) {
           return value_;
         } else if constexpr (std::is_integral_v<T> && !std::is_same_v<T, bool>) {
@@ -40,7 +39,7 @@ namespace routine::http { // namespace utils
       }
 
     private:
-      std::string value_;
+      std::string_view value_;
 
     private:
       template <typename T>
@@ -80,29 +79,98 @@ namespace routine::http { // namespace utils
       }
     };
 
+    struct Entry {
+      std::string_view key;
+      Field field;
+    };
+
+    using container = routine::utils::SmallVector<Entry, 8>;
+
   public:
-    bool contains(const std::string& key) const noexcept { return params_.contains(key); }
+    Parameters() = default;
+
+    // Decoded and copied strings are allocated from 'resource'
+    explicit Parameters(std::pmr::memory_resource* resource) : storage_(resource) {}
+
+    // Query string without '?'. It is parsed on first access, keys and values are views into
+    // 'query' unless they need percent-decoding. 'query' must outlive the Parameters
+    explicit Parameters(std::string_view query,
+                        std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : query_(query), parsed_(query.empty()), storage_(resource) {}
+
+    // copies never share the memory resource of the source
+    Parameters(const Parameters& other);
+    Parameters(Parameters&&) noexcept = default;
+    Parameters& operator=(const Parameters& other);
+    // Parameters from different memory resources are copied on move
+    Parameters& operator=(Parameters&& other);
+
+    std::pmr::memory_resource* resource() const noexcept {
+      return storage_.get_allocator().resource();
+    }
+
+  public:
+    bool contains(std::string_view key) const { return find(key) != nullptr; }
+
+    size_t size() const {
+      parse();
+      return entries_.size();
+    }
+
+    // Copy key and value into the Parameters
+    void emplace(std::string_view key, std::string_view value);
 
-    size_t size() const noexcept { return params_.size(); }
+    // Add key and value without copying. Both views must outlive the Parameters
+    void emplace_view(std::string_view key, std::string_view value);
 
-    void emplace(std::string key, std::string value) noexcept {
-      params_.emplace(std::move(key), std::move(value));
+    // return the Field or throw exception if key is not found
+    const Field& at(std::string_view key) const;
+
+    // return the Field or empty Field if key is not found
+    Field operator[](std::string_view key) const {
+      const Field* field = find(key);
+      return field ? *field : Field{};
+    }
+
+    // return the Field* or nullptr if key is not found
+    const Field* find(std::string_view key) const;
+
+    void erase(std::string_view key);
+
+    // Remove all entries, including the unparsed query
+    void clear();
+
+    container::const_iterator begin() const {
+      parse();
+      return entries_.begin();
+    }
+    container::const_iterator end() const {
+      parse();
+      return entries_.end();
+    }
+
+  private:
+    void parse() const {
+      if (!parsed_) parse_query();
     }
 
-    Field& at(const std::string& key) { return params_.at(key); }
+    // Split 'query_' by '&' and '=' with percent-decoding
+    void parse_query() const;
 
-    Field& operator[](const std::string& key) { return params_[key]; }
-    const Field& operator[](const std::string& key) const { return params_[key]; }
+    // Decode "%XX" and '+' into the storage, return 'string' itself if nothing to decode
+    std::string_view decode(std::string_view string) const;
 
-    void erase(const std::string& key) { params_.erase(key); }
+    std::string_view store(std::string_view string) const;
 
-    auto begin() noexcept { return params_.begin(); }
-    auto end() noexcept { return params_.end(); }
-    auto begin() const noexcept { return params_.begin(); }
-    auto end() const noexcept { return params_.end(); }
+    // Copy all entries of 'other' into the own memory resource
+    void assign(const Parameters& other);
 
   private:
-    mutable std::unordered_map<std::string, Field> params_;
+    std::string_view query_;
+    mutable bool parsed_{true};
+    mutable container entries_;
+    // nodes are stable, views stay valid on move
+    mutable std::pmr::forward_list<std::pmr::string> storage_;
   };
 
 } // namespace routine::http
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "http/request.hpp"
+#include "http/response.hpp"
+#include "http/route_policy.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace routine::http {
+
+  // Token bucket of a route. Every client IP may send 'burst' requests at once and 'rate'
+  // requests per second after that. Declare it in the handler:
+  //   inline static const RateLimit rate_limit{10, 20};            // per client IP
+  //   inline static const RateLimit rate_limit{100, 100, "x-api-key"}; // and per header value
+  // With 'header', a request takes a token of its value bucket as well. Header values are not
+  // validated, the client IP bucket keeps clients with made-up values to the limit
+  class RateLimit {
+  public:
+    RateLimit(double rate, uint32_t burst, std::string header = {});
+
+    double rate() const noexcept { return rate_; }
+    uint32_t burst() const noexcept { return burst_; }
+    const std::string& header() const noexcept { return header_; }
+
+    // Pre-serialized 429 with Retry-After, shared by all rejected requests
+    const Response_ptr& rejected_response() const noexcept { return rejected_; }
+
+  private:
+    double rate_;
+    uint32_t burst_;
+    std::string header_;
+    Response_ptr rejected_;
+  };
+
+  // Buckets of all routes and keys in fixed lock-free hash tables, one per shard. A bucket is
+  // one atomic word (refill time and tokens) updated with CAS, so IO threads never block each
+  // other. When the probe window of a key is full, the least recently refilled bucket is
+  // taken over and its owner starts again with a full bucket. Thread-safe
+  class RateLimiter {
+  public:
+    static constexpr size_t default_capacity = 64 * 1024; // buckets
+    static constexpr size_t shard_count = 16;
+
+    explicit RateLimiter(size_t capacity = default_capacity);
+
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+    // Take a token from the bucket of 'address' on the route of 'limit' and, unless 'key' is
+    // empty, from the bucket of 'key' as well. False if either bucket is empty
+    bool try_acquire(const RateLimit& limit, std::string_view address,
+                     std::string_view key = {}) noexcept;
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    // bucket state: refill time in milliseconds (high half) and tokens * 1000 (low half),
+    // 0 - the bucket is full
+    struct Slot {
+      std::atomic<uint64_t> key{0}; // hash of route and key, 0 - free
+      std::atomic<uint64_t> state{0};
+    };
+
+    // separate allocation per shard, so keys of different shards do not share cache lines
+    struct Shard {
+      std::unique_ptr<Slot[]> slots;
+    };
+
+    static constexpr size_t probe_limit = 8;
+
+    // Never 0, which marks a full bucket
+    uint32_t now_ms() const noexcept;
+
+    // Take a token from the bucket of 'hash', never 0
+    bool acquire(const RateLimit& limit, uint64_t hash) noexcept;
+
+    static bool take(Slot& slot, const RateLimit& limit, uint32_t now) noexcept;
+
+  private:
+    std::array<Shard, shard_count> shards_;
+    size_t slot_mask_;
+    Clock::time_point epoch_;
+  };
+
+} // namespace routine::http
@@ -3,32 +3,62 @@
 #include "http/body_storage.hpp"
 #include "http/headers.hpp"
 #include "http/params.hpp"
+#include "http/route_policy.hpp"
 #include "http/types.hpp"
 #include <memory>
+#include <memory_resource>
+#include <string_view>
 
 namespace routine::http {
 
+  class RequestHandler;
+  class Response;
+
   class Request {
   public:
-    Request(const std::string& raw_http);
+    // Copy the message head and parse it. Strings of the request are allocated from 'resource'
+    Request(std::string_view raw_http,
+            std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    // query parameters are views into the raw message head, so Request is never copied or moved
+    Request(const Request&) = delete;
+    Request& operator=(const Request&) = delete;
 
     const Headers& headers();
+    // Drop a field of the head, e.g. Content-Encoding of a body decoded by the session
+    void erase_header(Header key) noexcept { headers_.erase(key); }
     Method method();
-    const std::string& path();
+    std::string_view path();
     Version version();
 
     std::string prepare_request() const;
 
+    // Append serialized request to 'buffer'
+    void serialize(std::string& buffer) const;
+
     routine::http::Parameters& query_params() { return query_params_; }
     routine::http::Parameters& path_params() { return path_params_; }
     std::unique_ptr<routine::http::I_BodyStorage>& body() { return body_; };
 
-  private:
-    size_t parse_query_parameters(const std::string& string);
+    // Handler resolved by the router, nullptr if not routed or answered by the router
+    const std::shared_ptr<RequestHandler>& handler() const noexcept { return handler_; }
+    // Response of the router itself (404, 405, OPTIONS) when there is no handler
+    const std::shared_ptr<Response>& route_response() const noexcept { return route_response_; }
+    // Cache and rate limit of the route
+    const RoutePolicy& route_policy() const noexcept { return route_policy_; }
+    bool is_routed() const noexcept { return is_routed_; }
+    void set_handler(std::shared_ptr<RequestHandler> handler,
+                     std::shared_ptr<Response> route_response = nullptr,
+                     RoutePolicy route_policy = {}) {
+      handler_ = std::move(handler);
+      route_response_ = std::move(route_response);
+      route_policy_ = route_policy;
+      is_routed_ = true;
+    }
 
   private:
     Method method_;
-    std::string path_;
+    std::pmr::string path_;
     routine::http::Version version_;
     routine::http::Headers headers_;
 
@@ -36,8 +66,17 @@ namespace routine::http {
     routine::http::Parameters path_params_;
 
     std::unique_ptr<I_BodyStorage> body_;
+
+    std::shared_ptr<RequestHandler> handler_;
+    std::shared_ptr<Response> route_response_;
+    RoutePolicy route_policy_;
+    bool is_routed_{false};
   };
 
   using Request_ptr = std::shared_ptr<Request>;
 
+  // Create request in an arena from the thread pool. The request, its control block, the raw
+  // head and parsed strings live in the arena, which is released when the last pointer drops
+  Request_ptr make_request(std::string_view raw_http);
+
 } // namespace routine::http
@@ -10,6 +10,8 @@
 #include <memory>
 #include <numeric>
 #include <stdexcept>
+#include <string>
+#include <string_view>
 #include <system_error>
 #include <vector>
 
@@ -31,12 +33,57 @@ namespace routine::http {
     Status& status();
     Headers& headers();
 
-    std::string prepare_response();
+    std::string prepare_response() const;
+
+    // Append serialized response to 'buffer'
+    void serialize(std::string& buffer) const;
+
+    // Append the head of a body written by the caller in chunks of
+    // I_BodyStorage::make_chunks(): with Content-Length if 'chunks' knows the size, with
+    // Transfer-Encoding: chunked otherwise
+    void serialize_stream_head(std::string& buffer, const I_BodyChunks& chunks) const;
+
+  public:
+    // Immutable response for byte-identical replies (fallbacks, health checks, fixed blobs).
+    // It is serialized once, later serializations copy the bytes and patch only the Date.
+    // Keep the pointer and return it from handlers, the response must not be modified
+    static Response_ptr make_static(Status status, Headers headers, std::string body = {});
+
+    // Static response with the body in external memory, e.g. a mapped file. Only the head is
+    // serialized, 'owner' keeps 'body' alive while the response is alive
+    static Response_ptr make_static(Status status, Headers headers, std::string_view body,
+                                    std::shared_ptr<const void> owner);
+
+    bool is_static() const noexcept { return !encoded_.empty(); }
+
+    // Append the cached head of static response with the current Date
+    void serialize_head(std::string& buffer) const;
+
+    // Cached body bytes of static response
+    std::string_view encoded_body() const noexcept {
+      if (external_owner_) return external_body_;
+      return std::string_view(encoded_).substr(encoded_head_size_);
+    }
 
   private:
     Status status_;
     Headers headers_;
     std::shared_ptr<I_BodyStorage> body_;
+
+    // static response only
+    std::string encoded_;
+    size_t encoded_head_size_{0};
+    size_t date_offset_{0};
+    std::string_view external_body_;
+    std::shared_ptr<const void> external_owner_;
+
+    // Keep 'encoded' as the serialized static response with head of 'head_size' bytes
+    void set_encoded(std::string encoded, size_t head_size);
+
+    // Status line and headers with Content-Length of 'body_size', or chunked if 'is_chunked'.
+    // Room for the body is reserved if it is appended right after
+    void serialize_head(std::string& buffer, size_t body_size, bool is_chunked,
+                        bool is_body_appended = true) const;
   };
 
 } // namespace routine::http
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "http/compression.hpp"
+#include "http/request.hpp"
+#include "http/response.hpp"
+#include "http/route_policy.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace routine::http {
+
+  // Opt-in caching of GET responses of a route. Declare it in the handler:
+  //   inline static const CachePolicy cache{std::chrono::seconds(5), {"page"}, {"accept"}};
+  struct CachePolicy {
+    std::chrono::milliseconds ttl{1000}; // 0 - responses are not stored, only coalesced
+    std::vector<std::string> query;      // query parameters which are part of the key
+    std::vector<std::string> vary;       // request headers which are part of the key
+    bool coalesce{false}; // concurrent requests with one key wait for the first of them
+  };
+
+  // Sharded LRU of pre-serialized responses with TTL and memory cap. Entries are static
+  // responses with ETag, hits are sent without serialization and without CPU workers.
+  // Thread-safe
+  class ResponseCache {
+  public:
+    static constexpr size_t default_capacity = 64 * 1024 * 1024;
+    static constexpr size_t shard_count = 16;
+
+    // Pre-serialized 200 with ETag and its 304 in every stored coding
+    struct Cached {
+      Representations representations;
+    };
+    using Cached_ptr = std::shared_ptr<const Cached>;
+
+    // Receives the response of the in-flight request. nullptr if it cannot be shared, the
+    // waiter then calls its own handler
+    using Waiter_callback = std::function<void(const Response_ptr&)>;
+
+  public:
+    explicit ResponseCache(size_t capacity = default_capacity) { set_capacity(capacity); }
+
+    ResponseCache(const ResponseCache&) = delete;
+    ResponseCache& operator=(const ResponseCache&) = delete;
+
+    // Key of the request: path with parameters, selected query parameters and Vary headers
+    static std::string make_key(Request& request, const CachePolicy& policy);
+
+    // Cached response, 304 if If-None-Match matches its ETag, or nullptr if absent or expired
+    Response_ptr find(std::string_view key, Request& request);
+
+    // Cache 200 response of a GET handler to 'request', nullptr if it is not cacheable or
+    // not shareable. Stored only with positive TTL, which fits into the capacity
+    Cached_ptr insert(std::string key, const Response_ptr& response, const CachePolicy& policy,
+                      Request& request);
+
+    // Representation for Accept-Encoding of the request: 304 if If-None-Match matches,
+    // otherwise its 200
+    static const Response_ptr& select(const Cached& cached, Request& request);
+
+    // If-None-Match contains 'etag' (weak comparison) or "*"
+    static bool is_not_modified(Request& request, std::string_view etag);
+
+    // The response to 'request' may be given to other clients: it sets no cookie, is not
+    // "no-store" or "private", and answers a request without Authorization unless it is
+    // marked "public" (RFC 9111 3, 3.5)
+    static bool is_shareable(Response& response, Request& request);
+
+    // Singleflight. Wait for the in-flight request with the key: true if 'callback' was
+    // queued, false if there is none and the caller must process the request and complete()
+    bool join(const std::string& key, Request_ptr request, Waiter_callback callback);
+
+    // Fan out the result of the first request, 'request', to the waiters. Each waiter gets
+    // 'cached' (or its 304), otherwise 'response' pre-serialized once for all of them if it
+    // is shareable. Otherwise the waiters get nullptr and call their own handler
+    void complete(const std::string& key, const Cached_ptr& cached, const Response_ptr& response,
+                  Request& request);
+
+    // Codings stored along with the identity, compressed once on insert. Disabled by
+    // default. Not thread-safe, set before serving
+    void set_compression(const CompressionPolicy& policy) { compression_ = policy; }
+
+    // Memory cap of keys and serialized responses, shared equally by the shards
+    void set_capacity(size_t bytes) noexcept {
+      shard_capacity_.store(bytes / shard_count, std::memory_order_relaxed);
+    }
+
+    // Bytes held by all shards
+    size_t size() const;
+
+    void clear();
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+      std::string key;
+      Cached_ptr cached;
+      Clock::time_point expires;
+      size_t bytes{0};
+    };
+
+    struct Waiter {
+      Request_ptr request;
+      Waiter_callback callback;
+    };
+
+    struct Shard {
+      mutable std::mutex mutex;
+      std::list<Entry> entries; // most recently used first
+      std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+      size_t bytes{0};
+
+      // in-flight requests by key, with the requests waiting for them
+      std::unordered_map<std::string, std::vector<Waiter>> flights;
+
+      void erase(std::list<Entry>::iterator it);
+    };
+
+    Shard& shard(std::string_view key) noexcept;
+
+  private:
+    std::array<Shard, shard_count> shards_;
+    std::atomic<size_t> shard_capacity_{0};
+    CompressionPolicy compression_{.encodings = encoding_bit(Encoding::Identity)};
+  };
+
+} // namespace routine::http
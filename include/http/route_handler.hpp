@@ -1,25 +1,55 @@
 #pragma once
 
+#include "http/rate_limiter.hpp"
+#include "http/response_cache.hpp"
+#include "http/static_files.hpp"
 #include "request_handler.hpp"
 #include "utils/utils.hpp"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <forward_list>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
 #include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace routine::http {
 
+  // Router of request paths to handlers. Registered routes form a segment tree, which is
+  // compiled into a radix tree: chains of static segments are merged into one node and
+  // children of every node are stored contiguously and sorted, so lookup does not allocate.
+  // Leaves dispatch by request method, the router answers 404, 405 and OPTIONS itself
   class RouteHandler : private spdlog::logger {
+  public:
     using Handler_creator = std::function<std::shared_ptr<routine::http::RequestHandler>()>;
-    using Handler_creator_ptr = std::unique_ptr<Handler_creator>;
 
-    struct ResourceHandler {
-      Handler_creator_ptr resource;
-      std::unordered_map<std::string, ResourceHandler> nodes;
+    // Path parameters of one route, deeper routes are rejected
+    static constexpr size_t max_path_params = 16;
+
+    // Handler of the request, or a response of the router itself: 404, 405 or OPTIONS
+    struct Route {
+      std::shared_ptr<routine::http::RequestHandler> handler;
+      Response_ptr response;
+      RoutePolicy policy;
+    };
+
+    // CORS preflight answered by the router for paths without OPTIONS handler
+    struct CorsPolicy {
+      std::string allow_origin{"*"};
+      std::string allow_headers; // empty - allow the requested headers
+      std::chrono::seconds max_age{600};
     };
 
   public:
-    RouteHandler() : spdlog::logger(*spdlog::get("Router")) {}
+    RouteHandler() : spdlog::logger(*spdlog::get("Router")) { builder_.emplace_back(); }
 
 #if defined(__cplusplus) && __cplusplus >= 202002L
     // C++20 and newer
@@ -29,82 +59,164 @@ namespace routine::http {
     // C++17 and lower
     template <typename T, typename = std::enable_if_t<std::is_base_of_v<RequestHandler, T>>>
 #endif
-    void add_handler() {
+    void add_handler(HandlerLifetime lifetime = handler_lifetime<T>()) {
+      add_handler<T>(handler_method<T>(), lifetime);
+    }
+
+#if defined(__cplusplus) && __cplusplus >= 202002L
+    // C++20 and newer
+    template <typename T>
+      requires std::is_base_of_v<RequestHandler, T>
+#else
+    // C++17 and lower
+    template <typename T, typename = std::enable_if_t<std::is_base_of_v<RequestHandler, T>>>
+#endif
+    void add_handler(Method method, HandlerLifetime lifetime = handler_lifetime<T>()) {
       static_assert(
-          std::is_same_v<decltype(T::path), const std::string>,
+          std::is_convertible_v<decltype(T::path), std::string_view>,
           "\n\n\tYou need to define 'path' field in the 'RouteHandler::add_handler<T>()' handler."
-          "\n\tType 'T' must contain T::path with 'const std::string' type."
+          "\n\tType 'T' must contain T::path with 'const std::string' or 'std::string_view' type."
           "\n\tFor more details, see '/docs/http/RequestHandler'\n");
 
-      auto lambda_handler_creator =
-          std::make_unique<Handler_creator>([]() { return std::make_shared<T>(); });
-
-      if (T::path.find('{') == std::string::npos) {
-        // Static Handlers
-        info("Successfully added a static handler for '{}'", T::path);
-        static_handlers_[routine::utils::format_path(T::path)] = std::move(lambda_handler_creator);
-      } else {
-        // Dynamic Handlers
-        ResourceHandler* node = &dynamic_handlers_;
-        std::string current_full_path{'/'};
-        std::string path{T::path};
-        auto path_parts = routine::utils::split_string<std::string>(path, '/', 4);
-
-        for (const auto& key : path_parts) {
-          // check if key is a path parameter
-          if (key[0] == '{') {
-            auto it = std::find_if(node->nodes.begin(), node->nodes.end(),
-                                   [](const std::pair<const std::string, ResourceHandler>& pair) {
-                                     return pair.first[0] == '{';
-                                   });
-
-            // if current level already have parameter AND it is not equal to the current one
-            if (it != node->nodes.end() && it->first != key)
-              throw std::invalid_argument(
-                  std::format("The path '{}' already has a another parameter '{}' on it.",
-                              current_full_path + key, it->first));
-          }
-
-          node = &node->nodes[key];
-          current_full_path.append(key);
-        }
-
-        info("Successfully added a dynamic handler for '{}'", T::path);
-        node->resource = std::move(lambda_handler_creator);
+      switch (lifetime) {
+        case HandlerLifetime::Singleton:
+          add_handler(T::path, method, &make_handler<T, HandlerLifetime::Singleton>,
+                      handler_policy<T>());
+          break;
+        case HandlerLifetime::PerThread:
+          add_handler(T::path, method, &make_handler<T, HandlerLifetime::PerThread>,
+                      handler_policy<T>(thread_handler<T, HandlerLifetime::PerThread>()));
+          break;
+        case HandlerLifetime::PerRequest:
+          add_handler(T::path, method, &make_handler<T, HandlerLifetime::PerRequest>,
+                      handler_policy<T>());
+          break;
       }
     }
 
-    std::shared_ptr<routine::http::RequestHandler> route(Request& request) {
-      // check if ResourceHandler have in static_handlers_
-      if (auto it = static_handlers_.find(request.path()); it != static_handlers_.end())
-        return (*it->second)();
-
-      // otherwise search in dynamic_handlers_
-      ResourceHandler* node = &dynamic_handlers_;
-      auto path_parts = routine::utils::split_string<std::string>(request.path(), '/', 4);
-
-      for (const auto& key : path_parts) {
-        auto it = node->nodes.find(key);
-        if (it == node->nodes.end()) {
-          // if key not found, look for the presence of the parameter at this level
-          it = std::find_if(node->nodes.begin(), node->nodes.end(),
-                            [](const std::pair<const std::string&, ResourceHandler&> pair) {
-                              return pair.first[0] == '{';
-                            });
-          if (it == node->nodes.end())
-            return nullptr;
-          else
-            request.path_params().emplace(it->first.substr(1, it->first.size() - 2), key);
-        }
-        node = &it->second;
-      }
+    // Register handler creator of any method for 'path'. Segments "{name}" are path parameters,
+    // the last segment "{*name}" captures the rest of the path, e.g. "/assets/{*file}"
+    void add_handler(std::string_view path, Handler_creator creator);
+
+    // Register handler creator of 'method' for 'path', Method::None means any method.
+    // 'policy' sets the response cache and the rate limit of the route. Throws
+    // std::logic_error once the router is compiled
+    void add_handler(std::string_view path, Method method, Handler_creator creator,
+                     RoutePolicy policy = {});
+
+    // Routes of a compile-time RouteTable<Handlers...>, looked up before the routes added
+    // at runtime. One table per router, compile() throws std::logic_error if a runtime route
+    // has the path of a table route
+    template <typename Table>
+    void add_table() {
+      if (is_compiled_)
+        throw std::logic_error("Route table added after the router was compiled");
+      if (table_) throw std::logic_error("The router already has a route table");
+      table_ = &Table::route;
+      table_allowed_.assign(Table::allowed.begin(), Table::allowed.end());
+      table_paths_.assign(Table::keys.begin(), Table::keys.end());
+    }
+
+    // Build the lookup tree. Called by Scheduler::set_router(), routes are added before it:
+    // later additions throw std::logic_error, so routing threads read the tree without locks
+    void compile();
+
+    // Serve GET requests under 'prefix' from 'files', e.g. add_static("/assets", files)
+    void add_static(std::string_view prefix, std::shared_ptr<StaticFiles> files);
+
+    // Response for requests without handler. Static responses are sent without serialization
+    void set_not_found(Response_ptr response) { not_found_ = std::move(response); }
+    const Response_ptr& not_found() const noexcept { return not_found_; }
 
-      return node->resource ? (*node->resource)() : nullptr;
+    static Response_ptr default_not_found() {
+      static const Response_ptr response =
+          Response::make_static(Status::Not_Found, Headers{}, "Requested resource not found");
+      return response;
     }
 
+    // Answer CORS preflight requests. Disabled by default
+    void set_cors(CorsPolicy policy) { cors_ = std::move(policy); }
+
+    // Find handler for the request path and method and write path parameters into the
+    // request. Static segments take precedence over parameters. The router must be compiled
+    Route route(Request& request);
+
+  private:
+    static constexpr uint32_t npos = static_cast<uint32_t>(-1);
+
+    // Uncompressed node of registered routes, one per path segment
+    struct BuildNode {
+      std::vector<std::pair<std::string_view, uint32_t>> children; // static segment -> node
+      std::string_view parameter_name;
+      uint32_t parameter{npos};
+      uint32_t tail{npos}; // "{*name}" child, its name is 'parameter_name' of the child
+      uint32_t leaf{npos};
+    };
+
+    // Compiled node. Static children are [children_begin, children_end) sorted by 'first'
+    // with segment_less()
+    struct Node {
+      std::string_view label; // static segment or parameter name
+      std::string_view first; // first segment of 'label'
+      uint32_t children_begin{0};
+      uint32_t children_end{0};
+      uint32_t parameter{npos};
+      uint32_t tail{npos};
+      uint32_t leaf{npos};
+    };
+
+    // Handlers of one path, indexes in 'handlers_'
+    struct Leaf {
+      MethodHandlers handlers;
+      uint16_t allowed{0};
+    };
+
+    // Pre-serialized answers for one set of allowed methods
+    struct MethodResponses {
+      std::string allow;
+      Response_ptr options;     // 204 with Allow
+      Response_ptr not_allowed; // 405 with Allow
+    };
+
+    struct Captures {
+      std::array<std::pair<std::string_view, std::string_view>, max_path_params> params;
+      size_t size{0};
+    };
+
+    // Order of children: by length, then by bytes. Most comparisons do not reach memcmp
+    static bool segment_less(std::string_view left, std::string_view right) noexcept {
+      if (left.size() != right.size()) return left.size() < right.size();
+      return left < right;
+    }
+
+    bool match(uint32_t index, std::string_view path, Captures& captures, uint32_t& leaf) const;
+
+    // Build node of a formatted path, parameters match whatever their names. npos if the path
+    // has no node
+    uint32_t find_built(std::string_view path) const;
+
+    static MethodResponses make_method_responses(uint16_t allowed);
+    Response_ptr method_response(Request& request, uint16_t allowed, bool is_preflight) const;
+
   private:
-    ResourceHandler dynamic_handlers_;
-    std::unordered_map<std::string, Handler_creator_ptr> static_handlers_;
+    std::forward_list<std::string> paths_;  // formatted paths, segments are views into them
+    std::forward_list<std::string> labels_; // merged labels of compiled nodes
+    std::vector<BuildNode> builder_;
+    std::vector<Node> nodes_;
+    std::vector<Leaf> leaves_;
+    std::vector<Handler_creator> handlers_;
+    std::vector<RoutePolicy> policies_; // by handler index
+    bool is_compiled_{false};
+
+    RouteMatch (*table_)(Request&, bool){nullptr};
+    std::vector<uint16_t> table_allowed_;
+    std::vector<std::string_view> table_paths_; // in the form of Request::path()
+
+    // by allowed methods, filled by compile()
+    std::unordered_map<uint16_t, MethodResponses> method_responses_;
+    std::optional<CorsPolicy> cors_;
+
+    Response_ptr not_found_{default_not_found()};
   };
 
 } // namespace routine::http
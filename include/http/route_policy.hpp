@@ -0,0 +1,58 @@
+#pragma once
+
+#include <memory>
+
+namespace routine::http {
+
+  struct CachePolicy;
+  class RateLimit;
+  struct BodyChunkPolicy;
+  class RequestHandler;
+
+  // Optional behaviour of a route, declared as static members of the handler:
+  //   inline static const CachePolicy cache{...};
+  //   inline static const RateLimit rate_limit{...};
+  //   inline static const BodyChunkPolicy body_chunks{...};
+  struct RoutePolicy {
+    const CachePolicy* cache{nullptr};
+    const RateLimit* rate_limit{nullptr};
+    const BodyChunkPolicy* body_chunks{nullptr};
+    // Instance of a HandlerLifetime::PerThread handler for the calling thread, CPU workers
+    // call it instead of using the instance routed on the IO thread
+    std::shared_ptr<RequestHandler> (*thread_handler)(){nullptr};
+  };
+
+  // &T::cache or nullptr
+  template <typename T>
+  constexpr const CachePolicy* handler_cache() {
+    if constexpr (requires { T::cache; })
+      return &T::cache;
+    else
+      return nullptr;
+  }
+
+  // &T::rate_limit or nullptr
+  template <typename T>
+  constexpr const RateLimit* handler_rate_limit() {
+    if constexpr (requires { T::rate_limit; })
+      return &T::rate_limit;
+    else
+      return nullptr;
+  }
+
+  // &T::body_chunks or nullptr
+  template <typename T>
+  constexpr const BodyChunkPolicy* handler_body_chunks() {
+    if constexpr (requires { T::body_chunks; })
+      return &T::body_chunks;
+    else
+      return nullptr;
+  }
+
+  template <typename T>
+  constexpr RoutePolicy
+  handler_policy(std::shared_ptr<RequestHandler> (*thread_handler)() = nullptr) {
+    return {handler_cache<T>(), handler_rate_limit<T>(), handler_body_chunks<T>(), thread_handler};
+  }
+
+} // namespace routine::http
@@ -0,0 +1,320 @@
+#pragma once
+
+#include "http/request.hpp"
+#include "http/route_policy.hpp"
+#include "request_handler.hpp"
+#include "utils/perfect_hash.hpp"
+#include "utils/simd.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace routine::http {
+
+  namespace detail {
+    inline constexpr uint32_t route_npos = static_cast<uint32_t>(-1);
+
+    // T::path must be a constant expression, e.g. 'static constexpr std::string_view path'
+    template <typename T>
+    concept ConstexprRoute =
+        std::is_base_of_v<RequestHandler, T> &&
+        requires { typename std::integral_constant<size_t, std::string_view(T::path).size()>; };
+
+    // "/a/{b}/c" -> "a/{b}/c", the form of Request::path()
+    consteval std::string_view route_key(std::string_view path) {
+      if (path.empty() || path.front() != '/') throw "RouteTable: path must start with '/'";
+      path.remove_prefix(1);
+      if (!path.empty() && path.back() == '/') throw "RouteTable: path must not end with '/'";
+      if (path.find("//") != std::string_view::npos) throw "RouteTable: empty path segment";
+      if (path.find("{*") != std::string_view::npos)
+        throw "RouteTable: rest parameters are supported by RouteHandler only";
+      return path;
+    }
+
+    constexpr bool is_parameterized(std::string_view key) {
+      return key.find('{') != std::string_view::npos;
+    }
+
+    constexpr size_t segment_count(std::string_view key) {
+      return key.empty() ? 0 : std::count(key.begin(), key.end(), '/') + 1;
+    }
+
+    // Node of the trie over parameterized routes. Static children are
+    // [children_begin, children_end), the parameter child is stored separately
+    struct RouteTableNode {
+      std::string_view segment; // static segment or parameter name
+      uint32_t children_begin{0};
+      uint32_t children_end{0};
+      uint32_t parameter{route_npos};
+      uint32_t leaf{route_npos};
+    };
+  } // namespace detail
+
+  // Route table generated at compile time from a list of handler types. Static paths are
+  // found with a perfect hash, parameterized paths with a constexpr trie. Handlers of one path
+  // are dispatched by T::method. Duplicate paths and methods and different parameter names on
+  // one level are compile errors.
+  //
+  //   using Routes = RouteTable<UsersHandler, UserHandler, HealthHandler>;
+  //   router->add_table<Routes>();
+  //
+  // Handlers declare 'static constexpr std::string_view path' in normalized form
+  template <detail::ConstexprRoute... Handlers>
+  class RouteTable {
+    static constexpr size_t handler_count = sizeof...(Handlers);
+
+  public:
+    // Find handler for the request path and method and write path parameters into the
+    // request. Static paths take precedence over parameters
+    static RouteMatch route(Request& request, bool is_preflight = false) {
+      uint32_t leaf = find_leaf(request);
+      if (leaf == detail::route_npos) return {};
+
+      uint32_t handler = select_handler(leaves[leaf], request.method(), is_preflight);
+      if (handler == no_handler) return {nullptr, allowed[leaf]};
+      return {creators[handler](), 0, policies[handler]};
+    }
+
+    // Paths of the handlers in the form of Request::path(), e.g. "a/{b}/c"
+    static constexpr std::array<std::string_view, handler_count> keys{
+        detail::route_key(Handlers::path)...};
+
+  private:
+    static constexpr std::array<Method, handler_count> methods{handler_method<Handlers>()...};
+
+    static constexpr std::array<RequestHandler_ptr (*)(), handler_count> creators{
+        &make_handler<Handlers>...};
+
+    static constexpr std::array<RoutePolicy, handler_count> policies{
+        handler_policy<Handlers>(thread_handler<Handlers>())...};
+
+    // Handlers of one path share a leaf, indexed by the first of them
+    static constexpr std::array<uint32_t, handler_count> leaf_of = [] {
+      std::array<uint32_t, handler_count> result{};
+      for (size_t i = 0; i < handler_count; ++i)
+        result[i] = std::find(keys.begin(), keys.end(), keys[i]) - keys.begin();
+      return result;
+    }();
+
+    static constexpr std::array<MethodHandlers, handler_count> leaves = [] {
+      std::array<MethodHandlers, handler_count> result;
+      for (auto& leaf : result)
+        leaf.fill(no_handler);
+      for (size_t i = 0; i < handler_count; ++i) {
+        auto& slot = result[leaf_of[i]][static_cast<size_t>(methods[i])];
+        if (slot != no_handler) throw "RouteTable: duplicate path and method";
+        slot = i;
+      }
+      return result;
+    }();
+
+  public:
+    // Allowed methods of every path, 0 for handlers sharing the path of a previous one
+    static constexpr std::array<uint16_t, handler_count> allowed = [] {
+      std::array<uint16_t, handler_count> result{};
+      for (size_t i = 0; i < handler_count; ++i)
+        if (leaf_of[i] == i) result[i] = allowed_methods(leaves[i]);
+      return result;
+    }();
+
+  private:
+    static constexpr bool is_static_leaf(size_t i) {
+      return leaf_of[i] == i && !detail::is_parameterized(keys[i]);
+    }
+    static constexpr bool is_dynamic_leaf(size_t i) {
+      return leaf_of[i] == i && detail::is_parameterized(keys[i]);
+    }
+
+    static constexpr size_t static_count = [] {
+      size_t count = 0;
+      for (size_t i = 0; i < handler_count; ++i)
+        count += is_static_leaf(i);
+      return count;
+    }();
+    static constexpr size_t dynamic_count = [] {
+      size_t count = 0;
+      for (size_t i = 0; i < handler_count; ++i)
+        count += is_dynamic_leaf(i);
+      return count;
+    }();
+
+    // Static paths, leaves[i] is the leaf of keys[i]
+    template <size_t N>
+    struct StaticRoutes {
+      std::array<std::string_view, N> keys{};
+      std::array<uint32_t, N> leaves{};
+    };
+
+    static constexpr StaticRoutes<static_count> static_routes = [] {
+      StaticRoutes<static_count> routes;
+      for (size_t i = 0, j = 0; i < handler_count; ++i)
+        if (is_static_leaf(i)) {
+          routes.keys[j] = keys[i];
+          routes.leaves[j++] = i;
+        }
+      return routes;
+    }();
+    static constexpr auto static_keys = static_routes.keys;
+    static constexpr auto static_leaves = static_routes.leaves;
+    static constexpr auto static_hash = routine::utils::make_perfect_hash(static_keys);
+
+    // Upper bound of trie nodes: root and one node per segment
+    static constexpr size_t node_limit = [] {
+      size_t count = 1;
+      for (size_t i = 0; i < handler_count; ++i)
+        if (is_dynamic_leaf(i)) count += detail::segment_count(keys[i]);
+      return count;
+    }();
+
+    static constexpr size_t max_params = [] {
+      size_t result = 0;
+      for (auto key : keys)
+        result = std::max<size_t>(result, std::count(key.begin(), key.end(), '{'));
+      return result;
+    }();
+
+    struct Trie {
+      std::array<detail::RouteTableNode, node_limit> nodes{};
+      size_t size{0};
+    };
+
+    // Insert every parameterized route into a segment tree, then emit it breadth-first so
+    // static children of each node are contiguous
+    static consteval Trie make_trie() {
+      struct BuildNode {
+        std::string_view segment;
+        bool is_parameter{false};
+        uint32_t parent{detail::route_npos};
+        uint32_t leaf{detail::route_npos};
+      };
+      std::array<BuildNode, node_limit> build{};
+      size_t build_size = 1;
+
+      for (size_t route = 0; route < handler_count; ++route) {
+        if (!is_dynamic_leaf(route)) continue;
+        std::string_view key = keys[route];
+
+        uint32_t node = 0;
+        while (!key.empty()) {
+          size_t end = std::min(key.find('/'), key.size());
+          std::string_view segment = key.substr(0, end);
+          key.remove_prefix(std::min(end + 1, key.size()));
+
+          bool is_parameter = segment.front() == '{';
+          if (is_parameter) {
+            if (segment.back() != '}' || segment.size() < 3)
+              throw "RouteTable: invalid path parameter";
+            segment = segment.substr(1, segment.size() - 2);
+          }
+
+          uint32_t child = detail::route_npos;
+          for (uint32_t i = 1; i < build_size; ++i) {
+            if (build[i].parent != node || build[i].is_parameter != is_parameter) continue;
+            if (is_parameter && build[i].segment != segment)
+              throw "RouteTable: another parameter name on the same level";
+            if (build[i].segment == segment) child = i;
+          }
+
+          if (child == detail::route_npos) {
+            child = build_size++;
+            build[child] = {segment, is_parameter, node, detail::route_npos};
+          }
+          node = child;
+        }
+
+        if (build[node].leaf != detail::route_npos) throw "RouteTable: duplicate path";
+        build[node].leaf = route;
+      }
+
+      Trie trie;
+      std::array<uint32_t, node_limit> queue{}; // compiled node -> build node
+      trie.size = 1;
+      for (size_t index = 0; index < trie.size; ++index) {
+        uint32_t source = queue[index];
+        auto& node = trie.nodes[index];
+        node.leaf = build[source].leaf;
+
+        node.children_begin = trie.size;
+        for (uint32_t i = 1; i < build_size; ++i)
+          if (build[i].parent == source && !build[i].is_parameter) {
+            trie.nodes[trie.size].segment = build[i].segment;
+            queue[trie.size++] = i;
+          }
+        node.children_end = trie.size;
+
+        for (uint32_t i = 1; i < build_size; ++i)
+          if (build[i].parent == source && build[i].is_parameter) {
+            node.parameter = trie.size;
+            trie.nodes[trie.size].segment = build[i].segment;
+            queue[trie.size++] = i;
+          }
+      }
+
+      return trie;
+    }
+
+    static constexpr Trie trie = make_trie();
+
+    struct Captures {
+      std::array<std::pair<std::string_view, std::string_view>, max_params> params;
+      size_t size{0};
+    };
+
+    // Leaf of the request path or route_npos
+    static uint32_t find_leaf(Request& request) {
+      std::string_view path = request.path();
+
+      if constexpr (static_count > 0) {
+        size_t index = static_hash.find(path);
+        if (index != static_hash.npos && static_keys[index] == path) return static_leaves[index];
+      }
+
+      if constexpr (dynamic_count > 0) {
+        Captures captures;
+        uint32_t leaf = detail::route_npos;
+        if (match(0, path, captures, leaf)) {
+          auto& path_params = request.path_params();
+          for (size_t i = 0; i < captures.size; ++i)
+            path_params.emplace_view(captures.params[i].first, captures.params[i].second);
+          return leaf;
+        }
+      }
+
+      return detail::route_npos;
+    }
+
+    static bool match(uint32_t index, std::string_view path, Captures& captures,
+                      uint32_t& leaf) {
+      const auto& node = trie.nodes[index];
+      if (path.empty()) {
+        leaf = node.leaf;
+        return leaf != detail::route_npos;
+      }
+
+      size_t segment_end = routine::utils::simd::find_char(path.data(), path.size(), '/');
+      std::string_view segment = path.substr(0, segment_end);
+      std::string_view rest = path.substr(std::min(segment_end + 1, path.size()));
+
+      for (uint32_t child = node.children_begin; child < node.children_end; ++child)
+        if (trie.nodes[child].segment == segment) {
+          if (match(child, rest, captures, leaf)) return true;
+          break;
+        }
+
+      // static branch did not match, try parameter of this level
+      if (node.parameter != detail::route_npos) {
+        captures.params[captures.size++] = {trie.nodes[node.parameter].segment, segment};
+        if (match(node.parameter, rest, captures, leaf)) return true;
+        --captures.size;
+      }
+
+      return false;
+    }
+  };
+
+} // namespace routine::http
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "http/headers.hpp"
+#include "http/types.hpp"
+#include "utils/utils.hpp"
+#include <charconv>
+#include <concepts>
+#include <limits>
+#include <string>
+#include <string_view>
+
+namespace routine::http {
+
+  // Writes parts of HTTP message into a reusable output buffer. Serializer only appends,
+  // so the buffer keeps its capacity between messages and may hold several of them
+  class Serializer {
+  public:
+    static constexpr std::string_view crlf{"\r\n"};
+    static constexpr std::string_view default_server{"server: RoutineHttpLibrary\r\n"};
+    static constexpr std::string_view default_user_agent{"user-agent: Asio/RoutineHttp\r\n"};
+
+  public:
+    explicit Serializer(std::string& buffer) noexcept : buffer_(buffer) {}
+
+    // Reserve 'size' bytes more than already written
+    void reserve(size_t size) { buffer_.reserve(buffer_.size() + size); }
+
+    Serializer& append(std::string_view string) {
+      buffer_.append(string);
+      return *this;
+    }
+
+    Serializer& append(char c) {
+      buffer_.push_back(c);
+      return *this;
+    }
+
+    template <std::integral T>
+    Serializer& append_number(T value) {
+      char digits[std::numeric_limits<T>::digits10 + 2];
+      auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), value);
+      buffer_.append(digits, end);
+      return *this;
+    }
+
+    // "key: value\r\n" with the precomputed prefix of well-known header
+    Serializer& header(routine::http::Header key, std::string_view value) {
+      buffer_.append(utils::header_prefix(key)).append(value).append(crlf);
+      return *this;
+    }
+
+    Serializer& header(std::string_view key, std::string_view value) {
+      buffer_.append(key).append(": ").append(value).append(crlf);
+      return *this;
+    }
+
+    Serializer& header(const HeaderField& field) {
+      return field.id() != Header::None ? header(field.id(), field.value())
+                                        : header(field.key(), field.value());
+    }
+
+    template <std::integral T>
+    Serializer& header(routine::http::Header key, T value) {
+      buffer_.append(utils::header_prefix(key));
+      append_number(value);
+      buffer_.append(crlf);
+      return *this;
+    }
+
+    // Approximate size of the header lines, used to pre-size the buffer
+    static size_t estimate(const Headers& headers) {
+      size_t size = 0;
+      for (const auto& field : headers)
+        size += field.key().size() + field.value().size() + 4;
+      return size;
+    }
+
+    std::string& buffer() noexcept { return buffer_; }
+
+  private:
+    std::string& buffer_;
+  };
+
+} // namespace routine::http
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "http/compression.hpp"
+#include "http/request.hpp"
+#include "http/response.hpp"
+#include "request_handler.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <spdlog/logger.h>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+namespace routine::http {
+
+  // GET handler of the files of a directory:
+  //   router->add_static("/assets", std::make_shared<StaticFiles>("./public"));
+  //
+  // Small files are kept as pre-serialized responses in a bounded LRU, along with their
+  // compressed codings. Larger ones keep their descriptor open and are read with pread()
+  // while they are sent, a file truncated meanwhile closes the connection of the response
+  // instead of faulting. Responses carry ETag and Last-Modified: conditional requests get
+  // 304, a single byte range gets 206. Cached files are dropped on inotify events of the
+  // directory tree, so hits do not stat the file. Without inotify every hit is revalidated
+  // by stat. Thread-safe
+  class StaticFiles : public RequestHandler, private spdlog::logger {
+  public:
+    struct Options {
+      size_t cache_capacity{32 * 1024 * 1024}; // bytes of small files held in memory
+      size_t max_cached_size{256 * 1024};      // larger files are read while they are sent
+      size_t max_open_files{256};              // descriptors of larger files held by the LRU
+      std::string index{"index.html"}; // file of a directory
+      std::string cache_control;       // Cache-Control of the responses, none if empty
+      CompressionPolicy compression;   // codings of small files, compressed once on load
+    };
+
+    // Path parameter with the file, see RouteHandler::add_static()
+    static constexpr std::string_view parameter{"file"};
+
+    explicit StaticFiles(std::filesystem::path root);
+    StaticFiles(std::filesystem::path root, Options options);
+    ~StaticFiles() override;
+
+    StaticFiles(const StaticFiles&) = delete;
+    StaticFiles& operator=(const StaticFiles&) = delete;
+
+    Response_ptr process_request(Request_ptr request) override;
+
+    // Drop cached files, they are read again on the next request
+    void clear();
+
+  private:
+    struct File {
+      Representations representations;  // identity in memory or on the disk, codings in memory
+      std::string_view bytes;            // body in memory for byte ranges
+      std::shared_ptr<const void> owner; // keeps 'bytes' alive
+      std::shared_ptr<const int> fd;     // of a file read while it is sent
+      Headers headers;                   // headers of partial responses
+      std::string etag; // of the identity
+      std::string last_modified;
+      std::time_t modified{0};
+      int64_t modified_ns{0}; // identity of the content for revalidation by stat
+      size_t size{0};
+      size_t cost{0}; // bytes in memory
+      bool is_open{false}; // holds 'fd'
+      bool is_cacheable{true}; // false if the path goes through a symlink
+    };
+    using File_ptr = std::shared_ptr<const File>;
+
+    struct Entry {
+      std::string key;
+      File_ptr file;
+    };
+
+    // File by path relative to the root, the index file for directories. nullptr if it is
+    // absent or outside of the root
+    File_ptr find(const std::string& key, bool is_index = false);
+    File_ptr lookup(const std::string& key);
+    File_ptr load(const std::string& key, bool& is_directory);
+    void insert(const std::string& key, const File_ptr& file, uint64_t generation);
+
+    // Drop the file, or every file under the directory
+    void erase(std::string_view key, bool is_directory);
+    void remove(std::list<Entry>::iterator it);
+
+    // 200, 206, 304 or 416 for the request
+    Response_ptr respond(const File_ptr& file, Request& request) const;
+    Response_ptr partial(const File_ptr& file, std::string_view range) const;
+
+    static bool is_not_modified(const File& file, std::string_view etag, Request& request);
+
+    // inotify watch of the directory 'relative' to the root and of its subdirectories
+    void watch(const std::string& relative);
+    void run_watcher();
+
+  private:
+    std::filesystem::path root_; // canonical
+    Options options_;
+
+    std::mutex mutex_;
+    std::list<Entry> entries_; // most recently used first
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> index_;
+    size_t bytes_{0};
+    size_t open_{0};
+
+    // changed by every event, files loaded during an event are not cached
+    std::atomic<uint64_t> generation_{0};
+
+    std::atomic<bool> is_watching_{false};
+    int inotify_fd_{-1};
+    int stop_fd_{-1};
+    std::unordered_map<int, std::string> watches_; // descriptor -> directory, watcher only
+    std::thread watcher_;
+  };
+
+} // namespace routine::http
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+
 namespace routine::http {
   enum class Method : uint8_t {
     None,
@@ -15,6 +17,9 @@ namespace routine::http {
     Trace
   };
 
+  // Number of methods. Keep in sync with the last routine::http::Method value
+  inline constexpr size_t method_count = static_cast<size_t>(Method::Trace) + 1;
+
   enum class Header {
     None,
     Host,
@@ -39,8 +44,25 @@ namespace routine::http {
     Access_Control_Allow_Origin,
     Access_Control_Allow_Methods,
     Transfer_Encoding,
+    Allow,
+    Vary,
+    Access_Control_Allow_Headers,
+    Access_Control_Max_Age,
+    Access_Control_Request_Method,
+    Access_Control_Request_Headers,
+    ETag,
+    If_None_Match,
+    Retry_After,
+    If_Modified_Since,
+    Range,
+    If_Range,
+    Content_Range,
+    Accept_Ranges,
   };
 
+  // Number of well-known headers. Keep in sync with the last routine::http::Header value
+  inline constexpr size_t header_count = static_cast<size_t>(Header::Accept_Ranges) + 1;
+
   enum class Version : uint8_t { None = 0, Http10 = 10, Http11 = 11, Http2 = 20, Http3 = 30 };
 
   enum class Status : uint16_t {
@@ -3,11 +3,17 @@
 #include "http/request.hpp"
 #include "http/response.hpp"
 #include "scheduler.hpp"
+#include "utils/memory_budget.hpp"
 #include <chrono>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <spdlog/logger.h>
+#include <string>
+#include <string_view>
 #include <system_error>
+#include <vector>
 
 #ifdef USE_BOOST_ASIO
 #include <boost/asio.hpp>
@@ -45,20 +51,145 @@ namespace routine::net {
   private:
     void run_timeout_timer();
 
+    // Read and process the next request, run_process() waits for the memory budget first
+    void read_next_request();
+
+    // Check 'has_room' every retry interval of the memory budget until it is true or
+    // 'deadline' passes, the socket is not read meanwhile. The callback gets the last result
+    void wait_for_memory(std::function<bool()> has_room,
+                         std::chrono::steady_clock::time_point deadline,
+                         std::function<void(bool)> callback);
+
     bool is_errors(const std::error_code& ec);
 
+    // Serialize message into the pending output buffer and start writing if socket is idle
+    template <typename T>
+    void enqueue_write(const T& message, std::function<void(const std::error_code&)> callback);
+
+    // Queue bytes which are not a message, e.g. an interim "100 Continue", behind the
+    // output enqueued before them
+    void enqueue_bytes(std::string_view bytes,
+                       std::function<void(const std::error_code&)> callback);
+
+    // Write head of static response and reference its cached body
+    void enqueue_static(routine::http::Response_ptr response,
+                        std::function<void(const std::error_code&)> callback);
+
+    // Write head of a response with chunked body and its first chunk, the next chunks are
+    // produced as the previous ones are sent
+    void enqueue_stream(routine::http::Response_ptr response,
+                        std::unique_ptr<routine::http::I_BodyChunks> chunks,
+                        std::function<void(const std::error_code&)> callback);
+
+    // Write the head of a streamed response and its first chunk. 'write_mutex_' must be locked
+    void start_stream(routine::http::Response_ptr response,
+                      std::unique_ptr<routine::http::I_BodyChunks> chunks, Write_callback callback);
+
+    // Append the next chunk of the streamed body, and the messages which waited for it after
+    // the last one. A body which ends short of its Content-Length closes the connection
+    // instead. 'write_mutex_' must be locked
+    void append_chunk();
+
+    // Swap pending output into the write buffer and send it. 'write_mutex_' must be locked
+    void do_write();
+
   private:
     std::string address_;
 
     routine::Scheduler_ptr scheduler_;
     asio::ip::tcp::socket socket_;
+    // serializes the handlers which may otherwise run at once on the IO threads: timers,
+    // reads of body pieces and continuations posted by CPU tasks
+    asio::strand<asio::io_context::executor_type> strand_;
 
     asio::steady_timer timeout_timer_;
     std::chrono::milliseconds timeout_;
 
+    // paused reads wait for the memory budget on it
+    asio::steady_timer budget_timer_;
+    // bytes a request head may take, reads of the next one wait until the budget holds them
+    static constexpr size_t head_reserve = 8 * 1024;
+
+    // Output is double buffered: messages are serialized into 'pending_buffer_' while
+    // 'write_buffer_' is being sent. Both keep their capacity for the session lifetime
+    static constexpr size_t output_buffer_size = 4096;
+
+    // bodies of static responses from this size are sent from their cache without copying
+    static constexpr size_t external_body_size = 1024;
+
+    using Write_callback = std::function<void(const std::error_code&)>;
+
+    // Bytes sent from outside of the output buffer, inserted at 'position' of the buffer
+    struct External_output {
+      size_t position;
+      std::string_view bytes;
+      std::shared_ptr<const void> holder; // keeps 'bytes' alive until the write is complete
+    };
+
+    std::mutex write_mutex_;
+    bool is_writing_{false};
+    bool is_closing_{false}; // "Connection: close" waits until the output is sent
+    std::string write_buffer_;
+    std::string pending_buffer_;
+    std::vector<External_output> write_external_;
+    std::vector<External_output> pending_external_;
+    std::vector<asio::const_buffer> write_sequence_;
+    std::vector<Write_callback> write_callbacks_;
+    std::vector<Write_callback> pending_callbacks_;
+    routine::utils::MemoryCharge write_charge_; // of both output buffers
+
+    // bytes of a streamed body produced per write
+    static constexpr size_t stream_chunk_size = 16 * 1024;
+
+    // Response whose body is produced while it is sent
+    struct Stream_output {
+      routine::http::Response_ptr response; // keeps the body alive
+      std::unique_ptr<routine::http::I_BodyChunks> chunks;
+      Write_callback callback;
+      std::optional<uint64_t> remaining{}; // bytes still due of a body with Content-Length
+    };
+
+    // Message enqueued during a stream, written after its last chunk. Either a response or
+    // serialized bytes
+    struct Waiting_output {
+      routine::http::Response_ptr response;
+      std::unique_ptr<routine::http::I_BodyChunks> chunks;
+      std::string bytes;
+      Write_callback callback;
+    };
+
+    std::optional<Stream_output> stream_;
+    std::vector<Waiting_output> waiting_;
+
   private:
     using Buffer_ptr = std::shared_ptr<asio::streambuf>;
 
+    // reused between messages, keeps its capacity and bytes of pipelined messages
+    Buffer_ptr read_buffer_;
+    routine::utils::MemoryCharge read_charge_;
+
+    // a rejected body was not read, the connection closes after the response
+    bool is_body_skipped_{false};
+
+    // response returned by RequestHandler::prepare_request(), sent without the CPU queue
+    routine::http::Response_ptr prepared_response_;
+
+    // Route the request once and take a token of its RateLimit. Requests over the limit
+    // lose their handler and keep the 429 as the router response
+    routine::http::RequestHandler_ptr route_request(const routine::http::Request_ptr& request);
+
+    // Client IP, the rate limit key of every request
+    std::string_view client_ip() const;
+
+    // CPU task of a routed request: call the handler, store its response in the cache under
+    // 'cache_key' if it is not empty and send it. The first of coalesced requests,
+    // 'is_coalesced', passes the response on to the requests waiting for it
+    void run_handler(routine::http::Request_ptr request, routine::http::RequestHandler_ptr handler,
+                     const std::string& cache_key, bool is_coalesced);
+
+    // run_process() for the next request, or close on "Connection: close"
+    void continue_or_close(routine::http::Request& request);
+
     template <typename T>
     void do_read_headers(std::function<void(const std::error_code&, std::shared_ptr<T>)> callback);
 
@@ -69,9 +200,67 @@ namespace routine::net {
         routine::http::Response_ptr response, Buffer_ptr buffer,
         std::function<void(const std::error_code&, routine::http::Response_ptr)> callback);
 
+    // Read the body of a request admitted by the memory budget by its route: in pieces to
+    // the handler, decoded or as it is
+    void do_read_request_body(
+        routine::http::Request_ptr request, Buffer_ptr buffer,
+        routine::http::RequestHandler_ptr handler,
+        std::function<void(const std::error_code&, routine::http::Request_ptr)> callback);
+
+    // 413 or 503 for a body the memory budget cannot hold becomes the prepared response.
+    // The body is not read
+    void reject_unread_body(routine::http::Status status);
+
     template <typename T>
     void do_read_body(std::shared_ptr<T> message, Buffer_ptr buffer,
                       std::function<void(const std::error_code&, std::shared_ptr<T>)> callback);
+
+    // bytes of a body read at once into storages without prepare()
+    static constexpr size_t body_chunk_size = 64 * 1024;
+
+    // End of a request body: a status of its storage other than Ok becomes the prepared
+    // response
+    void finish_body(routine::http::Request& request);
+
+    // Decoder of the request body by its Content-Encoding, nullptr for the identity. Sets
+    // 415 as the prepared response if the coding is not accepted
+    std::unique_ptr<routine::http::Decompressor>
+    make_decompressor(routine::http::Request& request);
+
+    // Read the coded body in chunks and pass the decoded bytes to the body storage. Malformed
+    // or oversized bodies are read to the end and dropped, with 400 or 413 as the response
+    void do_read_encoded_body(
+        routine::http::Request_ptr request, Buffer_ptr buffer,
+        std::unique_ptr<routine::http::Decompressor> decompressor,
+        std::function<void(const std::error_code&, routine::http::Request_ptr)> callback);
+
+    // coded bytes read from the socket at once
+    static constexpr size_t encoded_chunk_size = 16 * 1024;
+
+    // 400 or 413 of a body which failed to decode becomes the prepared response
+    void reject_encoded_body(routine::http::Status status);
+
+    // Body of a route with BodyChunkPolicy on its way to RequestHandler::on_body_chunk()
+    struct Body_chunks;
+    using Body_chunks_ptr = std::shared_ptr<Body_chunks>;
+
+    // Read the body asynchronously in pieces and queue them for the handler on the CPU
+    // threads. Reading pauses while the queue is full and resumes as the handler takes them
+    void do_read_body_chunks(
+        routine::http::Request_ptr request, Buffer_ptr buffer,
+        routine::http::RequestHandler_ptr handler,
+        std::unique_ptr<routine::http::Decompressor> decompressor,
+        std::function<void(const std::error_code&, routine::http::Request_ptr)> callback);
+    void read_body_chunk(Body_chunks_ptr chunks);
+
+    // Decode the piece if needed and queue it, a delivery task is started if there is none
+    void push_body_chunk(const Body_chunks_ptr& chunks, std::string chunk);
+
+    // Delivery task: pass the queued pieces to the handler until the queue is empty
+    void deliver_body_chunks(const Body_chunks_ptr& chunks);
+
+    // Callback of the body once it is read and delivered, or read failed
+    void complete_body_chunks(const Body_chunks_ptr& chunks, const std::error_code& ec);
   };
 
   using HttpSession_ptr = std::shared_ptr<HttpSession>;
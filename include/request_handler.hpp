@@ -3,16 +3,43 @@
 #include "http/body_storage.hpp"
 #include "http/request.hpp"
 #include "http/response.hpp"
+#include "http/route_policy.hpp"
 #include "http/types.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <span>
 
 namespace routine::http {
 
+  // How many handler instances the router creates
+  enum class HandlerLifetime : uint8_t {
+    Singleton,  // one instance for all requests, must be thread-safe
+    PerThread,  // one instance per thread: prepare_request() runs on the instance of the IO
+                // thread, on_body_chunk() and process_request() on that of the CPU worker
+    PerRequest, // new instance for every request (default)
+  };
+
+  // Body of the route passed to RequestHandler::on_body_chunk() while it is read, instead of
+  // being stored in the request:
+  //   inline static const BodyChunkPolicy body_chunks{.max_queued = 8};
+  struct BodyChunkPolicy {
+    size_t chunk_size{64 * 1024}; // bytes read from the socket at once
+    size_t max_queued{4};         // chunks waiting for the handler, reads pause above it
+  };
+
   class RequestHandler {
   public:
     // DONT FORGET TO SPECIFY THE PATH OF RESOURCE HANDLER
     // inline static const std::string path = "/path/to/resource";
 
+    // Optionally specify the lifetime, stateless handlers cost nothing to instantiate
+    // static constexpr HandlerLifetime lifetime = HandlerLifetime::Singleton;
+
+    // Optionally specify the method, otherwise the handler gets requests of any method
+    // static constexpr Method method = Method::Get;
+
     // Executed in IO-bound threads.
     // > Return nullptr - to add to the queue,
     // > or return a ready Response_ptr to skip the queue and return to the client.
@@ -22,6 +49,14 @@ namespace routine::http {
       return nullptr;
     }
 
+    // Executed in threads bound to the processor for every piece of the body as it is read,
+    // if the handler declares 'body_chunks'. Pieces come in order and one at a time, the
+    // socket is not read while 'max_queued' of them wait. process_request() is called after
+    // the last one. Return false to refuse the rest, it is read and dropped
+    virtual bool on_body_chunk(Request_ptr request, std::span<const uint8_t> chunk) {
+      return true;
+    }
+
     // Executed in threads bound to the processor.
     // > Return nullptr - to add to the queue again,
     // > or return a ready Response_ptr for sending to the client.
@@ -32,4 +67,90 @@ namespace routine::http {
 
   using RequestHandler_ptr = std::shared_ptr<routine::http::RequestHandler>;
 
+  // T::lifetime or HandlerLifetime::PerRequest
+  template <typename T>
+  constexpr HandlerLifetime handler_lifetime() {
+    if constexpr (requires { T::lifetime; })
+      return T::lifetime;
+    else
+      return HandlerLifetime::PerRequest;
+  }
+
+  // T::method or Method::None, which means any method
+  template <typename T>
+  constexpr Method handler_method() {
+    if constexpr (requires { T::method; })
+      return T::method;
+    else
+      return Method::None;
+  }
+
+  // Handlers of one path indexed by Method, Method::None is the handler of any method
+  using MethodHandlers = std::array<uint32_t, method_count>;
+  inline constexpr uint32_t no_handler = static_cast<uint32_t>(-1);
+
+  // Set of methods, bit per Method
+  static_assert(method_count <= 16);
+  constexpr uint16_t method_bit(Method method) noexcept {
+    return static_cast<uint16_t>(1u << static_cast<size_t>(method));
+  }
+
+  // Methods of a path for "Allow". OPTIONS is answered by the router if there is no handler
+  constexpr uint16_t allowed_methods(const MethodHandlers& handlers) noexcept {
+    if (handlers[static_cast<size_t>(Method::None)] != no_handler)
+      return static_cast<uint16_t>(((1u << method_count) - 1) & ~method_bit(Method::None));
+
+    uint16_t mask = method_bit(Method::Options);
+    for (size_t i = 1; i < method_count; ++i)
+      if (handlers[i] != no_handler) mask |= method_bit(static_cast<Method>(i));
+    return mask;
+  }
+
+  // Handler of 'method', or no_handler if the router answers itself: 405, OPTIONS without
+  // handler, or CORS preflight when 'is_preflight'
+  constexpr uint32_t select_handler(const MethodHandlers& handlers, Method method,
+                                    bool is_preflight = false) noexcept {
+    if (handlers[static_cast<size_t>(method)] != no_handler)
+      return handlers[static_cast<size_t>(method)];
+    if (method == Method::Options && is_preflight) return no_handler;
+    return handlers[static_cast<size_t>(Method::None)];
+  }
+
+  // Result of path lookup. Without handler, 'allowed' holds methods of the matched path or
+  // 0 if the path is not found
+  struct RouteMatch {
+    RequestHandler_ptr handler;
+    uint16_t allowed{0};
+    RoutePolicy policy;
+  };
+
+  // Handler instance according to the lifetime
+  template <typename T, HandlerLifetime Lifetime = handler_lifetime<T>()>
+  RequestHandler_ptr make_handler() {
+    if constexpr (Lifetime == HandlerLifetime::Singleton) {
+      static const RequestHandler_ptr instance = std::make_shared<T>();
+      return instance;
+    } else if constexpr (Lifetime == HandlerLifetime::PerThread) {
+      thread_local const RequestHandler_ptr instance = std::make_shared<T>();
+      return instance;
+    } else {
+      return std::make_shared<T>();
+    }
+  }
+
+  // RoutePolicy::thread_handler of T: make_handler() of PerThread handlers, otherwise nullptr
+  template <typename T, HandlerLifetime Lifetime = handler_lifetime<T>()>
+  constexpr RequestHandler_ptr (*thread_handler())() {
+    if constexpr (Lifetime == HandlerLifetime::PerThread)
+      return &make_handler<T, HandlerLifetime::PerThread>;
+    else
+      return nullptr;
+  }
+
+  // Handler of a routed request for the calling thread
+  inline RequestHandler_ptr local_handler(const RequestHandler_ptr& handler,
+                                          const RoutePolicy& policy) {
+    return policy.thread_handler ? policy.thread_handler() : handler;
+  }
+
 }; // namespace routine::http
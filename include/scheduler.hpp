@@ -1,9 +1,13 @@
 #pragma once
 
+#include "http/compression.hpp"
+#include "http/rate_limiter.hpp"
 #include "http/request.hpp"
+#include "http/response_cache.hpp"
 #include "http/route_handler.hpp"
 #include "request_handler.hpp"
 #include "thread_pool.hpp"
+#include "utils/memory_budget.hpp"
 
 #include <memory>
 #include <spdlog/logger.h>
@@ -27,18 +31,44 @@ namespace routine {
     void set_io_timeout(size_t milliseconds);
     size_t get_io_timeout() const;
 
+    // Compression of dynamic and cached responses, disabled by default. Set before run()
+    void set_compression(const http::CompressionPolicy& policy);
+    const http::CompressionPolicy& compression() const noexcept { return compression_; }
+
+    // Decoding of request bodies in Content-Encoding and its limits. Set before run()
+    void set_decompression(const http::DecompressionPolicy& policy) { decompression_ = policy; }
+    const http::DecompressionPolicy& decompression() const noexcept { return decompression_; }
+
+    // Limit of the process-wide memory budget of session buffers and request bodies, and how
+    // sessions wait for it. Without a limit the memory is only counted. Set before run()
+    void set_memory_budget(const utils::MemoryBudgetPolicy& policy);
+    const utils::MemoryBudgetPolicy& memory_budget() const noexcept { return memory_budget_; }
+
     asio::io_context& get_context();
 
     void run(size_t io_bound_threads, size_t cpu_bound_threads);
 
     void join_threads();
 
-    routine::http::RequestHandler_ptr route_request(http::Request_ptr request);
+    // Resolve the handler once, later calls return the handler kept on the request.
+    // Without handler the request keeps the router's response: 404, 405 or OPTIONS
+    routine::http::RequestHandler_ptr route_request(const http::Request_ptr& request);
+    // Response for requests without handler
+    routine::http::Response_ptr not_found_response() const;
+    // Responses of routes with CachePolicy, looked up on IO threads
+    http::ResponseCache& response_cache() noexcept { return response_cache_; }
+    // Buckets of routes with RateLimit, taken on IO threads before dispatch
+    http::RateLimiter& rate_limiter() noexcept { return rate_limiter_; }
     void prepare_task(std::function<void()> lambda);
 
   private:
     asio::io_context context_;
     std::unique_ptr<http::RouteHandler> router_;
+    http::ResponseCache response_cache_;
+    http::RateLimiter rate_limiter_;
+    http::CompressionPolicy compression_{.encodings = http::encoding_bit(http::Encoding::Identity)};
+    http::DecompressionPolicy decompression_;
+    utils::MemoryBudgetPolicy memory_budget_;
     ThreadPool cpu_thread_pool_;
     ThreadPool io_thread_pool_;
 
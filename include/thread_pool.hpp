@@ -20,12 +20,13 @@ namespace routine {
 
       void stop();
 
-      std::thread thread_;
-
       std::queue<std::function<void()>> queue_;
       std::mutex mutex_;
       std::condition_variable cv_;
       std::atomic<Status> status_;
+
+      // started last, after the members it uses are constructed
+      std::thread thread_;
     };
 
   public:
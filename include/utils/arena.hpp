@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory_resource>
+
+namespace routine::utils {
+
+  // Arena counters. 'upstream_allocations' stays constant on the steady-state request path
+  struct ArenaStats {
+    std::atomic<size_t> acquired{0};             // arenas handed out to requests
+    std::atomic<size_t> created{0};              // arenas allocated from heap
+    std::atomic<size_t> upstream_allocations{0}; // heap allocations after the initial block
+    std::atomic<size_t> upstream_bytes{0};
+  };
+
+  ArenaStats& arena_stats() noexcept;
+
+  // Monotonic arena of a single request. Owners are counted intrusively, the last release
+  // drops all memory in one shot and returns the arena to a pool. Arenas are cached per thread,
+  // the surplus goes to a shared list, so arenas released on CPU threads go back to IO threads
+  class RequestArena {
+  public:
+    static constexpr size_t initial_size = 8 * 1024;
+
+  public:
+    // Take an arena from the pool (or create a new one). It has no owners until the first
+    // ArenaAllocator is created
+    static RequestArena* acquire();
+
+    std::pmr::memory_resource* resource() noexcept { return &monotonic_; }
+
+    void retain() noexcept { owners_.fetch_add(1, std::memory_order_relaxed); }
+    void release() noexcept;
+
+  private:
+    RequestArena();
+
+    // Counts allocations which did not fit into the initial block
+    class CountingResource final : public std::pmr::memory_resource {
+      void* do_allocate(size_t bytes, size_t alignment) override;
+      void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+      bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+      }
+    };
+
+  private:
+    alignas(std::max_align_t) std::array<std::byte, initial_size> initial_;
+    CountingResource upstream_;
+    std::pmr::monotonic_buffer_resource monotonic_;
+    std::atomic<uint32_t> owners_{0};
+    RequestArena* next_{nullptr}; // intrusive pool list
+
+    friend class ArenaPool;
+  };
+
+  // Allocator that keeps the arena alive while any copy exists. Used with std::allocate_shared,
+  // so the control block's allocator is the last owner of the arena
+  template <typename T>
+  class ArenaAllocator {
+  public:
+    using value_type = T;
+
+    explicit ArenaAllocator(RequestArena* arena) noexcept : arena_(arena) { arena_->retain(); }
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena_(other.arena()) {
+      arena_->retain();
+    }
+
+    ArenaAllocator(const ArenaAllocator& other) noexcept : arena_(other.arena_) {
+      arena_->retain();
+    }
+
+    ArenaAllocator& operator=(const ArenaAllocator&) = delete;
+
+    ~ArenaAllocator() { arena_->release(); }
+
+    T* allocate(size_t n) {
+      return static_cast<T*>(arena_->resource()->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    // memory is dropped with the whole arena
+    void deallocate(T*, size_t) noexcept {}
+
+    RequestArena* arena() const noexcept { return arena_; }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const noexcept {
+      return arena_ == other.arena();
+    }
+
+  private:
+    RequestArena* arena_;
+  };
+
+} // namespace routine::utils
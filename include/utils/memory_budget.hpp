@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <utility>
+
+namespace routine::utils {
+
+  // Process-wide count of the bytes held by session buffers and body storages. Without a limit
+  // the bytes are only counted. Lock-free: charges are atomic additions, try_charge() is a
+  // compare-and-swap loop against the limit
+  class MemoryBudget {
+  public:
+    static MemoryBudget& global() noexcept;
+
+    // 0 removes the limit
+    void set_limit(size_t bytes) noexcept { limit_.store(bytes, std::memory_order_relaxed); }
+    size_t limit() const noexcept { return limit_.load(std::memory_order_relaxed); }
+    size_t used() const noexcept { return used_.load(std::memory_order_relaxed); }
+
+    // The limit holds 'bytes' more at the moment
+    bool has_room(size_t bytes) const noexcept;
+
+    // Charge 'bytes' if the limit holds them
+    bool try_charge(size_t bytes) noexcept;
+
+    // Charge memory which is allocated anyway, the count may go over the limit
+    void charge(size_t bytes) noexcept { used_.fetch_add(bytes, std::memory_order_relaxed); }
+    void release(size_t bytes) noexcept { used_.fetch_sub(bytes, std::memory_order_relaxed); }
+
+  private:
+    std::atomic<size_t> used_{0};
+    std::atomic<size_t> limit_{0};
+  };
+
+  // Bytes of one owner in the global budget, released with the owner. The charge itself is
+  // not synchronized, it is changed by one thread at a time
+  class MemoryCharge {
+  public:
+    MemoryCharge() = default;
+    ~MemoryCharge() { resize(0); }
+
+    MemoryCharge(MemoryCharge&& other) noexcept : bytes_(std::exchange(other.bytes_, 0)) {}
+    MemoryCharge& operator=(MemoryCharge&& other) noexcept;
+
+    MemoryCharge(const MemoryCharge&) = delete;
+    MemoryCharge& operator=(const MemoryCharge&) = delete;
+
+    // Grow to 'bytes' if the budget holds the difference. Shrinking always succeeds
+    bool try_resize(size_t bytes) noexcept;
+    // Charge of memory which is allocated anyway
+    void resize(size_t bytes) noexcept;
+
+    size_t bytes() const noexcept { return bytes_; }
+
+  private:
+    size_t bytes_{0};
+  };
+
+  // Limit of the global budget and the reaction of sessions to it
+  struct MemoryBudgetPolicy {
+    size_t limit{0}; // bytes, 0 only counts them
+    // While the budget is exhausted sessions do not read the socket and check it again every
+    // 'retry_interval'. A request or body which does not fit after 'max_wait' is answered
+    // with 503 and the connection is closed, a body larger than the whole limit gets 413 at
+    // once
+    std::chrono::milliseconds retry_interval{10};
+    std::chrono::milliseconds max_wait{500};
+  };
+
+} // namespace routine::utils
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace routine::utils {
+
+  // FNV-1a with seed and final avalanche, optionally ignoring ASCII case
+  template <bool IgnoreCase = false>
+  constexpr uint32_t fnv1a(std::string_view string, uint32_t seed = 0) noexcept {
+    uint32_t hash = 2166136261u ^ (seed * 0x9E3779B1u);
+    for (char c : string) {
+      if constexpr (IgnoreCase)
+        if (c >= 'A' && c <= 'Z') c |= 0x20;
+      hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    return hash;
+  }
+
+  // ASCII case-insensitive comparison
+  constexpr bool iequals(std::string_view left, std::string_view right) noexcept {
+    if (left.size() != right.size()) return false;
+    for (size_t i = 0; i < left.size(); ++i) {
+      char l = left[i] >= 'A' && left[i] <= 'Z' ? left[i] | 0x20 : left[i];
+      char r = right[i] >= 'A' && right[i] <= 'Z' ? right[i] | 0x20 : right[i];
+      if (l != r) return false;
+    }
+    return true;
+  }
+
+  // Minimal perfect hash ("hash and displace") over N keys known at compile time.
+  // find() returns the index of the only key that may be equal to 'key', the caller must
+  // compare it. Built by make_perfect_hash() in constant evaluation only
+  template <size_t N, bool IgnoreCase = false>
+  struct PerfectHash {
+    static constexpr size_t npos = static_cast<size_t>(-1);
+    static constexpr size_t table_size = std::bit_ceil(std::max<size_t>(N * 2, 2));
+    static constexpr size_t bucket_count = std::bit_ceil(std::max<size_t>(N / 2, 1));
+
+    std::array<uint32_t, bucket_count> seeds{};
+    std::array<uint32_t, table_size> slots{}; // key index + 1, 0 if empty
+
+    constexpr size_t find(std::string_view key) const noexcept {
+      uint32_t seed = seeds[fnv1a<IgnoreCase>(key) & (bucket_count - 1)];
+      uint32_t slot = slots[fnv1a<IgnoreCase>(key, seed) & (table_size - 1)];
+      return slot == 0 ? npos : slot - 1;
+    }
+  };
+
+  // Build perfect hash table. Duplicate keys are reported as compile error
+  template <bool IgnoreCase = false, size_t N>
+  consteval PerfectHash<N, IgnoreCase>
+  make_perfect_hash(const std::array<std::string_view, N>& keys) {
+    using Table = PerfectHash<N, IgnoreCase>;
+    Table table;
+
+    auto bucket_of = [&keys](size_t key) {
+      return fnv1a<IgnoreCase>(keys[key]) & (Table::bucket_count - 1);
+    };
+
+    std::array<size_t, Table::bucket_count> bucket_sizes{};
+    std::array<size_t, N> order{};
+    for (size_t i = 0; i < N; ++i) {
+      order[i] = i;
+      ++bucket_sizes[bucket_of(i)];
+    }
+
+    // place the largest buckets first, keys of one bucket are contiguous in 'order'
+    std::sort(order.begin(), order.end(), [&](size_t left, size_t right) {
+      size_t left_bucket = bucket_of(left), right_bucket = bucket_of(right);
+      if (bucket_sizes[left_bucket] != bucket_sizes[right_bucket])
+        return bucket_sizes[left_bucket] > bucket_sizes[right_bucket];
+      return left_bucket < right_bucket;
+    });
+
+    for (size_t begin = 0; begin < N;) {
+      size_t bucket = bucket_of(order[begin]);
+      size_t end = begin + bucket_sizes[bucket];
+
+      for (size_t i = begin; i < end; ++i)
+        for (size_t j = i + 1; j < end; ++j)
+          if (IgnoreCase ? iequals(keys[order[i]], keys[order[j]])
+                         : keys[order[i]] == keys[order[j]])
+            throw "make_perfect_hash: duplicate keys";
+
+      for (uint32_t seed = 1;; ++seed) {
+        if (seed == (1u << 20)) throw "make_perfect_hash: seed not found";
+
+        bool placed = true;
+        size_t i = begin;
+        for (; i < end; ++i) {
+          uint32_t hash = fnv1a<IgnoreCase>(keys[order[i]], seed);
+          auto& slot = table.slots[hash & (Table::table_size - 1)];
+          if (slot != 0) {
+            placed = false;
+            break;
+          }
+          slot = order[i] + 1;
+        }
+
+        if (placed) {
+          table.seeds[bucket] = seed;
+          break;
+        }
+
+        // rollback partially placed keys of the bucket
+        while (i-- > begin)
+          table.slots[fnv1a<IgnoreCase>(keys[order[i]], seed) & (Table::table_size - 1)] = 0;
+      }
+
+      begin = end;
+    }
+
+    return table;
+  }
+
+} // namespace routine::utils
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace routine::utils::simd {
+
+  // Instruction set used by the kernels. Selected once at startup from cpuid
+  enum class Level : uint8_t { Scalar, Sse42, Avx2 };
+
+  // Currently selected kernels level
+  Level level() noexcept;
+
+  // Force kernels level (for benchmarks). Returns false if the CPU does not support it
+  bool force_level(Level level) noexcept;
+
+  // Index of the first 'ch' in [data, data + size), or size if not found
+  size_t find_char(const char* data, size_t size, char ch) noexcept;
+
+  // Index of the first 'a' or 'b' in [data, data + size), or size if not found
+  size_t find_any_of(const char* data, size_t size, char a, char b) noexcept;
+
+  // Index of the "\r\n\r\n" sequence in [data, data + size), or size if not found
+  size_t find_header_end(const char* data, size_t size) noexcept;
+
+  // Index of the first byte that is not a RFC 7230 'tchar', or size if all bytes are valid
+  size_t find_non_token(const char* data, size_t size) noexcept;
+
+  // Lowercase ASCII letters in-place
+  void to_lower(char* data, size_t size) noexcept;
+
+  inline bool is_token(const char* data, size_t size) noexcept {
+    return size > 0 && find_non_token(data, size) == size;
+  }
+
+} // namespace routine::utils::simd
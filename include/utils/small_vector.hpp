@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+namespace routine::utils {
+
+  // Vector with inline storage for N elements. Spills to heap only when it grows beyond N.
+  // Supports trivially copyable types only, so elements are moved with memcpy
+  template <typename T, size_t N>
+    requires std::is_trivially_copyable_v<T>
+  class SmallVector {
+  public:
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+  public:
+    SmallVector() = default;
+
+    SmallVector(const SmallVector& other) { append(other.data(), other.size()); }
+
+    SmallVector(SmallVector&& other) noexcept { steal(other); }
+
+    SmallVector& operator=(const SmallVector& other) {
+      if (this != &other) {
+        size_ = 0;
+        append(other.data(), other.size());
+      }
+      return *this;
+    }
+
+    SmallVector& operator=(SmallVector&& other) noexcept {
+      if (this != &other) {
+        heap_.reset();
+        data_ = inline_data();
+        capacity_ = N;
+        steal(other);
+      }
+      return *this;
+    }
+
+  public:
+    T* data() noexcept { return data_; }
+    const T* data() const noexcept { return data_; }
+
+    size_t size() const noexcept { return size_; }
+    size_t capacity() const noexcept { return capacity_; }
+    bool empty() const noexcept { return size_ == 0; }
+
+    T& operator[](size_t index) noexcept { return data_[index]; }
+    const T& operator[](size_t index) const noexcept { return data_[index]; }
+
+    T& back() noexcept { return data_[size_ - 1]; }
+    const T& back() const noexcept { return data_[size_ - 1]; }
+
+    iterator begin() noexcept { return data_; }
+    iterator end() noexcept { return data_ + size_; }
+    const_iterator begin() const noexcept { return data_; }
+    const_iterator end() const noexcept { return data_ + size_; }
+
+    T& push_back(const T& value) {
+      if (size_ == capacity_) grow(capacity_ * 2);
+      ::new (static_cast<void*>(data_ + size_)) T(value);
+      return data_[size_++];
+    }
+
+    void pop_back() noexcept { --size_; }
+
+    void erase(size_t index) noexcept {
+      std::memmove(static_cast<void*>(data_ + index), data_ + index + 1,
+                   (size_ - index - 1) * sizeof(T));
+      --size_;
+    }
+
+    void clear() noexcept { size_ = 0; }
+
+    void reserve(size_t capacity) {
+      if (capacity > capacity_) grow(capacity);
+    }
+
+  private:
+    T* inline_data() noexcept { return reinterpret_cast<T*>(inline_); }
+
+    void append(const T* values, size_t count) {
+      reserve(size_ + count);
+      if (count > 0) std::memcpy(static_cast<void*>(data_ + size_), values, count * sizeof(T));
+      size_ += count;
+    }
+
+    void grow(size_t capacity) {
+      auto heap = std::make_unique_for_overwrite<std::byte[]>(capacity * sizeof(T));
+      if (size_ > 0) std::memcpy(heap.get(), data_, size_ * sizeof(T));
+      heap_ = std::move(heap);
+      data_ = reinterpret_cast<T*>(heap_.get());
+      capacity_ = capacity;
+    }
+
+    void steal(SmallVector& other) noexcept {
+      if (other.heap_) {
+        heap_ = std::move(other.heap_);
+        data_ = other.data_;
+        capacity_ = other.capacity_;
+      } else if (other.size_ > 0) {
+        std::memcpy(static_cast<void*>(data_), other.data_, other.size_ * sizeof(T));
+      }
+      size_ = other.size_;
+
+      other.data_ = other.inline_data();
+      other.capacity_ = N;
+      other.size_ = 0;
+    }
+
+  private:
+    alignas(T) std::byte inline_[N * sizeof(T)];
+    std::unique_ptr<std::byte[]> heap_;
+    T* data_{inline_data()};
+    size_t size_{0};
+    size_t capacity_{N};
+  };
+
+} // namespace routine::utils
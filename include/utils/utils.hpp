@@ -1,7 +1,12 @@
 #pragma once
 
 #include "http/types.hpp"
+#include "utils/perfect_hash.hpp"
 #include <algorithm>
+#include <array>
+#include <ctime>
+#include <optional>
+#include <format>
 #include <numeric>
 #include <spdlog/spdlog.h>
 #include <sstream>
@@ -9,98 +14,361 @@
 #include <string>
 #include <string_view>
 #include <type_traits>
-#include <unordered_map>
 #include <vector>
 
 namespace routine::utils {
+  // Call 'lambda' for each non-empty part of 'input' separated by 'delim'
+  template <typename Lambda>
+  inline void for_each_part(std::string_view input, char delim, Lambda&& lambda) {
+    while (!input.empty()) {
+      size_t end = std::min(input.find(delim), input.size());
+      if (end > 0) lambda(input.substr(0, end));
+      input.remove_prefix(std::min(end + 1, input.size()));
+    }
+  }
+
   template <typename StringT,
             typename = std::enable_if_t<std::is_same_v<std::decay_t<StringT>, std::string> ||
                                         std::is_same_v<std::decay_t<StringT>, std::string_view>>>
-  inline std::vector<StringT> split_string(const std::string& input, char delim = ' ',
+  inline std::vector<StringT> split_string(std::string_view input, char delim = ' ',
                                            size_t reserve_size = 4) {
     std::vector<StringT> result;
     result.reserve(reserve_size);
-    std::istringstream ss(input);
-    std::string token;
-    while (std::getline(ss, token, delim)) {
-      if (token.empty()) continue;
-      result.push_back(token);
-    }
+    for_each_part(input, delim, [&result](std::string_view part) { result.emplace_back(part); });
     return result;
   }
 
   template <typename StringT,
             typename = std::enable_if_t<std::is_same_v<std::decay_t<StringT>, std::string> ||
                                         std::is_same_v<std::decay_t<StringT>, std::string_view>>>
-  inline std::vector<StringT> split_string_limit(const std::string& input, char delim,
+  inline std::vector<StringT> split_string_limit(std::string_view input, char delim,
                                                  size_t limit) {
     std::vector<StringT> result;
     result.reserve(limit);
-    std::istringstream ss(input);
-    std::string token;
-    while (limit-- > 0 && std::getline(ss, token, delim)) {
-      if (token.empty()) continue;
-      result.push_back(token);
-    }
+    for_each_part(input, delim, [&result, limit](std::string_view part) {
+      if (result.size() < limit) result.emplace_back(part);
+    });
     return result;
   }
 
-  inline std::string format_path(std::string path) {
-    auto parts = split_string<std::string>(path, '/');
-    path = std::accumulate(parts.begin(), parts.end(), std::string{},
-                           [](auto a, auto& b) { return a.empty() ? b : a + '/' + b; });
-    return std::move(path);
+  // Remove leading, trailing and repeated '/'
+  template <typename StringT>
+  inline void format_path(std::string_view path, StringT& result) {
+    result.clear();
+    result.reserve(path.size());
+    for_each_part(path, '/', [&result](std::string_view part) {
+      if (!result.empty()) result.push_back('/');
+      result.append(part);
+    });
+  }
+
+  inline std::string format_path(std::string_view path) {
+    std::string result;
+    format_path(path, result);
+    return result;
   }
 } // namespace routine::utils
 
 namespace routine::http::utils {
-  // Make HTTP format datatime
-  inline std::string get_current_http_date() {
-    auto now = std::chrono::system_clock::now();
-    std::time_t time = std::chrono::system_clock::to_time_t(now);
+  // Size of IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+  inline constexpr size_t http_date_size = 29;
+
+  // Format IMF-fixdate (RFC 7231) into 'out' of http_date_size bytes
+  inline void format_http_date(std::time_t time, char* out) {
+    static constexpr std::string_view days{"SunMonTueWedThuFriSat"};
+    static constexpr std::string_view months{"JanFebMarAprMayJunJulAugSepOctNovDec"};
 
     std::tm tm_gmt;
     gmtime_r(&time, &tm_gmt);
 
-    // RFC 7231
-    std::ostringstream oss;
-    oss << std::put_time(&tm_gmt, "%a, %d %b %Y %H:%M:%S GMT");
-
-    return oss.str();
-  }
-
-  inline std::string_view to_string(routine::http::Header header) {
-    static const std::unordered_map<http::Header, std::string> map = {
-        {Header::None, "none"},
-        {Header::Host, "host"},
-        {Header::User_Agent, "user-agent"},
-        {Header::Accept, "accept"},
-        {Header::Accept_Encoding, "accept-encoding"},
-        {Header::Accept_Language, "accept-language"},
-        {Header::Content_Type, "content-type"},
-        {Header::Content_Length, "content-length"},
-        {Header::Authorization, "authorization"},
-        {Header::Connection, "connection"},
-        {Header::Referer, "referer"},
-        {Header::Cookie, "cookie"},
-        {Header::Cache_Control, "cache-control"},
-        {Header::Origin, "origin"},
-        {Header::Date, "date"},
-        {Header::Server, "server"},
-        {Header::Set_Cookie, "set-cookie"},
-        {Header::Last_Modified, "last-modified"},
-        {Header::Location, "location"},
-        {Header::Content_Encoding, "content-encoding"},
-        {Header::Access_Control_Allow_Origin, "access-control-allow-origin"},
-        {Header::Access_Control_Allow_Methods, "access-control-allow-methods"},
-        {Header::Transfer_Encoding, "transfer-encoding"},
+    auto two_digits = [&out](int value) {
+      *out++ = '0' + value / 10;
+      *out++ = '0' + value % 10;
+    };
+
+    out = std::copy_n(days.data() + tm_gmt.tm_wday * 3, 3, out);
+    *out++ = ',';
+    *out++ = ' ';
+    two_digits(tm_gmt.tm_mday);
+    *out++ = ' ';
+    out = std::copy_n(months.data() + tm_gmt.tm_mon * 3, 3, out);
+    *out++ = ' ';
+    two_digits((tm_gmt.tm_year + 1900) / 100);
+    two_digits((tm_gmt.tm_year + 1900) % 100);
+    *out++ = ' ';
+    two_digits(tm_gmt.tm_hour);
+    *out++ = ':';
+    two_digits(tm_gmt.tm_min);
+    *out++ = ':';
+    two_digits(tm_gmt.tm_sec);
+    std::copy_n(" GMT", 4, out);
+  }
+
+  // Parse IMF-fixdate, the only format servers send. nullopt for other formats
+  inline std::optional<std::time_t> parse_http_date(std::string_view date) {
+    static constexpr std::string_view months{"JanFebMarAprMayJunJulAugSepOctNovDec"};
+    if (date.size() != http_date_size || date.substr(3, 2) != ", " || !date.ends_with(" GMT"))
+      return std::nullopt;
+
+    auto number = [date](size_t offset, size_t size) {
+      int value = 0;
+      for (char c : date.substr(offset, size)) {
+        if (c < '0' || c > '9') return -1;
+        value = value * 10 + (c - '0');
+      }
+      return value;
+    };
+
+    std::tm tm_gmt{};
+    size_t month = months.find(date.substr(8, 3));
+    tm_gmt.tm_mday = number(5, 2);
+    tm_gmt.tm_year = number(12, 4) - 1900;
+    tm_gmt.tm_hour = number(17, 2);
+    tm_gmt.tm_min = number(20, 2);
+    tm_gmt.tm_sec = number(23, 2);
+    if (month == std::string_view::npos || month % 3 != 0 || tm_gmt.tm_mday < 0 ||
+        tm_gmt.tm_year < 0 || tm_gmt.tm_hour < 0 || tm_gmt.tm_min < 0 || tm_gmt.tm_sec < 0)
+      return std::nullopt;
+    tm_gmt.tm_mon = month / 3;
+    return timegm(&tm_gmt);
+  }
+
+  // Make HTTP format datatime
+  inline std::string get_current_http_date() {
+    std::string date(http_date_size, ' ');
+    format_http_date(std::time(nullptr), date.data());
+    return date;
+  }
+
+  // Preformatted HTTP date of the current thread, reformatted only when the second changes.
+  // The view is valid until thread exit, its content changes at most once per second
+  inline std::string_view cached_http_date() {
+    thread_local std::array<char, http_date_size> date;
+    thread_local std::time_t formatted_at = -1;
+
+    if (std::time_t now = std::time(nullptr); now != formatted_at) {
+      format_http_date(now, date.data());
+      formatted_at = now;
+    }
+    return {date.data(), date.size()};
+  }
+
+  namespace detail {
+    inline constexpr std::array<std::string_view, http::header_count> header_names{
+        "none",
+        "host",
+        "user-agent",
+        "accept",
+        "accept-encoding",
+        "accept-language",
+        "content-type",
+        "content-length",
+        "authorization",
+        "connection",
+        "referer",
+        "cookie",
+        "cache-control",
+        "origin",
+        "date",
+        "server",
+        "set-cookie",
+        "last-modified",
+        "location",
+        "content-encoding",
+        "access-control-allow-origin",
+        "access-control-allow-methods",
+        "transfer-encoding",
+        "allow",
+        "vary",
+        "access-control-allow-headers",
+        "access-control-max-age",
+        "access-control-request-method",
+        "access-control-request-headers",
+        "etag",
+        "if-none-match",
+        "retry-after",
+        "if-modified-since",
+        "range",
+        "if-range",
+        "content-range",
+        "accept-ranges",
+    };
+
+    inline constexpr auto header_hash = routine::utils::make_perfect_hash<true>(header_names);
+
+    inline constexpr std::array<std::string_view, http::method_count> method_names{
+        "NONE", "GET", "POST", "PUT", "PATCH", "DELETE", "HEAD", "OPTIONS", "CONNECT", "TRACE"};
+
+    inline constexpr auto method_hash = routine::utils::make_perfect_hash(method_names);
+
+    inline constexpr std::pair<http::Status, std::string_view> status_reasons[]{
+        {Status::None, "None"},
+        {Status::Continue, "Continue"},
+        {Status::Switching_Protocols, "Switching_Protocols"},
+        {Status::Processing, "Processing"},
+        {Status::Early_Hints, "Early_Hints"},
+        {Status::Ok, "Ok"},
+        {Status::Created, "Created"},
+        {Status::Accepted, "Accepted"},
+        {Status::Non_Authoritative_Information, "Non_Authoritative_Information"},
+        {Status::No_Content, "No_Content"},
+        {Status::Reset_Content, "Reset_Content"},
+        {Status::Partial_Content, "Partial_Content"},
+        {Status::Multi_Status, "Multi_Status"},
+        {Status::Already_Reported, "Already_Reported"},
+        {Status::Im_Used, "Im_Used"},
+        {Status::Multiple_Choices, "Multiple_Choices"},
+        {Status::Moved_Permanently, "Moved_Permanently"},
+        {Status::Found, "Found"},
+        {Status::See_Other, "See_Other"},
+        {Status::Not_Modified, "Not_Modified"},
+        {Status::Use_Proxy, "Use_Proxy"},
+        {Status::Temporary_Redirect, "Temporary_Redirect"},
+        {Status::Permanent_Redirect, "Permanent_Redirect"},
+        {Status::Bad_Request, "Bad_Request"},
+        {Status::Unauthorized, "Unauthorized"},
+        {Status::Payment_Required, "Payment_Required"},
+        {Status::Forbidden, "Forbidden"},
+        {Status::Not_Found, "Not_Found"},
+        {Status::Method_Not_Allowed, "Method_Not_Allowed"},
+        {Status::Not_Acceptable, "Not_Acceptable"},
+        {Status::Proxy_Auth_Required, "Proxy_Auth_Required"},
+        {Status::Request_Timeout, "Request_Timeout"},
+        {Status::Conflict, "Conflict"},
+        {Status::Gone, "Gone"},
+        {Status::Length_Required, "Length_Required"},
+        {Status::Precondition_Failed, "Precondition_Failed"},
+        {Status::Payload_Too_Large, "Payload_Too_Large"},
+        {Status::Uri_Too_Long, "Uri_Too_Long"},
+        {Status::Unsupported_Media_Type, "Unsupported_Media_Type"},
+        {Status::Range_Not_Satisfiable, "Range_Not_Satisfiable"},
+        {Status::Expectation_Failed, "Expectation_Failed"},
+        {Status::Misdirected_Request, "Misdirected_Request"},
+        {Status::Unprocessable_Entity, "Unprocessable_Entity"},
+        {Status::Locked, "Locked"},
+        {Status::Failed_Dependency, "Failed_Dependency"},
+        {Status::Too_Early, "Too_Early"},
+        {Status::Upgrade_Required, "Upgrade_Required"},
+        {Status::Precondition_Required, "Precondition_Required"},
+        {Status::Too_Many_Requests, "Too_Many_Requests"},
+        {Status::Request_Header_Fields_Too_Large, "Request_Header_Fields_Too_Large"},
+        {Status::Unavailable_For_Legal_Reasons, "Unavailable_For_Legal_Reasons"},
+        {Status::Internal_Server_Error, "Internal_Server_Error"},
+        {Status::Not_Implemented, "Not_Implemented"},
+        {Status::Bad_Gateway, "Bad_Gateway"},
+        {Status::Service_Unavailable, "Service_Unavailable"},
+        {Status::Gateway_Timeout, "Gateway_Timeout"},
+        {Status::Http_Version_Not_Supported, "Http_Version_Not_Supported"},
+        {Status::Variant_Also_Negotiates, "Variant_Also_Negotiates"},
+        {Status::Insufficient_Storage, "Insufficient_Storage"},
+        {Status::Loop_Detected, "Loop_Detected"},
+        {Status::Not_Extended, "Not_Extended"},
+        {Status::Network_Auth_Required, "Network_Auth_Required"},
     };
-    return map.at(header);
+
+    inline constexpr std::string_view status_line_prefix{"HTTP/1.1 "};
+    inline constexpr size_t status_code_limit = 600;
+
+    // "100" or "0" for Status::None
+    constexpr size_t status_code_digits(http::Status status) {
+      return static_cast<uint16_t>(status) >= 100 ? 3 : 1;
+    }
+
+    constexpr size_t status_line_size(const std::pair<http::Status, std::string_view>& entry) {
+      // "HTTP/1.1 " + code + ' ' + reason + "\r\n"
+      return status_line_prefix.size() + status_code_digits(entry.first) + 1 +
+             entry.second.size() + 2;
+    }
+
+    inline constexpr size_t status_lines_size = []() {
+      size_t size = 0;
+      for (const auto& entry : status_reasons)
+        size += status_line_size(entry);
+      return size;
+    }();
+
+    // All status lines ("HTTP/1.1 200 Ok\r\n") concatenated into one buffer,
+    // with offset and size of each line indexed by status code
+    struct StatusLines {
+      std::array<char, status_lines_size> buffer{};
+      std::array<uint16_t, status_code_limit> offsets{};
+      std::array<uint8_t, status_code_limit> sizes{};
+    };
+
+    inline constexpr StatusLines status_lines = []() {
+      StatusLines lines;
+      size_t offset = 0;
+      for (const auto& [status, reason] : status_reasons) {
+        auto code = static_cast<uint16_t>(status);
+        lines.offsets[code] = offset;
+        lines.sizes[code] = status_line_size({status, reason});
+
+        for (char c : status_line_prefix)
+          lines.buffer[offset++] = c;
+        if (code >= 100) {
+          lines.buffer[offset++] = '0' + code / 100;
+          lines.buffer[offset++] = '0' + code / 10 % 10;
+        }
+        lines.buffer[offset++] = '0' + code % 10;
+        lines.buffer[offset++] = ' ';
+        for (char c : reason)
+          lines.buffer[offset++] = c;
+        lines.buffer[offset++] = '\r';
+        lines.buffer[offset++] = '\n';
+      }
+      return lines;
+    }();
+
+    inline constexpr size_t header_prefixes_size = []() {
+      size_t size = 0;
+      for (auto name : header_names)
+        size += name.size() + 2;
+      return size;
+    }();
+
+    // All header line prefixes ("content-length: ") concatenated into one buffer,
+    // with offset of each prefix indexed by routine::http::Header
+    struct HeaderPrefixes {
+      std::array<char, header_prefixes_size> buffer{};
+      std::array<uint16_t, http::header_count> offsets{};
+    };
+
+    inline constexpr HeaderPrefixes header_prefixes = []() {
+      HeaderPrefixes prefixes;
+      size_t offset = 0;
+      for (size_t i = 0; i < header_names.size(); ++i) {
+        prefixes.offsets[i] = offset;
+        for (char c : header_names[i])
+          prefixes.buffer[offset++] = c;
+        prefixes.buffer[offset++] = ':';
+        prefixes.buffer[offset++] = ' ';
+      }
+      return prefixes;
+    }();
+  } // namespace detail
+
+  inline constexpr std::string_view to_string(routine::http::Header header) {
+    return detail::header_names.at(static_cast<size_t>(header));
+  }
+
+  // Header line prefix, e.g. "content-length: "
+  inline constexpr std::string_view header_prefix(routine::http::Header header) {
+    size_t index = static_cast<size_t>(header);
+    return {detail::header_prefixes.buffer.data() + detail::header_prefixes.offsets.at(index),
+            detail::header_names[index].size() + 2};
+  }
+
+  // Convert header name to routine::http::Header (case-insensitive). Header::None if not well-known
+  inline constexpr http::Header header_from_string(std::string_view string) {
+    size_t index = detail::header_hash.find(string);
+    if (index == detail::header_hash.npos ||
+        !routine::utils::iequals(detail::header_names[index], string))
+      return Header::None;
+    return static_cast<http::Header>(index);
   }
 
   // Convert std::string to routine::http::Version
-  inline http::Version version_from_string(const std::string& string) {
-    // std::transform(string.begin(), string.end(), string.begin(), ::toupper);
+  inline constexpr http::Version version_from_string(std::string_view string) {
     if (string.starts_with("HTTP/1.0"))
       return Version::Http10;
     else if (string.starts_with("HTTP/1.1"))
@@ -113,103 +381,47 @@ namespace routine::http::utils {
   }
 
   // Convert routine::http::Version to std::string_view
-  inline std::string_view to_string(http::Version version) {
-    static const std::unordered_map<http::Version, std::string> map{
-        {http::Version::None, "HTTP/?"},
-        {http::Version::Http10, "HTTP/1.0"},
-        {http::Version::Http11, "HTTP/1.1"},
-        {http::Version::Http2, "HTTP/2"},
-        {http::Version::Http3, "HTTP/3"}};
-    return map.at(version);
+  inline constexpr std::string_view to_string(http::Version version) {
+    switch (version) {
+      case http::Version::Http10:
+        return "HTTP/1.0";
+      case http::Version::Http11:
+        return "HTTP/1.1";
+      case http::Version::Http2:
+        return "HTTP/2";
+      case http::Version::Http3:
+        return "HTTP/3";
+      default:
+        return "HTTP/?";
+    }
   }
 
   // Convert std::string to routine::http::Method
-  inline http::Method method_from_string(const std::string& string) {
-    // std::transform(string.begin(), string.end(), string.begin(), ::toupper);
+  inline constexpr http::Method method_from_string(std::string_view string) {
+    size_t index = detail::method_hash.find(string);
+    if (index == detail::method_hash.npos || detail::method_names[index] != string)
+      return Method::None;
+    return static_cast<http::Method>(index);
+  }
 
-    static const std::unordered_map<std::string, http::Method> map{
-        {"GET", Method::Get},         {"POST", Method::Post},       {"PUT", Method::Put},
-        {"DELETE", Method::Delete},   {"PATCH", Method::Patch},     {"HEAD", Method::Head},
-        {"OPTIONS", Method::Options}, {"CONNECT", Method::Connect}, {"TRACE", Method::Trace}};
+  // Convert routine::http::Method to std::string_view
+  inline constexpr std::string_view to_string(http::Method method) {
+    return detail::method_names.at(static_cast<size_t>(method));
+  }
 
-    if (auto it = map.find(string); it != map.end()) { return it->second; }
-    return Method::None;
+  // Full status line, e.g. "HTTP/1.1 200 Ok\r\n"
+  inline constexpr std::string_view status_line(http::Status status) {
+    auto code = static_cast<uint16_t>(status);
+    if (code >= detail::status_code_limit || detail::status_lines.sizes[code] == 0)
+      throw std::out_of_range(std::format("Unknown status code {}", code));
+    return {detail::status_lines.buffer.data() + detail::status_lines.offsets[code],
+            detail::status_lines.sizes[code]};
   }
 
-  // Convert routine::http::Method to std::string_view
-  inline std::string_view to_string(http::Method method) {
-    static const std::array<std::string, 10> names{"NONE",   "GET",  "POST",    "PUT",     "PATCH",
-                                                   "DELETE", "HEAD", "OPTIONS", "CONNECT", "TRACE"};
-
-    return names.at(static_cast<size_t>(method));
-  }
-
-  // Convert routine::http::Status to std::string_view
-  inline std::string_view to_string(http::Status status) {
-    static const std::unordered_map<Status, std::string> map{
-        {Status::Continue, "100 Continue"},
-        {Status::Switching_Protocols, "101 Switching_Protocols"},
-        {Status::Processing, "102 Processing"},
-        {Status::Early_Hints, "103 Early_Hints"},
-        {Status::Ok, "200 Ok"},
-        {Status::Created, "201 Created"},
-        {Status::Accepted, "202 Accepted"},
-        {Status::Non_Authoritative_Information, "203 Non_Authoritative_Information"},
-        {Status::No_Content, "204 No_Content"},
-        {Status::Reset_Content, "205 Reset_Content"},
-        {Status::Partial_Content, "206 Partial_Content"},
-        {Status::Multi_Status, "207 Multi_Status"},
-        {Status::Already_Reported, "208 Already_Reported"},
-        {Status::Im_Used, "226 Im_Used"},
-        {Status::Multiple_Choices, "300 Multiple_Choices"},
-        {Status::Moved_Permanently, "301 Moved_Permanently"},
-        {Status::Found, "302 Found"},
-        {Status::See_Other, "303 See_Other"},
-        {Status::Not_Modified, "304 Not_Modified"},
-        {Status::Use_Proxy, "305 Use_Proxy"},
-        {Status::Temporary_Redirect, "307 Temporary_Redirect"},
-        {Status::Permanent_Redirect, "308 Permanent_Redirect"},
-        {Status::Bad_Request, "400 Bad_Request"},
-        {Status::Unauthorized, "401 Unauthorized"},
-        {Status::Payment_Required, "402 Payment_Required"},
-        {Status::Forbidden, "403 Forbidden"},
-        {Status::Not_Found, "404 Not_Found"},
-        {Status::Method_Not_Allowed, "405 Method_Not_Allowed"},
-        {Status::Not_Acceptable, "406 Not_Acceptable"},
-        {Status::Proxy_Auth_Required, "407 Proxy_Auth_Required"},
-        {Status::Request_Timeout, "408 Request_Timeout"},
-        {Status::Conflict, "409 Conflict"},
-        {Status::Gone, "410 Gone"},
-        {Status::Length_Required, "411 Length_Required"},
-        {Status::Precondition_Failed, "412 Precondition_Failed"},
-        {Status::Payload_Too_Large, "413 Payload_Too_Large"},
-        {Status::Uri_Too_Long, "414 Uri_Too_Long"},
-        {Status::Unsupported_Media_Type, "415 Unsupported_Media_Type"},
-        {Status::Range_Not_Satisfiable, "416 Range_Not_Satisfiable"},
-        {Status::Expectation_Failed, "417 Expectation_Failed"},
-        {Status::Misdirected_Request, "421 Misdirected_Request"},
-        {Status::Unprocessable_Entity, "422 Unprocessable_Entity"},
-        {Status::Locked, "423 Locked"},
-        {Status::Failed_Dependency, "424 Failed_Dependency"},
-        {Status::Too_Early, "425 Too_Early"},
-        {Status::Upgrade_Required, "426 Upgrade_Required"},
-        {Status::Precondition_Required, "428 Precondition_Required"},
-        {Status::Too_Many_Requests, "429 Too_Many_Requests"},
-        {Status::Request_Header_Fields_Too_Large, "431 Request_Header_Fields_Too_Large"},
-        {Status::Unavailable_For_Legal_Reasons, "451 Unavailable_For_Legal_Reasons"},
-        {Status::Internal_Server_Error, "500 Internal_Server_Error"},
-        {Status::Not_Implemented, "501 Not_Implemented"},
-        {Status::Bad_Gateway, "502 Bad_Gateway"},
-        {Status::Service_Unavailable, "503 Service_Unavailable"},
-        {Status::Gateway_Timeout, "504 Gateway_Timeout"},
-        {Status::Http_Version_Not_Supported, "505 Http_Version_Not_Supported"},
-        {Status::Variant_Also_Negotiates, "506 Variant_Also_Negotiates"},
-        {Status::Insufficient_Storage, "507 Insufficient_Storage"},
-        {Status::Loop_Detected, "508 Loop_Detected"},
-        {Status::Not_Extended, "510 Not_Extended"},
-        {Status::Network_Auth_Required, "511 Network_Auth_Required"},
-        {Status::None, "0 None"},
-    };
-    return map.at(status);
+  // Convert routine::http::Status to std::string_view, e.g. "200 Ok"
+  inline constexpr std::string_view to_string(http::Status status) {
+    auto line = status_line(status);
+    return line.substr(detail::status_line_prefix.size(),
+                       line.size() - detail::status_line_prefix.size() - 2);
   }
 }; // namespace routine::http::utils
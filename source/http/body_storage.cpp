@@ -1,105 +1,710 @@
 #include "http/body_storage.hpp"
-#include <boost/asio/buffers_iterator.hpp>
+#include "http/json_binding.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
 #include <cstring>
 #include <exception>
+#include <fcntl.h>
+#include <format>
 #include <iterator>
+#include <stdexcept>
 #include <spdlog/spdlog.h>
-#include <tao/json/from_input.hpp>
-#include <tao/json/from_stream.hpp>
+#include <system_error>
 #include <tao/json/from_string.hpp>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+  using routine::http::detail::JsonCounter;
+
+  size_t written(const std::string& output) noexcept {
+    return output.size();
+  }
+  size_t written(const JsonCounter& output) noexcept {
+    return output.size;
+  }
+
+  // Resumable serialization of a tao::json::value. Every write() call continues where the
+  // previous one stopped, so large arrays are written in pieces without an intermediate string
+  template <typename Output>
+  class JsonWriter {
+  public:
+    explicit JsonWriter(const tao::json::value& root) { frames_.push_back({&root}); }
+
+    // Write until 'output' grew by 'limit' bytes. false when the value is written completely
+    bool write(Output& output, size_t limit) {
+      size_t start = written(output);
+      while (!frames_.empty()) {
+        if (written(output) - start >= limit) return true;
+
+        Frame& frame = frames_.back();
+        const tao::json::value& value = *frame.value;
+        if (value.type() == tao::json::type::ARRAY) {
+          const auto& array = value.get_array();
+          if (frame.index == 0) output.push_back('[');
+          if (frame.index == array.size()) {
+            output.push_back(']');
+            frames_.pop_back();
+            continue;
+          }
+          if (frame.index > 0) output.push_back(',');
+          const tao::json::value* element = &array[frame.index++];
+          frames_.push_back({element}); // invalidates 'frame'
+        } else if (value.type() == tao::json::type::OBJECT) {
+          const auto& object = value.get_object();
+          if (frame.index == 0) {
+            output.push_back('{');
+            frame.member = object.begin();
+          }
+          if (frame.member == object.end()) {
+            output.push_back('}');
+            frames_.pop_back();
+            continue;
+          }
+          if (frame.index++ > 0) output.push_back(',');
+          routine::http::detail::write_json_string(output, frame.member->first);
+          output.push_back(':');
+          const tao::json::value* member = &(frame.member++)->second;
+          frames_.push_back({member});
+        } else {
+          write_scalar(output, value);
+          frames_.pop_back();
+        }
+      }
+      return false;
+    }
+
+  private:
+    static void write_scalar(Output& output, const tao::json::value& value) {
+      char digits[32];
+      switch (value.type()) {
+        case tao::json::type::BOOLEAN:
+          output.append(value.get_boolean() ? "true" : "false");
+          return;
+        case tao::json::type::SIGNED: {
+          auto result = std::to_chars(digits, digits + sizeof(digits), value.get_signed());
+          output.append(std::string_view(digits, result.ptr - digits));
+          return;
+        }
+        case tao::json::type::UNSIGNED: {
+          auto result = std::to_chars(digits, digits + sizeof(digits), value.get_unsigned());
+          output.append(std::string_view(digits, result.ptr - digits));
+          return;
+        }
+        case tao::json::type::DOUBLE: {
+          if (!std::isfinite(value.get_double())) break;
+          auto result = std::to_chars(digits, digits + sizeof(digits), value.get_double());
+          output.append(std::string_view(digits, result.ptr - digits));
+          return;
+        }
+        case tao::json::type::STRING:
+          routine::http::detail::write_json_string(output, value.get_string());
+          return;
+        case tao::json::type::STRING_VIEW:
+          routine::http::detail::write_json_string(output, value.get_string_view());
+          return;
+        case tao::json::type::NULL_:
+        case tao::json::type::UNINITIALIZED:
+          break;
+        default:
+          // binary and pointer values are rare in responses, tao::json writes them
+          output.append(tao::json::to_string(value));
+          return;
+      }
+      output.append("null");
+    }
+
+    struct Frame {
+      const tao::json::value* value;
+      size_t index{0}; // elements or members written
+      tao::json::value::object_t::const_iterator member{};
+    };
+    std::vector<Frame> frames_;
+  };
+
+  class JsonChunks final : public routine::http::I_BodyChunks {
+  public:
+    explicit JsonChunks(const tao::json::value& value) : writer_(value) {}
+
+    bool next(std::string& buffer, size_t size_hint) override {
+      return writer_.write(buffer, size_hint);
+    }
+
+  private:
+    JsonWriter<std::string> writer_;
+  };
+
+  [[noreturn]] void throw_errno(const std::string& what) {
+    throw std::system_error(errno, std::generic_category(), what);
+  }
+
+  // Unnamed file of the directory, it is removed when the descriptor is closed
+  int open_temporary(const std::filesystem::path& directory) {
+#ifdef O_TMPFILE
+    int fd = ::open(directory.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd >= 0) return fd;
+#endif
+    std::string name = (directory / "routine-XXXXXX").string();
+    int temporary = ::mkostemp(name.data(), O_CLOEXEC);
+    if (temporary < 0)
+      throw_errno(std::format("Cannot create a temporary file in '{}'", directory.string()));
+    ::unlink(name.c_str());
+    return temporary;
+  }
+
+  // Read up to 'size' bytes at 'offset', fewer at the end of the file
+  size_t read_all(int fd, uint64_t offset, uint8_t* data, size_t size) {
+    size_t total = 0;
+    while (total < size) {
+      ssize_t count = ::pread(fd, data + total, size - total, static_cast<off_t>(offset + total));
+      if (count < 0) {
+        if (errno == EINTR) continue;
+        throw_errno("Cannot read the body file");
+      }
+      if (count == 0) break;
+      total += static_cast<size_t>(count);
+    }
+    return total;
+  }
+
+  void write_all(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+      ssize_t count = ::write(fd, data, size);
+      if (count < 0) {
+        if (errno == EINTR) continue;
+        throw_errno("Cannot write the body file");
+      }
+      data += count;
+      size -= static_cast<size_t>(count);
+    }
+  }
+
+  class FileChunks final : public routine::http::I_BodyChunks {
+  public:
+    explicit FileChunks(const routine::http::FileBody& body) : body_(body) {}
+
+    bool next(std::string& buffer, size_t size_hint) override {
+      size_t size = buffer.size();
+      size_t count = 0;
+      buffer.resize_and_overwrite(
+          size + std::min<uint64_t>(size_hint, body_.size() - offset_),
+          [&](char* data, size_t new_size) {
+            count = body_.read_at(offset_, reinterpret_cast<uint8_t*>(data) + size,
+                                  new_size - size);
+            return size + count;
+          });
+      offset_ += count;
+      // a file truncated by someone else ends the body early
+      return count > 0 && offset_ < body_.size();
+    }
+
+  private:
+    const routine::http::FileBody& body_;
+    uint64_t offset_{0};
+  };
+
+  // Chunks of a FileRangeBody, sent with Content-Length of the range
+  class FileRangeChunks final : public routine::http::I_BodyChunks {
+  public:
+    explicit FileRangeChunks(const routine::http::FileRangeBody& body) : body_(body) {}
+
+    bool next(std::string& buffer, size_t size_hint) override {
+      size_t size = buffer.size();
+      size_t count = 0;
+      buffer.resize_and_overwrite(
+          size + std::min<uint64_t>(size_hint, body_.size() - offset_),
+          [&](char* data, size_t new_size) {
+            count = body_.read_at(offset_, reinterpret_cast<uint8_t*>(data) + size,
+                                  new_size - size);
+            return size + count;
+          });
+      offset_ += count;
+      return count > 0 && offset_ < body_.size();
+    }
+
+    std::optional<uint64_t> size() const override { return body_.size(); }
+
+  private:
+    const routine::http::FileRangeBody& body_;
+    uint64_t offset_{0};
+  };
+} // namespace
+
+std::span<const uint8_t>
+routine::http::MemoryBody::bytes_of(const Segment& segment) noexcept {
+  if (auto block = std::get_if<Block>(&segment)) return {block->data.get(), block->size};
+  if (auto vector = std::get_if<std::vector<uint8_t>>(&segment)) return *vector;
+  const auto& string = std::get<std::string>(segment);
+  return {reinterpret_cast<const uint8_t*>(string.data()), string.size()};
+}
+
+routine::http::MemoryBody::Block& routine::http::MemoryBody::tail_block(size_t size) {
+  if (!segments_.empty())
+    if (auto block = std::get_if<Block>(&segments_.back());
+        block && block->capacity - block->size >= size)
+      return *block;
+
+  size_t capacity = std::max(size, block_size);
+  auto& block = std::get<Block>(segments_.emplace_back(
+      Block{std::make_unique_for_overwrite<uint8_t[]>(capacity), 0, capacity}));
+  allocated_ += capacity;
+  account();
+  return block;
+}
+
+void routine::http::MemoryBody::account() const {
+  charge_.resize(std::max(allocated_, reserved_));
+}
 
 void routine::http::MemoryBody::operator=(const std::string& str) {
-  data_.resize(str.size());
-  ::memcpy(data_.data(), str.data(), data_.size());
+  segments_.clear();
+  size_ = 0;
+  allocated_ = 0;
+  reserved_ = 0;
+  account();
+  write(str);
 }
 
 void routine::http::MemoryBody::write(const std::vector<uint8_t>& buffer) {
-  size_t size = data_.size();
-  data_.resize(size + buffer.size());
-  ::memcpy(data_.data() + size, buffer.data(), buffer.size());
+  write(std::span<const uint8_t>(buffer));
 }
 
 void routine::http::MemoryBody::write(asio::streambuf& buffer) {
-  size_t size = data_.size();
-  data_.resize(size + buffer.data().size());
-  ::memcpy(data_.data() + size, buffer.data().data(), buffer.data().size());
+  write(std::span<const uint8_t>(static_cast<const uint8_t*>(buffer.data().data()),
+                                 buffer.data().size()));
   buffer.consume(buffer.size());
 }
 
 void routine::http::MemoryBody::write(const std::string& buffer) {
-  size_t size = data_.size();
-  data_.resize(size + buffer.size());
-  ::memcpy(data_.data() + size, buffer.data(), buffer.size());
+  write(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(buffer.data()),
+                                 buffer.size()));
 }
 
 void routine::http::MemoryBody::write(std::string&& buffer) {
-  data_.insert(data_.end(), std::make_move_iterator(buffer.begin()),
-               std::make_move_iterator(buffer.end()));
+  if (buffer.size() < adopt_size) {
+    write(static_cast<const std::string&>(buffer));
+    return;
+  }
+  size_ += buffer.size();
+  allocated_ += buffer.capacity();
+  segments_.emplace_back(std::move(buffer));
+  account();
+}
+
+void routine::http::MemoryBody::write(std::vector<uint8_t>&& buffer) {
+  if (buffer.size() < adopt_size) {
+    write(std::span<const uint8_t>(buffer));
+    return;
+  }
+  size_ += buffer.size();
+  allocated_ += buffer.capacity();
+  segments_.emplace_back(std::move(buffer));
+  account();
+}
+
+void routine::http::MemoryBody::write(std::span<const uint8_t> bytes) {
+  if (bytes.empty()) return;
+  auto space = prepare(bytes.size());
+  ::memcpy(space.data(), bytes.data(), bytes.size());
+  commit(bytes.size());
 }
 
 std::vector<uint8_t> routine::http::MemoryBody::read() const {
-  return data_;
+  auto bytes = span();
+  return std::vector<uint8_t>(bytes.begin(), bytes.end());
 }
 
 size_t routine::http::MemoryBody::size() const {
-  return data_.size();
+  return size_;
 }
 
 std::string routine::http::MemoryBody::as_string() const {
-  return std::string(data_.begin(), data_.end());
+  std::string result;
+  result.reserve(size_);
+  append_to(result);
+  return result;
+}
+
+std::span<const uint8_t> routine::http::MemoryBody::span() const {
+  if (segments_.size() > 1) {
+    Block joined{std::make_unique_for_overwrite<uint8_t[]>(size_), 0, size_};
+    for (const auto& segment : segments_) {
+      auto bytes = bytes_of(segment);
+      ::memcpy(joined.data.get() + joined.size, bytes.data(), bytes.size());
+      joined.size += bytes.size();
+    }
+    segments_.clear();
+    segments_.emplace_back(std::move(joined));
+    allocated_ = size_;
+    account();
+  }
+  return segments_.empty() ? std::span<const uint8_t>{} : bytes_of(segments_.front());
+}
+
+void routine::http::MemoryBody::for_each_segment(
+    const std::function<void(std::span<const uint8_t>)>& callback) const {
+  for (const auto& segment : segments_)
+    if (auto bytes = bytes_of(segment); !bytes.empty()) callback(bytes);
+}
+
+std::span<uint8_t> routine::http::MemoryBody::prepare(size_t size) {
+  Block& block = tail_block(size);
+  return {block.data.get() + block.size, size};
+}
+
+void routine::http::MemoryBody::commit(size_t size) {
+  std::get<Block>(segments_.back()).size += size;
+  size_ += size;
+}
+
+bool routine::http::MemoryBody::reserve(size_t size) {
+  if (!charge_.try_resize(std::max(charge_.bytes(), allocated_ + size))) return false;
+  reserved_ = allocated_ + size;
+  return true;
+}
+
+void routine::http::MemoryBody::append_to(std::string& buffer) const {
+  for (const auto& segment : segments_) {
+    auto bytes = bytes_of(segment);
+    buffer.append(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+  }
 }
 
 const uint8_t* routine::http::MemoryBody::data() const {
-  return data_.data();
+  return span().data();
 }
 
 //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  // //  //  //  //  // //
 
+routine::http::FileBody::FileBody() : FileBody(std::filesystem::temp_directory_path()) {}
+
+routine::http::FileBody::FileBody(const std::filesystem::path& directory)
+    : fd_(open_temporary(directory)) {}
+
+routine::http::FileBody::~FileBody() {
+  ::close(fd_);
+}
+
+void routine::http::FileBody::operator=(const std::string& str) {
+  if (::ftruncate(fd_, 0) != 0) throw_errno("Cannot truncate the body file");
+  ::lseek(fd_, 0, SEEK_SET);
+  size_ = 0;
+  write(str);
+}
+
+void routine::http::FileBody::write(const std::vector<uint8_t>& buffer) {
+  write(std::span<const uint8_t>(buffer));
+}
+
+void routine::http::FileBody::write(asio::streambuf& buffer) {
+  write(std::span<const uint8_t>(static_cast<const uint8_t*>(buffer.data().data()),
+                                 buffer.data().size()));
+  buffer.consume(buffer.size());
+}
+
+void routine::http::FileBody::write(const std::string& buffer) {
+  write(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(buffer.data()),
+                                 buffer.size()));
+}
+
+void routine::http::FileBody::write(std::string&& buffer) {
+  write(static_cast<const std::string&>(buffer));
+}
+
+void routine::http::FileBody::write(std::span<const uint8_t> bytes) {
+  write_all(fd_, bytes.data(), bytes.size());
+  size_ += bytes.size();
+}
+
+size_t routine::http::FileBody::read_at(uint64_t offset, uint8_t* data, size_t size) const {
+  return read_all(fd_, offset, data, size);
+}
+
+std::vector<uint8_t> routine::http::FileBody::read() const {
+  std::vector<uint8_t> result(size_);
+  result.resize(read_at(0, result.data(), result.size()));
+  return result;
+}
+
+size_t routine::http::FileBody::size() const {
+  return size_;
+}
+
+std::string routine::http::FileBody::as_string() const {
+  std::string result;
+  append_to(result);
+  return result;
+}
+
+void routine::http::FileBody::for_each_segment(
+    const std::function<void(std::span<const uint8_t>)>& callback) const {
+  auto chunk = std::make_unique_for_overwrite<uint8_t[]>(read_chunk_size);
+  for (uint64_t offset = 0; offset < size_;) {
+    size_t count =
+        read_at(offset, chunk.get(), std::min<uint64_t>(read_chunk_size, size_ - offset));
+    if (count == 0) break;
+    callback({chunk.get(), count});
+    offset += count;
+  }
+}
+
+void routine::http::FileBody::append_to(std::string& buffer) const {
+  size_t size = buffer.size();
+  buffer.resize_and_overwrite(size + size_, [this, size](char* data, size_t new_size) {
+    return size + read_at(0, reinterpret_cast<uint8_t*>(data) + size, new_size - size);
+  });
+}
+
+std::unique_ptr<routine::http::I_BodyChunks> routine::http::FileBody::make_chunks() const {
+  if (size_ <= read_chunk_size) return nullptr;
+  return std::make_unique<FileChunks>(*this);
+}
+
+void routine::http::FileBody::save(const std::filesystem::path& path) const {
+  // an unnamed file is linked by its descriptor, an unlinked one has to be copied
+  std::string self = std::format("/proc/self/fd/{}", fd_);
+  if (::linkat(AT_FDCWD, self.c_str(), AT_FDCWD, path.c_str(), AT_SYMLINK_FOLLOW) == 0) return;
+
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0) throw_errno(std::format("Cannot create '{}'", path.string()));
+  try {
+    for_each_segment([fd](std::span<const uint8_t> bytes) {
+      write_all(fd, bytes.data(), bytes.size());
+    });
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  ::close(fd);
+}
+
+//  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  // //  //  //  //  // //
+
+std::shared_ptr<const int> routine::http::FileRangeBody::share_descriptor(int fd) {
+  return std::shared_ptr<const int>(new int(fd), [](const int* fd) {
+    ::close(*fd);
+    delete fd;
+  });
+}
+
+void routine::http::FileRangeBody::operator=(const std::string&) {
+  throw std::logic_error("FileRangeBody is read-only");
+}
+
+void routine::http::FileRangeBody::write(const std::vector<uint8_t>&) {
+  throw std::logic_error("FileRangeBody is read-only");
+}
+
+void routine::http::FileRangeBody::write(asio::streambuf&) {
+  throw std::logic_error("FileRangeBody is read-only");
+}
+
+void routine::http::FileRangeBody::write(const std::string&) {
+  throw std::logic_error("FileRangeBody is read-only");
+}
+
+void routine::http::FileRangeBody::write(std::string&&) {
+  throw std::logic_error("FileRangeBody is read-only");
+}
+
+size_t routine::http::FileRangeBody::read_at(uint64_t offset, uint8_t* data, size_t size) const {
+  if (offset >= length_) return 0;
+  return read_all(*fd_, offset_ + offset, data, std::min<uint64_t>(size, length_ - offset));
+}
+
+std::vector<uint8_t> routine::http::FileRangeBody::read() const {
+  std::vector<uint8_t> result(length_);
+  result.resize(read_at(0, result.data(), result.size()));
+  return result;
+}
+
+size_t routine::http::FileRangeBody::size() const {
+  return length_;
+}
+
+std::string routine::http::FileRangeBody::as_string() const {
+  std::string result;
+  append_to(result);
+  return result;
+}
+
+void routine::http::FileRangeBody::for_each_segment(
+    const std::function<void(std::span<const uint8_t>)>& callback) const {
+  auto chunk = std::make_unique_for_overwrite<uint8_t[]>(FileBody::read_chunk_size);
+  for (uint64_t offset = 0; offset < length_;) {
+    size_t count = read_at(offset, chunk.get(),
+                           std::min<uint64_t>(FileBody::read_chunk_size, length_ - offset));
+    if (count == 0) break;
+    callback({chunk.get(), count});
+    offset += count;
+  }
+}
+
+void routine::http::FileRangeBody::append_to(std::string& buffer) const {
+  size_t size = buffer.size();
+  buffer.resize_and_overwrite(size + length_, [this, size](char* data, size_t new_size) {
+    return size + read_at(0, reinterpret_cast<uint8_t*>(data) + size, new_size - size);
+  });
+}
+
+std::unique_ptr<routine::http::I_BodyChunks> routine::http::FileRangeBody::make_chunks() const {
+  // always streamed, a truncated file has to close the connection
+  return std::make_unique<FileRangeChunks>(*this);
+}
+
+//  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  // //  //  //  //  // //
+
+routine::http::JsonBody::JsonBody(tao::json::value value)
+    : value_(std::move(value)), has_text_(false) {}
+
+void routine::http::JsonBody::drop_value() {
+  if (!has_text_) raw_.clear();
+  has_text_ = true;
+  value_.reset();
+  value_size_ = static_cast<size_t>(-1);
+}
+
+void routine::http::JsonBody::account() {
+  charge_.resize(std::max(raw_.capacity(), reserved_));
+}
+
 void routine::http::JsonBody::operator=(const std::string& buffer) {
-  write(buffer);
+  drop_value();
+  raw_ = buffer;
+  account();
 }
 
 void routine::http::JsonBody::write(const std::vector<uint8_t>& buffer) {
-  write(std::string(buffer.begin(), buffer.end()));
+  drop_value();
+  raw_.append(buffer.begin(), buffer.end());
+  account();
 }
 
 void routine::http::JsonBody::write(asio::streambuf& buffer) {
-  write(std::string(asio::buffers_begin(buffer.data()), asio::buffers_end(buffer.data())));
+  drop_value();
+  raw_.append(static_cast<const char*>(buffer.data().data()), buffer.data().size());
+  buffer.consume(buffer.size());
+  account();
 }
 
 void routine::http::JsonBody::write(const std::string& buffer) {
-  try {
-    data_ = tao::json::from_string(buffer);
-  } catch (const std::exception& e) {
-    spdlog::get("Http")->error("Exception # JsonBody # {}", e.what());
-  }
+  drop_value();
+  raw_.append(buffer);
+  account();
 }
 
 void routine::http::JsonBody::write(std::string&& buffer) {
-  try {
-    data_ = tao::json::from_string(std::move(buffer));
-  } catch (const std::exception& e) {
-    spdlog::get("Http")->error("Exception # JsonBody # {}", e.what());
-  }
+  drop_value();
+  if (raw_.empty())
+    raw_ = std::move(buffer);
+  else
+    raw_.append(buffer);
+  account();
+}
+
+void routine::http::JsonBody::write(std::span<const uint8_t> bytes) {
+  drop_value();
+  raw_.append(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+  account();
+}
+
+std::span<const uint8_t> routine::http::JsonBody::span() const {
+  if (!has_text_) return {};
+  return {reinterpret_cast<const uint8_t*>(raw_.data()), raw_.size()};
+}
+
+void routine::http::JsonBody::for_each_segment(
+    const std::function<void(std::span<const uint8_t>)>& callback) const {
+  if (!has_text_)
+    I_BodyStorage::for_each_segment(callback);
+  else if (!raw_.empty())
+    callback(span());
+}
+
+std::span<uint8_t> routine::http::JsonBody::prepare(size_t size) {
+  drop_value();
+  prepared_ = raw_.size();
+  // the socket overwrites the space, there is no need to zero it
+  raw_.resize_and_overwrite(prepared_ + size, [](char*, size_t size) { return size; });
+  account();
+  return {reinterpret_cast<uint8_t*>(raw_.data()) + prepared_, size};
+}
+
+void routine::http::JsonBody::commit(size_t size) {
+  raw_.resize(prepared_ + size);
+}
+
+bool routine::http::JsonBody::reserve(size_t size) {
+  if (!charge_.try_resize(std::max(charge_.bytes(), raw_.size() + size))) return false;
+  reserved_ = raw_.size() + size;
+  return true;
 }
 
 std::vector<uint8_t> routine::http::JsonBody::read() const {
-  std::string str = data_.get_string();
-  return std::vector<uint8_t>(str.begin(), str.end());
+  if (!has_text_) {
+    std::string text = as_string();
+    return std::vector<uint8_t>(text.begin(), text.end());
+  }
+  return std::vector<uint8_t>(raw_.begin(), raw_.end());
 }
 
 size_t routine::http::JsonBody::size() const {
-  return data_.get_string().size();
+  if (has_text_) return raw_.size();
+
+  size_t size = value_size_.load(std::memory_order_relaxed);
+  if (size == static_cast<size_t>(-1)) {
+    detail::JsonCounter counter;
+    JsonWriter<detail::JsonCounter>(*value_).write(counter, static_cast<size_t>(-1));
+    size = counter.size;
+    value_size_.store(size, std::memory_order_relaxed);
+  }
+  return size;
 }
 
 std::string routine::http::JsonBody::as_string() const {
-  return data_.get_string();
+  if (has_text_) return raw_;
+
+  std::string result;
+  result.reserve(size());
+  append_to(result);
+  return result;
+}
+
+void routine::http::JsonBody::append_to(std::string& buffer) const {
+  if (has_text_)
+    buffer.append(raw_);
+  else
+    JsonWriter<std::string>(*value_).write(buffer, static_cast<size_t>(-1));
+}
+
+std::unique_ptr<routine::http::I_BodyChunks> routine::http::JsonBody::make_chunks() const {
+  if (has_text_) return nullptr;
+  if (value_size_.load(std::memory_order_relaxed) <= chunked_size) return nullptr;
+
+  // counting stops after chunked_size bytes, small values are counted whole once
+  detail::JsonCounter counter;
+  if (!JsonWriter<detail::JsonCounter>(*value_).write(counter, chunked_size + 1)) {
+    value_size_.store(counter.size, std::memory_order_relaxed);
+    return nullptr;
+  }
+  return std::make_unique<JsonChunks>(*value_);
 }
 
 const uint8_t* routine::http::JsonBody::data() const {
-  return nullptr;
+  return has_text_ ? reinterpret_cast<const uint8_t*>(raw_.data()) : nullptr;
 }
 
 const tao::json::value& routine::http::JsonBody::json() const {
-  return data_;
+  if (!value_ && raw_.empty()) value_.emplace(tao::json::null);
+  if (!value_) {
+    try {
+      value_ = tao::json::from_string(raw_);
+    } catch (const std::exception& e) {
+      spdlog::get("Http")->error("Exception # JsonBody # {}", e.what());
+      value_.emplace(tao::json::null);
+    }
+  }
+  return *value_;
 }
@@ -0,0 +1,533 @@
+#include "http/compression.hpp"
+#include "http/body_storage.hpp"
+#include "utils/utils.hpp"
+#include <algorithm>
+#include <format>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef USE_BROTLI
+#include <brotli/decode.h>
+#include <brotli/encode.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+  using routine::http::Encoding;
+
+  // Codings in order of preference for equal q-values
+  constexpr std::array<Encoding, 3> preferred{Encoding::Brotli, Encoding::Zstd, Encoding::Gzip};
+
+  // Decoded bytes passed to the output at once
+  constexpr size_t decoded_chunk_size = 64 * 1024;
+
+  // Bodies decoded up to this size are not checked against max_ratio, small inputs of
+  // repetitive text compress far better than the ratio of a bomb
+  constexpr size_t min_ratio_size = 64 * 1024;
+
+#ifdef USE_ZSTD
+  // RFC 8878 7.2: 8 MB windows at most, larger ones are rejected instead of allocated
+  constexpr int max_zstd_window_log = 23;
+#endif
+
+  char* decoded_chunk() {
+    thread_local std::array<char, decoded_chunk_size> chunk;
+    return chunk.data();
+  }
+
+  bool equals_ignore_case(std::string_view left, std::string_view right) noexcept {
+    return left.size() == right.size() &&
+           std::equal(left.begin(), left.end(), right.begin(), [](char a, char b) {
+             return (a | 0x20) == (b | 0x20);
+           });
+  }
+
+  std::string_view trim(std::string_view string) noexcept {
+    while (!string.empty() && (string.front() == ' ' || string.front() == '\t'))
+      string.remove_prefix(1);
+    while (!string.empty() && (string.back() == ' ' || string.back() == '\t'))
+      string.remove_suffix(1);
+    return string;
+  }
+
+  // q-value in thousandths, 1000 if 'parameters' have none
+  int quality(std::string_view parameters) noexcept {
+    int result = 1000;
+    routine::utils::for_each_part(parameters, ';', [&result](std::string_view parameter) {
+      parameter = trim(parameter);
+      if (parameter.size() < 3 || (parameter[0] | 0x20) != 'q' || parameter[1] != '=') return;
+      parameter.remove_prefix(2);
+
+      if (parameter.front() != '0') {
+        result = 1000;
+        return;
+      }
+      result = 0;
+      int scale = 100;
+      for (size_t i = 2; i < parameter.size() && i < 5 && parameter[1] == '.'; ++i, scale /= 10)
+        if (parameter[i] >= '0' && parameter[i] <= '9') result += (parameter[i] - '0') * scale;
+    });
+    return result;
+  }
+
+  // "abc" -> "abc-br", W/"abc" -> W/"abc-br"
+  std::string coded_etag(std::string_view etag, Encoding encoding) {
+    std::string result(etag);
+    size_t position = result.ends_with('"') ? result.size() - 1 : result.size();
+    result.insert(position, std::string("-").append(routine::http::to_string(encoding)));
+    return result;
+  }
+
+  // false if Vary covers Accept-Encoding already
+  bool add_vary(routine::http::Headers& headers) {
+    using routine::http::Header;
+    auto vary = headers.find(Header::Vary);
+    if (!vary) {
+      headers.insert(Header::Vary, "Accept-Encoding");
+      return true;
+    }
+
+    bool is_present = false;
+    routine::utils::for_each_part(vary->value(), ',', [&is_present](std::string_view name) {
+      is_present |= equals_ignore_case(trim(name), "accept-encoding") || trim(name) == "*";
+    });
+    if (!is_present) headers.set(Header::Vary, std::string(vary->value()) + ", Accept-Encoding");
+    return !is_present;
+  }
+
+#ifdef USE_ZLIB
+  // deflate stream in gzip format, reset between calls and reinitialized on level change
+  struct GzipContext {
+    z_stream stream{};
+    int level{-1};
+
+    ~GzipContext() {
+      if (level >= 0) deflateEnd(&stream);
+    }
+
+    z_stream* get(int new_level) {
+      if (level == new_level) {
+        deflateReset(&stream);
+        return &stream;
+      }
+      if (level >= 0) deflateEnd(&stream);
+      stream = {};
+      level = -1;
+      if (deflateInit2(&stream, new_level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return nullptr;
+      level = new_level;
+      return &stream;
+    }
+  };
+#endif
+
+#ifdef USE_ZSTD
+  struct ZstdContext {
+    ZSTD_CCtx* context{ZSTD_createCCtx()};
+    ~ZstdContext() { ZSTD_freeCCtx(context); }
+  };
+#endif
+} // namespace
+
+uint8_t routine::http::supported_encodings() noexcept {
+  uint8_t result = encoding_bit(Encoding::Identity);
+#ifdef USE_ZLIB
+  result |= encoding_bit(Encoding::Gzip);
+#endif
+#ifdef USE_BROTLI
+  result |= encoding_bit(Encoding::Brotli);
+#endif
+#ifdef USE_ZSTD
+  result |= encoding_bit(Encoding::Zstd);
+#endif
+  return result;
+}
+
+std::string_view routine::http::to_string(Encoding encoding) noexcept {
+  switch (encoding) {
+    case Encoding::Gzip:
+      return "gzip";
+    case Encoding::Brotli:
+      return "br";
+    case Encoding::Zstd:
+      return "zstd";
+    default:
+      return "identity";
+  }
+}
+
+routine::http::Encoding routine::http::negotiate(std::string_view accept_encoding,
+                                                 uint8_t encodings) noexcept {
+  std::array<int, encoding_count> qualities;
+  qualities.fill(-1); // not listed
+  int any = -1;
+
+  routine::utils::for_each_part(accept_encoding, ',', [&](std::string_view part) {
+    size_t semicolon = std::min(part.find(';'), part.size());
+    std::string_view name = trim(part.substr(0, semicolon));
+    int value = quality(part.substr(semicolon));
+
+    if (name == "*")
+      any = value;
+    else if (equals_ignore_case(name, "gzip") || equals_ignore_case(name, "x-gzip"))
+      qualities[static_cast<size_t>(Encoding::Gzip)] = value;
+    else if (equals_ignore_case(name, "br"))
+      qualities[static_cast<size_t>(Encoding::Brotli)] = value;
+    else if (equals_ignore_case(name, "zstd"))
+      qualities[static_cast<size_t>(Encoding::Zstd)] = value;
+  });
+
+  Encoding result = Encoding::Identity;
+  int best = 0;
+  for (Encoding encoding : preferred) {
+    if (!(encodings & encoding_bit(encoding))) continue;
+    int value = qualities[static_cast<size_t>(encoding)];
+    if (value < 0) value = any;
+    if (value > best) {
+      result = encoding;
+      best = value;
+    }
+  }
+  return result;
+}
+
+bool routine::http::is_compressible(std::string_view content_type) noexcept {
+  content_type = content_type.substr(0, content_type.find(';'));
+  if (content_type.starts_with("text/")) return true;
+  for (std::string_view suffix : {"json", "xml", "javascript", "wasm", "x-www-form-urlencoded"})
+    if (content_type.find(suffix) != std::string_view::npos) return true;
+  return false;
+}
+
+std::optional<std::string> routine::http::compress(Encoding encoding, std::string_view data,
+                                                   const CompressionPolicy& policy) {
+  std::string result;
+  switch (encoding) {
+#ifdef USE_ZLIB
+    case Encoding::Gzip: {
+      thread_local GzipContext context;
+      z_stream* stream = context.get(policy.gzip_level);
+      if (!stream) return std::nullopt;
+
+      result.resize(deflateBound(stream, data.size()));
+      stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+      stream->avail_in = data.size();
+      stream->next_out = reinterpret_cast<Bytef*>(result.data());
+      stream->avail_out = result.size();
+      if (deflate(stream, Z_FINISH) != Z_STREAM_END) return std::nullopt;
+      result.resize(stream->total_out);
+      break;
+    }
+#endif
+#ifdef USE_BROTLI
+    case Encoding::Brotli: {
+      // the one-shot encoder keeps no state between calls, so there is no context to reuse
+      size_t size = BrotliEncoderMaxCompressedSize(data.size());
+      if (size == 0) return std::nullopt;
+      result.resize(size);
+      if (!BrotliEncoderCompress(policy.brotli_level, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_GENERIC,
+                                 data.size(), reinterpret_cast<const uint8_t*>(data.data()),
+                                 &size, reinterpret_cast<uint8_t*>(result.data())))
+        return std::nullopt;
+      result.resize(size);
+      break;
+    }
+#endif
+#ifdef USE_ZSTD
+    case Encoding::Zstd: {
+      thread_local ZstdContext context;
+      result.resize(ZSTD_compressBound(data.size()));
+      size_t size = ZSTD_compressCCtx(context.context, result.data(), result.size(), data.data(),
+                                      data.size(), policy.zstd_level);
+      if (ZSTD_isError(size)) return std::nullopt;
+      result.resize(size);
+      break;
+    }
+#endif
+    default:
+      return std::nullopt;
+  }
+
+  if (result.size() > data.size() * policy.max_ratio) return std::nullopt;
+  return result;
+}
+
+routine::http::Response_ptr routine::http::compress_response(const Response_ptr& response,
+                                                             Request& request,
+                                                             const CompressionPolicy& policy) {
+  // file bodies are sent from the disk, they are not read into memory to be compressed
+  if (!response || response->is_static() || !response->body() ||
+      response->body()->get_type() == StorageType::File || request.method() == Method::Head)
+    return response;
+
+  Status status = response->status();
+  if (status == Status::No_Content || status == Status::Not_Modified ||
+      status == Status::Partial_Content)
+    return response;
+
+  const Headers& headers = response->headers();
+  if (headers.contains(Header::Content_Encoding) || headers.contains(Header::Content_Range))
+    return response;
+
+  auto type = headers.find(Header::Content_Type);
+  if (!is_compressible(type ? type->value() : "text/plain") ||
+      response->body()->size() < policy.min_size)
+    return response;
+
+  // caches must keep the codings apart even if this client gets the identity. The response
+  // may be shared by the handler, so Vary goes to a copy of its headers
+  Headers coded_headers = headers;
+  bool is_vary_added = add_vary(coded_headers);
+  auto identity = [&] {
+    return is_vary_added
+               ? std::make_shared<Response>(status, std::move(coded_headers), response->body())
+               : response;
+  };
+
+  auto accept = request.headers().find(Header::Accept_Encoding);
+  Encoding encoding = negotiate(accept ? accept->value() : std::string_view{}, policy.encodings);
+  if (encoding == Encoding::Identity) return identity();
+
+  // contiguous bodies are compressed in place
+  auto& body = *response->body();
+  std::string joined;
+  auto bytes = body.span();
+  if (bytes.size() != body.size()) {
+    joined = body.as_string();
+    bytes = {reinterpret_cast<const uint8_t*>(joined.data()), joined.size()};
+  }
+  auto compressed = compress(
+      encoding, std::string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size()),
+      policy);
+  if (!compressed) return identity();
+
+  coded_headers.insert(Header::Content_Encoding, to_string(encoding));
+  return std::make_shared<Response>(status, std::move(coded_headers), std::move(*compressed));
+}
+
+routine::http::Representations
+routine::http::make_representations(Headers headers, std::string body,
+                                    const CompressionPolicy& policy,
+                                    std::initializer_list<Header> validators) {
+  std::array<std::optional<std::string>, encoding_count> bodies;
+  bool is_compressed = false;
+
+  auto type = headers.find(Header::Content_Type);
+  if (body.size() >= policy.min_size && !headers.contains(Header::Content_Encoding) &&
+      is_compressible(type ? type->value() : "text/plain"))
+    for (Encoding encoding : preferred)
+      if (policy.encodings & encoding_bit(encoding)) {
+        auto& compressed = bodies[static_cast<size_t>(encoding)];
+        compressed = compress(encoding, body, policy);
+        is_compressed |= compressed.has_value();
+      }
+  if (is_compressed) add_vary(headers);
+  bodies[static_cast<size_t>(Encoding::Identity)] = std::move(body);
+
+  std::string etag(headers.at(Header::ETag).value());
+  Representations result;
+  for (size_t i = 0; i < encoding_count; ++i) {
+    if (!bodies[i]) continue;
+    auto encoding = static_cast<Encoding>(i);
+    auto& representation = result[i];
+
+    Headers coded = headers;
+    representation.etag = encoding == Encoding::Identity ? etag : coded_etag(etag, encoding);
+    if (encoding != Encoding::Identity) {
+      coded.set(Header::ETag, representation.etag);
+      coded.insert(Header::Content_Encoding, to_string(encoding));
+    }
+
+    // RFC 7232 4.1: 304 carries the validators and caching headers of the 200
+    Headers not_modified{{"ETag", representation.etag}};
+    for (Header header : validators)
+      if (auto field = coded.find(header)) not_modified.insert(header, field->value());
+
+    representation.response =
+        Response::make_static(Status::Ok, std::move(coded), std::move(*bodies[i]));
+    representation.not_modified =
+        Response::make_static(Status::Not_Modified, std::move(not_modified));
+  }
+  return result;
+}
+
+const routine::http::Representation&
+routine::http::select_representation(const Representations& representations, Request& request) {
+  auto accept = request.headers().find(Header::Accept_Encoding);
+  if (!accept) return representations[static_cast<size_t>(Encoding::Identity)];
+
+  uint8_t available = 0;
+  for (size_t i = 0; i < encoding_count; ++i)
+    if (representations[i].response) available |= encoding_bit(static_cast<Encoding>(i));
+  return representations[static_cast<size_t>(negotiate(accept->value(), available))];
+}
+
+std::optional<routine::http::Encoding>
+routine::http::parse_encoding(std::string_view content_encoding) noexcept {
+  content_encoding = trim(content_encoding);
+  if (content_encoding.empty() || equals_ignore_case(content_encoding, "identity"))
+    return Encoding::Identity;
+  if (equals_ignore_case(content_encoding, "gzip") ||
+      equals_ignore_case(content_encoding, "x-gzip") ||
+      equals_ignore_case(content_encoding, "deflate"))
+    return Encoding::Gzip;
+  if (equals_ignore_case(content_encoding, "br")) return Encoding::Brotli;
+  if (equals_ignore_case(content_encoding, "zstd")) return Encoding::Zstd;
+  return std::nullopt;
+}
+
+struct routine::http::Decompressor::Stream {
+  Encoding encoding;
+#ifdef USE_ZLIB
+  z_stream gzip{};
+#endif
+#ifdef USE_BROTLI
+  BrotliDecoderState* brotli{nullptr};
+#endif
+#ifdef USE_ZSTD
+  ZSTD_DCtx* zstd{nullptr};
+#endif
+
+  ~Stream() {
+#ifdef USE_ZLIB
+    if (encoding == Encoding::Gzip) inflateEnd(&gzip);
+#endif
+#ifdef USE_BROTLI
+    if (brotli) BrotliDecoderDestroyInstance(brotli);
+#endif
+#ifdef USE_ZSTD
+    if (zstd) ZSTD_freeDCtx(zstd);
+#endif
+  }
+};
+
+routine::http::Decompressor::Decompressor(Encoding encoding, const DecompressionPolicy& policy)
+    : stream_(std::make_unique<Stream>(encoding)), policy_(policy) {
+  bool is_ready = false;
+  switch (encoding) {
+#ifdef USE_ZLIB
+    case Encoding::Gzip:
+      // 15 + 32: the largest window, gzip or zlib header detected automatically
+      is_ready = inflateInit2(&stream_->gzip, 15 + 32) == Z_OK;
+      if (!is_ready) stream_->encoding = Encoding::Identity; // nothing to end
+      break;
+#endif
+#ifdef USE_BROTLI
+    case Encoding::Brotli:
+      stream_->brotli = BrotliDecoderCreateInstance(nullptr, nullptr, nullptr);
+      is_ready = stream_->brotli != nullptr;
+      break;
+#endif
+#ifdef USE_ZSTD
+    case Encoding::Zstd:
+      stream_->zstd = ZSTD_createDCtx();
+      is_ready = stream_->zstd != nullptr &&
+                 !ZSTD_isError(ZSTD_DCtx_setParameter(stream_->zstd, ZSTD_d_windowLogMax,
+                                                      max_zstd_window_log));
+      break;
+#endif
+    default:
+      break;
+  }
+  if (!is_ready)
+    throw std::invalid_argument(
+        std::format("Decompressor: '{}' is not built in", to_string(encoding)));
+}
+
+routine::http::Decompressor::~Decompressor() = default;
+
+bool routine::http::Decompressor::write(std::string_view input, const Output& output) {
+  if (status_ != Status::Ok) return false;
+  if (input.empty()) return true;
+  // bytes after the end of the stream, gzip starts another member with them
+  if (is_finished_ && stream_->encoding != Encoding::Gzip) return fail(Status::Bad_Request);
+  encoded_ += input.size();
+
+  char* chunk = decoded_chunk();
+  switch (stream_->encoding) {
+#ifdef USE_ZLIB
+    case Encoding::Gzip: {
+      z_stream& stream = stream_->gzip;
+      stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+      stream.avail_in = input.size();
+      do {
+        // concatenated members (RFC 1952 2.2) decode into one body
+        if (is_finished_) {
+          if (inflateReset(&stream) != Z_OK) return fail(Status::Bad_Request);
+          is_finished_ = false;
+        }
+        stream.next_out = reinterpret_cast<Bytef*>(chunk);
+        stream.avail_out = decoded_chunk_size;
+        int result = inflate(&stream, Z_NO_FLUSH);
+        if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+          return fail(Status::Bad_Request);
+        if (!emit(chunk, decoded_chunk_size - stream.avail_out, output)) return false;
+        if (result == Z_STREAM_END) is_finished_ = true;
+      } while (stream.avail_in > 0 || (!is_finished_ && stream.avail_out == 0));
+      return true;
+    }
+#endif
+#ifdef USE_BROTLI
+    case Encoding::Brotli: {
+      size_t available_in = input.size();
+      auto next_in = reinterpret_cast<const uint8_t*>(input.data());
+      while (true) {
+        size_t available_out = decoded_chunk_size;
+        auto next_out = reinterpret_cast<uint8_t*>(chunk);
+        auto result = BrotliDecoderDecompressStream(stream_->brotli, &available_in, &next_in,
+                                                    &available_out, &next_out, nullptr);
+        if (result == BROTLI_DECODER_RESULT_ERROR) return fail(Status::Bad_Request);
+        if (!emit(chunk, decoded_chunk_size - available_out, output)) return false;
+        if (result == BROTLI_DECODER_RESULT_SUCCESS) {
+          is_finished_ = true;
+          return available_in == 0 || fail(Status::Bad_Request);
+        }
+        if (result == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT) return true;
+      }
+    }
+#endif
+#ifdef USE_ZSTD
+    case Encoding::Zstd: {
+      ZSTD_inBuffer in{input.data(), input.size(), 0};
+      while (true) {
+        ZSTD_outBuffer out{chunk, decoded_chunk_size, 0};
+        size_t result = ZSTD_decompressStream(stream_->zstd, &out, &in);
+        if (ZSTD_isError(result)) return fail(Status::Bad_Request);
+        if (!emit(chunk, out.pos, output)) return false;
+        if (result == 0) { // end of the frame
+          is_finished_ = true;
+          return in.pos == in.size || fail(Status::Bad_Request);
+        }
+        if (in.pos == in.size && out.pos < out.size) return true;
+      }
+    }
+#endif
+    default:
+      return fail(Status::Bad_Request);
+  }
+}
+
+bool routine::http::Decompressor::finish() {
+  if (status_ != Status::Ok) return false;
+  return is_finished_ || fail(Status::Bad_Request);
+}
+
+bool routine::http::Decompressor::emit(const char* data, size_t size, const Output& output) {
+  decoded_ += size;
+  if (decoded_ > policy_.max_size ||
+      (decoded_ > min_ratio_size && decoded_ > encoded_ * policy_.max_ratio))
+    return fail(Status::Payload_Too_Large);
+  if (size > 0) output(std::string_view(data, size));
+  return true;
+}
+
+bool routine::http::Decompressor::fail(Status status) noexcept {
+  status_ = status;
+  return false;
+}
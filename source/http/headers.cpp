@@ -1,125 +1,357 @@
 #include "http/headers.hpp"
 #include "http/types.hpp"
+#include "utils/simd.hpp"
 #include "utils/utils.hpp"
+#include <charconv>
 #include <format>
+#include <functional>
+#include <iterator>
 #include <spdlog/spdlog.h>
 #include <sstream>
 #include <stdexcept>
 #include <string_view>
+#include <strings.h>
 
-routine::http::Headers::Headers(const std::string& input) {
-  std::istringstream stream(input);
-  init_from_stream(stream);
+namespace {
+  // Remove optional whitespaces around header value
+  std::string_view trim_ows(std::string_view value) {
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+      value.remove_prefix(1);
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+      value.remove_suffix(1);
+    return value;
+  }
+
+  bool is_inside(std::string_view string, std::string_view buffer) {
+    return !string.empty() && std::less_equal<>{}(buffer.data(), string.data()) &&
+           std::less_equal<>{}(string.data() + string.size(), buffer.data() + buffer.size());
+  }
+
+  std::string_view rebase(std::string_view string, const char* from, const char* to) {
+    return {to + (string.data() - from), string.size()};
+  }
+} // namespace
+
+routine::http::Headers::Headers(std::pmr::memory_resource* resource)
+    : raw_(resource), storage_(resource) {}
+
+routine::http::Headers::Headers(std::string_view raw) {
+  init_from_raw(raw, 0);
 }
 
 routine::http::Headers::Headers(std::istringstream& stream) {
-  init_from_stream(stream);
+  init_from_raw(std::string(std::istreambuf_iterator<char>(stream), {}), 0);
 }
 
-void routine::http::Headers::init_from_stream(std::istringstream& stream) {
-  std::string line;
-  while (std::getline(stream, line)) {
-    if (line[0] == '\r') break;
+routine::http::Headers::Headers(
+    std::initializer_list<std::pair<std::string_view, std::string_view>> fields) {
+  for (const auto& [key, value] : fields)
+    insert(key, value);
+}
 
-    size_t n = line.find(':', 2);
-    if (n == std::string::npos) continue;
+// copies never share the memory resource of the source, e.g. the arena of a request
+routine::http::Headers::Headers(const Headers& other) {
+  assign(other);
+}
 
-    std::string header = line.substr(0, n);
-    std::string value =
-        line.substr(n + 2, line.size() - n - 3); // skip ": " and '\r' at back of line
+routine::http::Headers::Headers(Headers&& other) noexcept : Headers(other.resource()) {
+  *this = std::move(other);
+}
 
-    std::transform(header.begin(), header.end(), header.begin(), ::tolower);
+routine::http::Headers& routine::http::Headers::operator=(const Headers& other) {
+  if (this != &other) assign(other);
+  return *this;
+}
+
+routine::http::Headers& routine::http::Headers::operator=(Headers&& other) {
+  if (this == &other) return *this;
 
-    headers_.emplace(std::move(header), std::move(value));
+  if (*resource() != *other.resource()) {
+    assign(other);
+    other.clear();
+    return *this;
   }
+
+  // short strings are stored inline, so their views must be moved with them
+  const char* old_raw = other.raw_.data();
+  std::string_view old_raw_view = other.raw_;
+
+  raw_ = std::move(other.raw_);
+  fields_ = std::move(other.fields_);
+  slots_ = other.slots_;
+  storage_ = std::move(other.storage_);
+
+  if (raw_.data() != old_raw)
+    for (auto& field : fields_) {
+      if (is_inside(field.key_, old_raw_view))
+        field.key_ = rebase(field.key_, old_raw, raw_.data());
+      if (is_inside(field.value_, old_raw_view))
+        field.value_ = rebase(field.value_, old_raw, raw_.data());
+    }
+
+  other.clear();
+  return *this;
+}
+
+void routine::http::Headers::assign(const Headers& other) {
+  storage_.clear();
+  raw_ = other.raw_;
+  fields_ = other.fields_;
+  slots_ = other.slots_;
+  for (auto& field : fields_)
+    field = adopt(field, other);
+}
+
+void routine::http::Headers::init_from_raw(std::string_view raw, size_t offset) {
+  raw_.assign(raw);
+  init_from_string(std::string_view(raw_).substr(std::min(offset, raw_.size())));
+}
+
+void routine::http::Headers::init_from_string(std::string_view input) {
+  namespace simd = routine::utils::simd;
+
+  while (!input.empty()) {
+    size_t line_end = simd::find_char(input.data(), input.size(), '\n');
+    std::string_view line = input.substr(0, line_end);
+    input.remove_prefix(std::min(line_end + 1, input.size()));
+
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    if (line.empty()) break;
+
+    size_t n = simd::find_char(line.data(), line.size(), ':');
+    // skip lines without delimiter or with invalid header name
+    if (n == line.size() || !simd::is_token(line.data(), n)) continue;
+
+    // header names are lowercased in place, 'input' is a view into 'raw_'
+    char* key = raw_.data() + (line.data() - raw_.data());
+    simd::to_lower(key, n);
+
+    push(HeaderField(std::string_view(key, n), trim_ows(line.substr(n + 1))));
+  }
+}
+
+size_t routine::http::Headers::index_of(std::string_view key) const noexcept {
+  if (auto id = utils::header_from_string(key); id != Header::None) return index_of(id);
+
+  for (size_t i = 0; i < fields_.size(); ++i)
+    if (fields_[i].id() == Header::None && fields_[i].key().size() == key.size() &&
+        ::strncasecmp(fields_[i].key().data(), key.data(), key.size()) == 0)
+      return i;
+  return fields_.size();
+}
+
+size_t routine::http::Headers::index_of(routine::http::Header key) const noexcept {
+  size_t slot = slots_[static_cast<size_t>(key)];
+  return slot == 0 ? fields_.size() : slot - 1;
+}
+
+routine::http::HeaderField& routine::http::Headers::push(HeaderField field) {
+  if (field.id() != Header::None) {
+    auto& slot = slots_[static_cast<size_t>(field.id())];
+    if (slot == 0) slot = fields_.size() + 1;
+  }
+  return fields_.push_back(field);
+}
+
+std::string_view routine::http::Headers::store(std::string_view string) {
+  if (string.empty()) return {};
+  return storage_.emplace_front(string);
+}
+
+routine::http::HeaderField routine::http::Headers::adopt(const HeaderField& field,
+                                                         const Headers& source) {
+  HeaderField result = field;
+
+  if (is_inside(field.key_, source.raw_))
+    result.key_ = rebase(field.key_, source.raw_.data(), raw_.data());
+  else if (field.id() == Header::None)
+    result.key_ = store(field.key_);
+  // well-known header names point to static strings
+
+  if (is_inside(field.value_, source.raw_))
+    result.value_ = rebase(field.value_, source.raw_.data(), raw_.data());
+  else
+    result.value_ = store(field.value_);
+
+  return result;
+}
+
+void routine::http::Headers::reindex() noexcept {
+  slots_.fill(0);
+  for (size_t i = fields_.size(); i-- > 0;)
+    if (fields_[i].id() != Header::None) slots_[static_cast<size_t>(fields_[i].id())] = i + 1;
 }
 
 const routine::http::HeaderField& routine::http::Headers::at(std::string_view key) const {
-  auto it = headers_.find(key);
-  if (it == headers_.end()) throw std::invalid_argument(std::format("Header '{}' not found", key));
-  return *it;
+  size_t index = index_of(key);
+  if (index == fields_.size())
+    throw std::invalid_argument(std::format("Header '{}' not found", key));
+  return fields_[index];
 }
 
 const routine::http::HeaderField& routine::http::Headers::at(std::string_view key) noexcept {
-  auto it = headers_.find(key);
-  if (it == headers_.end()) it = headers_.emplace(key.data()).first;
-  return *it;
+  size_t index = index_of(key);
+  if (index == fields_.size()) {
+    insert(key, {});
+    return fields_.back();
+  }
+  return fields_[index];
 }
 
 const routine::http::HeaderField& routine::http::Headers::operator[](std::string_view key) const {
-  auto it = headers_.find(key);
-  if (it == headers_.end()) throw std::invalid_argument(std::format("Header '{}' not found", key));
-  return *it;
+  return at(key);
 }
 
 const routine::http::HeaderField&
 routine::http::Headers::operator[](std::string_view key) noexcept {
-  auto it = headers_.find(key);
-  if (it == headers_.end()) it = headers_.emplace(key.data()).first;
-  return *it;
+  return at(key);
 }
 
 const routine::http::HeaderField& routine::http::Headers::at(routine::http::Header key) const {
-  return at(utils::to_string(key));
+  size_t index = index_of(key);
+  if (index == fields_.size())
+    throw std::invalid_argument(std::format("Header '{}' not found", utils::to_string(key)));
+  return fields_[index];
 }
 
 const routine::http::HeaderField& routine::http::Headers::at(routine::http::Header key) noexcept {
-  return at(utils::to_string(key));
+  size_t index = index_of(key);
+  if (index == fields_.size()) {
+    insert(key, {});
+    return fields_.back();
+  }
+  return fields_[index];
 }
 
 const routine::http::HeaderField&
 routine::http::Headers::operator[](routine::http::Header key) const {
-  return at(utils::to_string(key));
+  return at(key);
 }
 
 const routine::http::HeaderField&
 routine::http::Headers::operator[](routine::http::Header key) noexcept {
-  return at(utils::to_string(key));
+  return at(key);
+}
+
+const routine::http::HeaderField*
+routine::http::Headers::find(std::string_view key) const noexcept {
+  size_t index = index_of(key);
+  return index == fields_.size() ? nullptr : &fields_[index];
+}
+
+const routine::http::HeaderField*
+routine::http::Headers::find(routine::http::Header key) const noexcept {
+  size_t index = index_of(key);
+  return index == fields_.size() ? nullptr : &fields_[index];
 }
 
 bool routine::http::Headers::contains(std::string_view key) const noexcept {
-  return headers_.contains(key);
+  return index_of(key) != fields_.size();
 }
 
 bool routine::http::Headers::contains(routine::http::Header key) const noexcept {
-  return headers_.contains(utils::to_string(key));
+  return slots_[static_cast<size_t>(key)] != 0;
 }
 
-void routine::http::Headers::insert(
-    std::pair<HeaderField::key_type, HeaderField::value_type>&& pair) {
-  insert(std::forward<HeaderField::key_type>(pair.first),
-         std::forward<HeaderField::value_type>(pair.second));
+void routine::http::Headers::insert(std::pair<std::string_view, std::string_view>&& pair) {
+  insert(pair.first, pair.second);
 }
 
-void routine::http::Headers::insert(HeaderField&& header) {
-  headers_.insert(std::move(header));
+void routine::http::Headers::insert(const HeaderField& header) {
+  if (header.id() != Header::None)
+    insert(header.id(), header.value());
+  else
+    insert(header.key(), header.value());
 }
 
-void routine::http::Headers::insert(const HeaderField& header) {
-  headers_.insert(header);
+void routine::http::Headers::insert(std::string_view key, std::string_view value) {
+  if (auto id = utils::header_from_string(key); id != Header::None) return insert(id, value);
+
+  std::pmr::string& stored_key = storage_.emplace_front(key);
+  routine::utils::simd::to_lower(stored_key.data(), stored_key.size());
+  push(HeaderField(stored_key, store(value)));
+}
+
+void routine::http::Headers::insert(routine::http::Header key, std::string_view value) {
+  push(HeaderField(key, store(value)));
+}
+
+void routine::http::Headers::set(std::string_view key, std::string_view value) {
+  size_t index = index_of(key);
+  if (index == fields_.size()) return insert(key, value);
+  fields_[index].value_ = store(value);
+}
+
+void routine::http::Headers::set(routine::http::Header key, std::string_view value) {
+  size_t index = index_of(key);
+  if (index == fields_.size()) return insert(key, value);
+  fields_[index].value_ = store(value);
+}
+
+void routine::http::Headers::erase(std::string_view key) noexcept {
+  if (size_t index = index_of(key); index != fields_.size()) {
+    fields_.erase(index);
+    reindex();
+  }
+}
+
+void routine::http::Headers::erase(routine::http::Header key) noexcept {
+  if (size_t index = index_of(key); index != fields_.size()) {
+    fields_.erase(index);
+    reindex();
+  }
+}
+
+size_t routine::http::Headers::size() const noexcept {
+  return fields_.size();
+}
+
+bool routine::http::Headers::empty() const noexcept {
+  return fields_.empty();
 }
 
 void routine::http::Headers::clear() noexcept {
-  headers_.clear();
+  raw_.clear();
+  fields_.clear();
+  slots_.fill(0);
+  storage_.clear();
 }
 
 routine::http::Headers::container::iterator routine::http::Headers::begin() noexcept {
-  return headers_.begin();
+  return fields_.begin();
 }
 routine::http::Headers::container::iterator routine::http::Headers::end() noexcept {
-  return headers_.end();
+  return fields_.end();
 }
 
 routine::http::Headers::container::const_iterator routine::http::Headers::begin() const noexcept {
-  return headers_.begin();
+  return fields_.begin();
 }
 routine::http::Headers::container::const_iterator routine::http::Headers::end() const noexcept {
-  return headers_.end();
+  return fields_.end();
 }
 
 routine::http::Headers::container::const_iterator routine::http::Headers::cbegin() const noexcept {
-  return headers_.cbegin();
+  return fields_.begin();
 }
 routine::http::Headers::container::const_iterator routine::http::Headers::cend() const noexcept {
-  return headers_.cend();
+  return fields_.end();
+}
+
+std::optional<size_t> routine::http::parse_content_length(const Headers& headers) noexcept {
+  const HeaderField* field = nullptr;
+  for (const auto& header : headers) {
+    if (header.id() != Header::Content_Length) continue;
+    if (field) return std::nullopt;
+    field = &header;
+  }
+  if (!field) return std::nullopt;
+
+  // from_chars takes no sign or whitespace, the whole value has to be read
+  auto value = field->value();
+  size_t length = 0;
+  auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), length);
+  if (value.empty() || ec != std::errc{} || end != value.data() + value.size())
+    return std::nullopt;
+  return length;
 }
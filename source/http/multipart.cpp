@@ -0,0 +1,341 @@
+#include "http/multipart.hpp"
+#include "utils/perfect_hash.hpp"
+#include "utils/simd.hpp"
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <utility>
+
+namespace {
+
+  constexpr size_t npos = std::string_view::npos;
+
+  std::string_view trim(std::string_view string) noexcept {
+    size_t begin = string.find_first_not_of(" \t");
+    if (begin == npos) return {};
+    return string.substr(begin, string.find_last_not_of(" \t") - begin + 1);
+  }
+
+  // Next "key=value" of a header parameter list, quoted values are unescaped. false at the end
+  bool next_parameter(std::string_view& input, std::string_view& key, std::string& value) {
+    input = trim(input);
+    while (!input.empty() && input.front() == ';')
+      input = trim(input.substr(1));
+    if (input.empty()) return false;
+
+    size_t equals = input.find_first_of("=;");
+    key = trim(input.substr(0, equals));
+    value.clear();
+    if (equals == npos || input[equals] == ';') {
+      input.remove_prefix(equals == npos ? input.size() : equals);
+      return true;
+    }
+    input = trim(input.substr(equals + 1));
+
+    if (!input.starts_with('"')) {
+      size_t end = std::min(input.find(';'), input.size());
+      value = trim(input.substr(0, end));
+      input.remove_prefix(end);
+      return true;
+    }
+    size_t i = 1;
+    for (; i < input.size() && input[i] != '"'; ++i) {
+      if (input[i] == '\\' && i + 1 < input.size()) ++i;
+      value.push_back(input[i]);
+    }
+    input.remove_prefix(std::min(i + 1, input.size()));
+    return true;
+  }
+
+  // RFC 2046 5.1.1: bcharsnospace and space, 1 to 70 characters, not ending with a space
+  bool is_valid_boundary(std::string_view boundary) noexcept {
+    if (boundary.empty() || boundary.size() > 70 || boundary.back() == ' ') return false;
+    return std::ranges::all_of(boundary, [](char c) {
+      return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+             std::string_view("'()+_,-./:=? ").find(c) != npos;
+    });
+  }
+
+} // namespace
+
+routine::http::MultipartParser::MultipartParser(std::string_view boundary,
+                                                MultipartOptions options,
+                                                Part_callback callback)
+    : delimiter_(std::string("\r\n--").append(boundary)), options_(std::move(options)),
+      callback_(std::move(callback)) {
+  if (options_.directory.empty()) options_.directory = std::filesystem::temp_directory_path();
+  // the first delimiter may open the body without the CRLF
+  pending_ = "\r\n";
+}
+
+std::optional<std::string>
+routine::http::MultipartParser::boundary_of(std::string_view content_type) {
+  size_t semicolon = content_type.find(';');
+  if (!routine::utils::iequals(trim(content_type.substr(0, semicolon)), "multipart/form-data") ||
+      semicolon == npos)
+    return std::nullopt;
+
+  std::string_view parameters = content_type.substr(semicolon);
+  std::string_view key;
+  std::string value;
+  while (next_parameter(parameters, key, value))
+    if (routine::utils::iequals(key, "boundary"))
+      return is_valid_boundary(value) ? std::optional(std::move(value)) : std::nullopt;
+  return std::nullopt;
+}
+
+bool routine::http::MultipartParser::write(std::span<const uint8_t> bytes) {
+  if (state_ == State::Done || state_ == State::Failed) return state_ != State::Failed;
+  std::string_view input(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+
+  // file parts throw on I/O errors
+  try {
+    if (pending_.empty()) {
+      pending_.assign(input.substr(parse(input)));
+    } else {
+      pending_.append(input);
+      pending_.erase(0, parse(pending_));
+    }
+  } catch (const std::exception&) {
+    fail(Status::Internal_Server_Error);
+  }
+  return state_ != State::Failed;
+}
+
+bool routine::http::MultipartParser::finish() {
+  if (state_ != State::Done && state_ != State::Failed) fail(Status::Bad_Request);
+  return state_ == State::Done;
+}
+
+size_t routine::http::MultipartParser::parse(std::string_view data) {
+  // Index of the delimiter in 'input', or npos and the index from which the end of 'input'
+  // may be the beginning of a delimiter
+  auto find_delimiter = [this](std::string_view input) -> std::pair<size_t, size_t> {
+    for (size_t from = 0;;) {
+      size_t i = from + routine::utils::simd::find_char(input.data() + from,
+                                                       input.size() - from, '\r');
+      if (i == input.size()) return {npos, i};
+      size_t available = std::min(input.size() - i, delimiter_.size());
+      if (std::memcmp(input.data() + i, delimiter_.data(), available) == 0)
+        return {available == delimiter_.size() ? i : npos, i};
+      from = i + 1;
+    }
+  };
+
+  size_t position = 0;
+  while (position < data.size()) {
+    std::string_view rest = data.substr(position);
+    switch (state_) {
+    case State::Preamble: {
+      auto [index, partial] = find_delimiter(rest);
+      if (index == npos) return position + partial;
+      position += index + delimiter_.size();
+      state_ = State::Boundary;
+      break;
+    }
+    case State::Boundary: {
+      // transport padding, then CRLF before the headers or "--" of the last delimiter
+      size_t i = rest.find_first_not_of(" \t");
+      if (i == npos) return data.size();
+      if (rest.size() - i < 2) return position + i;
+      if (rest.compare(i, 2, "--") == 0) {
+        state_ = State::Done;
+        return data.size();
+      }
+      if (rest.compare(i, 2, "\r\n") != 0) {
+        fail(Status::Bad_Request);
+        return data.size();
+      }
+      position += i + 2;
+      state_ = State::Headers;
+      break;
+    }
+    case State::Headers: {
+      size_t end = rest.starts_with("\r\n")
+                       ? 0
+                       : routine::utils::simd::find_header_end(rest.data(), rest.size());
+      if (end > options_.max_header_size) {
+        fail(Status::Payload_Too_Large);
+        return data.size();
+      }
+      if (end == rest.size()) return position;
+      if (!begin_part(rest.substr(0, end))) return data.size();
+      position += end == 0 ? 2 : end + 4;
+      state_ = State::Data;
+      break;
+    }
+    case State::Data: {
+      auto [index, partial] = find_delimiter(rest);
+      append(rest.substr(0, index == npos ? partial : index));
+      if (state_ == State::Failed) return data.size();
+      if (index == npos) return position + partial;
+
+      callback_(std::move(*part_));
+      part_.reset();
+      position += index + delimiter_.size();
+      state_ = State::Boundary;
+      break;
+    }
+    case State::Done:
+    case State::Failed:
+      return data.size();
+    }
+  }
+  return position;
+}
+
+bool routine::http::MultipartParser::begin_part(std::string_view headers) {
+  if (++parts_ > options_.max_parts) {
+    fail(Status::Payload_Too_Large);
+    return false;
+  }
+
+  MultipartPart part{.content_type = "text/plain"};
+  bool has_name = false;
+  while (!headers.empty()) {
+    size_t end = std::min(headers.find("\r\n"), headers.size());
+    std::string_view line = headers.substr(0, end);
+    headers.remove_prefix(std::min(end + 2, headers.size()));
+
+    size_t colon = line.find(':');
+    if (colon == npos) {
+      fail(Status::Bad_Request);
+      return false;
+    }
+    std::string_view name = trim(line.substr(0, colon));
+    std::string_view value = trim(line.substr(colon + 1));
+
+    if (routine::utils::iequals(name, "content-type")) {
+      part.content_type = value;
+    } else if (routine::utils::iequals(name, "content-disposition")) {
+      size_t semicolon = std::min(value.find(';'), value.size());
+      if (!routine::utils::iequals(trim(value.substr(0, semicolon)), "form-data")) {
+        fail(Status::Bad_Request);
+        return false;
+      }
+      std::string_view parameters = value.substr(semicolon);
+      std::string_view key;
+      std::string parameter;
+      while (next_parameter(parameters, key, parameter)) {
+        if (routine::utils::iequals(key, "name")) {
+          part.name = parameter;
+          has_name = true;
+        } else if (routine::utils::iequals(key, "filename")) {
+          part.filename = parameter;
+          part.is_file = true;
+        }
+      }
+    }
+  }
+
+  // RFC 7578 4.2: every part has a Content-Disposition with a name
+  if (!has_name) {
+    fail(Status::Bad_Request);
+    return false;
+  }
+  if (part.is_file)
+    part.body = std::make_unique<FileBody>(options_.directory);
+  else
+    part.body = std::make_unique<MemoryBody>();
+  part_ = std::move(part);
+  return true;
+}
+
+void routine::http::MultipartParser::append(std::string_view bytes) {
+  if (bytes.empty()) return;
+  if (!part_->is_file && part_->body->size() + bytes.size() > options_.max_field_size) {
+    fail(Status::Payload_Too_Large);
+    return;
+  }
+  part_->body->write(
+      std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size()));
+}
+
+void routine::http::MultipartParser::fail(Status status) {
+  state_ = State::Failed;
+  status_ = status;
+  part_.reset();
+  pending_.clear();
+}
+
+//  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  // //  //  //  //  // //
+
+routine::http::MultipartBody::MultipartBody(std::string_view boundary, MultipartOptions options)
+    : MultipartBody(boundary, std::move(options), nullptr) {}
+
+routine::http::MultipartBody::MultipartBody(std::string_view boundary,
+                                            MultipartOptions options,
+                                            MultipartParser::Part_callback callback)
+    : boundary_(boundary), options_(std::move(options)), callback_(std::move(callback)),
+      parser_(make_parser()) {}
+
+routine::http::MultipartParser routine::http::MultipartBody::make_parser() {
+  return MultipartParser(boundary_, options_, [this](MultipartPart&& part) {
+    if (callback_)
+      callback_(std::move(part));
+    else
+      parts_.push_back(std::move(part));
+  });
+}
+
+void routine::http::MultipartBody::operator=(const std::string& str) {
+  parser_ = make_parser();
+  parts_.clear();
+  size_ = 0;
+  write(str);
+}
+
+void routine::http::MultipartBody::write(const std::vector<uint8_t>& buffer) {
+  write(std::span<const uint8_t>(buffer));
+}
+
+void routine::http::MultipartBody::write(asio::streambuf& buffer) {
+  write(std::span<const uint8_t>(static_cast<const uint8_t*>(buffer.data().data()),
+                                 buffer.data().size()));
+  buffer.consume(buffer.size());
+}
+
+void routine::http::MultipartBody::write(const std::string& buffer) {
+  write(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(buffer.data()),
+                                 buffer.size()));
+}
+
+void routine::http::MultipartBody::write(std::string&& buffer) {
+  write(static_cast<const std::string&>(buffer));
+}
+
+void routine::http::MultipartBody::write(std::span<const uint8_t> bytes) {
+  size_ += bytes.size();
+  parser_.write(bytes);
+}
+
+std::span<uint8_t> routine::http::MultipartBody::prepare(size_t size) {
+  if (!window_) {
+    window_ = std::make_unique_for_overwrite<uint8_t[]>(window_size);
+    window_charge_.resize(window_size);
+  }
+  return {window_.get(), std::min(size, window_size)};
+}
+
+void routine::http::MultipartBody::commit(size_t size) {
+  write(std::span<const uint8_t>(window_.get(), size));
+}
+
+routine::http::Status routine::http::MultipartBody::finish() {
+  parser_.finish();
+  return parser_.status();
+}
+
+routine::http::MultipartPart* routine::http::MultipartBody::find(std::string_view name) {
+  auto it = std::ranges::find(parts_, name, &MultipartPart::name);
+  return it == parts_.end() ? nullptr : &*it;
+}
+
+std::unique_ptr<routine::http::MultipartBody>
+routine::http::make_multipart_body(Request& request, MultipartOptions options) {
+  if (!request.headers().contains(Header::Content_Type)) return nullptr;
+  auto boundary =
+      MultipartParser::boundary_of(request.headers().at(Header::Content_Type).value());
+  if (!boundary) return nullptr;
+  return std::make_unique<MultipartBody>(*boundary, std::move(options));
+}
@@ -0,0 +1,143 @@
+#include "http/params.hpp"
+#include "utils/simd.hpp"
+#include <stdexcept>
+#include <string>
+
+namespace {
+  int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  }
+} // namespace
+
+routine::http::Parameters::Parameters(const Parameters& other) {
+  assign(other);
+}
+
+routine::http::Parameters& routine::http::Parameters::operator=(const Parameters& other) {
+  if (this != &other) assign(other);
+  return *this;
+}
+
+routine::http::Parameters& routine::http::Parameters::operator=(Parameters&& other) {
+  if (this == &other) return *this;
+
+  if (*resource() != *other.resource()) {
+    assign(other);
+    return *this;
+  }
+
+  query_ = other.query_;
+  parsed_ = other.parsed_;
+  entries_ = std::move(other.entries_);
+  storage_ = std::move(other.storage_);
+  return *this;
+}
+
+void routine::http::Parameters::assign(const Parameters& other) {
+  clear();
+  for (const auto& entry : other)
+    emplace(entry.key, entry.field.value());
+}
+
+void routine::http::Parameters::emplace(std::string_view key, std::string_view value) {
+  parse();
+  entries_.push_back({store(key), Field(store(value))});
+}
+
+void routine::http::Parameters::emplace_view(std::string_view key, std::string_view value) {
+  parse();
+  entries_.push_back({key, Field(value)});
+}
+
+const routine::http::Parameters::Field&
+routine::http::Parameters::at(std::string_view key) const {
+  const Field* field = find(key);
+  if (!field) throw std::out_of_range(std::string("Parameter not found: ").append(key));
+  return *field;
+}
+
+const routine::http::Parameters::Field*
+routine::http::Parameters::find(std::string_view key) const {
+  parse();
+  for (const auto& entry : entries_)
+    if (entry.key == key) return &entry.field;
+  return nullptr;
+}
+
+void routine::http::Parameters::erase(std::string_view key) {
+  parse();
+  for (size_t i = 0; i < entries_.size();) {
+    if (entries_[i].key == key)
+      entries_.erase(i);
+    else
+      ++i;
+  }
+}
+
+void routine::http::Parameters::clear() {
+  query_ = {};
+  parsed_ = true;
+  entries_.clear();
+  storage_.clear();
+}
+
+void routine::http::Parameters::parse_query() const {
+  namespace simd = routine::utils::simd;
+  parsed_ = true;
+
+  std::string_view query = query_;
+  while (!query.empty()) {
+    size_t end = simd::find_char(query.data(), query.size(), '&');
+    std::string_view parameter = query.substr(0, end);
+    query.remove_prefix(std::min(end + 1, query.size()));
+    if (parameter.empty()) continue;
+
+    size_t delimiter = simd::find_char(parameter.data(), parameter.size(), '=');
+    std::string_view key = parameter.substr(0, delimiter);
+    std::string_view value =
+        delimiter == parameter.size() ? std::string_view{} : parameter.substr(delimiter + 1);
+
+    entries_.push_back({decode(key), Field(decode(value))});
+  }
+}
+
+std::string_view routine::http::Parameters::decode(std::string_view string) const {
+  namespace simd = routine::utils::simd;
+
+  size_t special = simd::find_any_of(string.data(), string.size(), '%', '+');
+  if (special == string.size()) return string;
+
+  std::pmr::string& decoded = storage_.emplace_front();
+  decoded.reserve(string.size());
+
+  while (special < string.size()) {
+    decoded.append(string.substr(0, special));
+
+    if (string[special] == '+') {
+      decoded.push_back(' ');
+      string.remove_prefix(special + 1);
+    } else if (int high, low; special + 2 < string.size() &&
+                              (high = hex_value(string[special + 1])) >= 0 &&
+                              (low = hex_value(string[special + 2])) >= 0) {
+      decoded.push_back(static_cast<char>(high << 4 | low));
+      string.remove_prefix(special + 3);
+    } else {
+      // malformed escape is kept as is
+      decoded.push_back('%');
+      string.remove_prefix(special + 1);
+    }
+
+    special = simd::find_any_of(string.data(), string.size(), '%', '+');
+  }
+  decoded.append(string);
+
+  return decoded;
+}
+
+std::string_view routine::http::Parameters::store(std::string_view string) const {
+  if (string.empty()) return {};
+  return storage_.emplace_front(string);
+}
@@ -0,0 +1,116 @@
+#include "http/rate_limiter.hpp"
+#include "http/headers.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <format>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+  // tokens are stored in thousandths, 32 bits of them
+  constexpr uint32_t max_burst = std::numeric_limits<uint32_t>::max() / 1000;
+
+  // refill times of concurrent requests may be slightly out of order
+  constexpr uint32_t max_clock_skew_ms = 60 * 1000;
+} // namespace
+
+routine::http::RateLimit::RateLimit(double rate, uint32_t burst, std::string header)
+    : rate_(rate), burst_(burst), header_(std::move(header)) {
+  if (!(rate_ > 0) || burst_ == 0 || burst_ > max_burst)
+    throw std::invalid_argument(
+        std::format("RateLimit: rate must be positive and burst in [1, {}]", max_burst));
+
+  // a token is refilled in 1 / rate seconds
+  auto retry_after = std::max<long long>(1, std::llround(std::ceil(1.0 / rate_)));
+  rejected_ = Response::make_static(Status::Too_Many_Requests,
+                                    Headers{{"Retry-After", std::to_string(retry_after)}},
+                                    "Too many requests");
+}
+
+routine::http::RateLimiter::RateLimiter(size_t capacity) : epoch_(Clock::now()) {
+  size_t slots = std::bit_ceil(std::max(capacity / shard_count, probe_limit));
+  slot_mask_ = slots - 1;
+  for (auto& shard : shards_)
+    shard.slots = std::make_unique<Slot[]>(slots);
+}
+
+bool routine::http::RateLimiter::try_acquire(const RateLimit& limit, std::string_view address,
+                                             std::string_view key) noexcept {
+  // header values are hashed apart from addresses, a value equal to an IP has its own bucket
+  uint64_t seed = reinterpret_cast<uintptr_t>(&limit) * 0x9E3779B97F4A7C15ull;
+  uint64_t hash = std::hash<std::string_view>{}(address) ^ seed;
+  if (!acquire(limit, hash + (hash == 0))) return false;
+  if (key.empty()) return true;
+
+  hash = std::hash<std::string_view>{}(key) ^ std::rotl(seed, 32);
+  return acquire(limit, hash + (hash == 0));
+}
+
+bool routine::http::RateLimiter::acquire(const RateLimit& limit, uint64_t hash) noexcept {
+  Shard& shard = shards_[(hash >> 56) & (shard_count - 1)];
+  uint32_t now = now_ms();
+
+  // a lost takeover means another key took the bucket, the window is probed again
+  while (true) {
+    Slot* oldest = nullptr;
+    uint64_t oldest_owner = 0;
+    uint32_t oldest_age = 0;
+    for (size_t i = 0; i < probe_limit; ++i) {
+      Slot& slot = shard.slots[(hash + i) & slot_mask_];
+
+      uint64_t owner = slot.key.load(std::memory_order_acquire);
+      if (owner == 0 && slot.key.compare_exchange_strong(owner, hash, std::memory_order_acq_rel))
+        owner = hash;
+      if (owner == hash) return take(slot, limit, now);
+
+      // full buckets are the first to be taken over
+      uint64_t state = slot.state.load(std::memory_order_relaxed);
+      uint32_t age = state ? now - static_cast<uint32_t>(state >> 32)
+                           : std::numeric_limits<uint32_t>::max();
+      if (!oldest || age > oldest_age) {
+        oldest = &slot;
+        oldest_owner = owner;
+        oldest_age = age;
+      }
+    }
+
+    if (oldest->key.compare_exchange_strong(oldest_owner, hash, std::memory_order_acq_rel)) {
+      oldest->state.store(0, std::memory_order_relaxed);
+      return take(*oldest, limit, now);
+    }
+  }
+}
+
+uint32_t routine::http::RateLimiter::now_ms() const noexcept {
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - epoch_);
+  auto now = static_cast<uint32_t>(elapsed.count());
+  return now ? now : 1;
+}
+
+bool routine::http::RateLimiter::take(Slot& slot, const RateLimit& limit, uint32_t now) noexcept {
+  const double capacity = 1000.0 * limit.burst();
+  uint64_t state = slot.state.load(std::memory_order_relaxed);
+
+  while (true) {
+    uint32_t refilled = now;
+    uint64_t tokens = static_cast<uint64_t>(capacity);
+    if (state != 0) {
+      uint32_t last = static_cast<uint32_t>(state >> 32);
+      uint32_t elapsed = now - last;
+      if (elapsed > std::numeric_limits<uint32_t>::max() - max_clock_skew_ms) {
+        elapsed = 0; // 'now' was taken before the last refill
+        refilled = last;
+      }
+      // 'rate' tokens per second is 'rate' thousandths per millisecond
+      tokens = static_cast<uint64_t>(
+          std::min(capacity, static_cast<double>(state & 0xFFFFFFFF) + elapsed * limit.rate()));
+    }
+    if (tokens < 1000) return false;
+
+    uint64_t next = (static_cast<uint64_t>(refilled) << 32) | (tokens - 1000);
+    if (slot.state.compare_exchange_weak(state, next, std::memory_order_relaxed))
+      return true;
+  }
+}
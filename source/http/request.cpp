@@ -1,55 +1,53 @@
 #include "http/request.hpp"
+#include "http/serializer.hpp"
+#include "utils/arena.hpp"
+#include "utils/simd.hpp"
 #include "utils/utils.hpp"
 #include <algorithm>
 #include <spdlog/spdlog.h>
-#include <sstream>
-
-routine::http::Request::Request(const std::string& raw_http) {
-  std::istringstream stream(raw_http);
-  std::string line;
-  std::getline(stream, line);
-
-  // parse first line
-  {
-    auto parts = routine::utils::split_string_limit<std::string>(line, ' ', 3);
-    method_ = utils::method_from_string(std::move(parts[0]));
-
-    size_t path_query_delimiter_index = parse_query_parameters(parts[1]);
-    if (path_query_delimiter_index == 0) {
-      path_ = routine::utils::format_path(std::move(parts[1]));
-    } else {
-      path_ = parts[1].substr(0, path_query_delimiter_index);
-    }
 
-    version_ = utils::version_from_string(std::move(parts[2]));
-  }
+routine::http::Request::Request(std::string_view raw_http, std::pmr::memory_resource* resource)
+    : path_(resource), headers_(resource), query_params_(resource), path_params_(resource) {
+  namespace simd = routine::utils::simd;
+
+  std::string_view head = raw_http;
+  size_t line_end = simd::find_char(head.data(), head.size(), '\n');
+  std::string_view line = head.substr(0, line_end);
+  if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+
+  // parse first line: "METHOD /path?query HTTP/1.1"
+  size_t method_end = simd::find_char(line.data(), line.size(), ' ');
+  method_ = utils::method_from_string(line.substr(0, method_end));
+  line.remove_prefix(std::min(method_end + 1, line.size()));
+
+  size_t target_end = simd::find_char(line.data(), line.size(), ' ');
+  std::string_view target = line.substr(0, target_end);
+  version_ = utils::version_from_string(line.substr(std::min(target_end + 1, line.size())));
+
+  size_t query_begin = simd::find_char(target.data(), target.size(), '?');
+  routine::utils::format_path(target.substr(0, query_begin), path_);
+
+  std::string_view query =
+      query_begin == target.size() ? std::string_view{} : target.substr(query_begin + 1);
+  size_t query_offset = query.data() - head.data();
+
+  // parse headers, raw message head is owned by 'headers_'
+  headers_.init_from_raw(raw_http, line_end + 1);
 
-  // parse headers
-  headers_.init_from_stream(stream);
+  // query is parsed lazily on first access
+  if (!query.empty())
+    query_params_ = Parameters(std::string_view(headers_.raw_).substr(query_offset, query.size()),
+                               resource);
 }
 
-size_t routine::http::Request::parse_query_parameters(const std::string& string) {
-  auto query_params_index = string.find('?');
-  if (query_params_index == std::string::npos) return 0;
-
-  const auto lambda_split_parameter =
-      [](const std::string& str) -> std::pair<std::string, std::string> {
-    size_t ind = str.find('=');
-    if (ind == std::string::npos)
-      return {str, ""};
-    else
-      return {str.substr(0, ind), str.substr(ind + 1, str.size())};
-  };
-
-  path_ = string.substr(0, query_params_index);
-  auto params = routine::utils::split_string<std::string>(
-      string.substr(query_params_index + 1, string.size()), '&');
-  std::for_each(params.begin(), params.end(),
-                [lambda_split_parameter, this](const std::string& str) {
-                  auto [key, value] = lambda_split_parameter(str);
-                  query_params_.emplace(std::move(key), std::move(value));
-                });
-  return query_params_index;
+routine::http::Request_ptr routine::http::make_request(std::string_view raw_http) {
+  using routine::utils::ArenaAllocator;
+  using routine::utils::RequestArena;
+
+  // the control block keeps a copy of the allocator, so it is the last owner of the arena
+  RequestArena* arena = RequestArena::acquire();
+  return std::allocate_shared<Request>(ArenaAllocator<Request>(arena), raw_http,
+                                       arena->resource());
 }
 
 const routine::http::Headers& routine::http::Request::headers() {
@@ -58,7 +56,7 @@ const routine::http::Headers& routine::http::Request::headers() {
 routine::http::Method routine::http::Request::method() {
   return method_;
 }
-const std::string& routine::http::Request::path() {
+std::string_view routine::http::Request::path() {
   return path_;
 }
 routine::http::Version routine::http::Request::version() {
@@ -66,45 +64,50 @@ routine::http::Version routine::http::Request::version() {
 }
 
 std::string routine::http::Request::prepare_request() const {
-  std::ostringstream stream;
-  stream << utils::to_string(method_) << " /";
+  std::string buffer;
+  serialize(buffer);
+  return buffer;
+}
+
+void routine::http::Request::serialize(std::string& buffer) const {
+  size_t body_size = body_ ? body_->size() : 0;
+
+  Serializer writer(buffer);
+  writer.reserve(path_.size() + query_params_.size() * 16 + Serializer::estimate(headers_) +
+                 64 + body_size);
+  writer.append(utils::to_string(method_)).append(" /");
 
   if (path_params_.size() > 0) {
-    auto path_parts = routine::utils::split_string<std::string>(path_, '/');
-    for (auto& part : path_parts) {
+    bool first = true;
+    routine::utils::for_each_part(path_, '/', [this, &writer, &first](std::string_view part) {
+      if (!first) writer.append('/');
+      first = false;
+
       if (part[0] == '{')
-        stream << path_params_[part.substr(1, part.size() - 2)].value();
+        writer.append(path_params_[part.substr(1, part.size() - 2)].value());
       else
-        stream << part;
-
-      if (part != *std::prev(path_parts.end())) stream << '/';
-    }
+        writer.append(part);
+    });
   } else {
-    if (path_.back() == '/')
-      stream << path_.substr(0, path_.size() - 1);
-    else
-      stream << routine::utils::format_path(path_);
+    writer.append(path_);
   }
 
   if (query_params_.size() > 0) {
-    stream << '?';
-    size_t i = 0;
-    for (auto& param : query_params_) {
-      stream << param.first << '=' << param.second.value();
-      if (++i < query_params_.size()) stream << '&';
+    char delimiter = '?';
+    for (const auto& param : query_params_) {
+      writer.append(delimiter).append(param.key).append('=').append(param.field.value());
+      delimiter = '&';
     }
   }
 
-  stream << " HTTP/1.1\r\n";
-
-  for (auto& header : headers_)
-    stream << header.as_string() << "\r\n";
+  writer.append(" HTTP/1.1\r\n");
 
-  if (!headers_.contains(http::Header::User_Agent)) stream << "User-Agent: Asio/RoutineHttp\r\n";
-  if (body_) stream << "Content-Length: " << body_->size() << "\r\n";
+  for (const auto& header : headers_)
+    if (!body_ || header.id() != Header::Content_Length) writer.header(header);
 
-  stream << "\r\n";
-  if (body_) stream << body_->as_string();
+  if (!headers_.contains(http::Header::User_Agent)) writer.append(Serializer::default_user_agent);
+  if (body_) writer.header(Header::Content_Length, body_size);
 
-  return stream.str();
+  writer.append(Serializer::crlf);
+  if (body_) body_->append_to(buffer);
 }
@@ -1,27 +1,25 @@
 #include "http/response.hpp"
 #include "http/body_storage.hpp"
+#include "http/serializer.hpp"
 #include "utils/utils.hpp"
+#include <cstring>
 #include <memory>
 #include <spdlog/spdlog.h>
-#include <sstream>
 
 routine::http::Response::Response(Status status, Headers headers)
-    : status_(status), headers_(headers), body_(nullptr) {}
+    : status_(status), headers_(std::move(headers)), body_(nullptr) {}
 
 routine::http::Response::Response(Status status, Headers headers,
                                   std::shared_ptr<I_BodyStorage> body)
-    : status_(status), headers_(headers), body_(body) {}
+    : status_(status), headers_(std::move(headers)), body_(body) {}
 
 routine::http::Response::Response(Status status, Headers headers, std::string body)
-    : status_(status), headers_(headers), body_(std::make_shared<MemoryBody>()) {
-  std::vector<uint8_t> buffer;
-  buffer.resize(body.size());
-  ::memcpy(buffer.data(), body.data(), buffer.size());
-  body_->write(buffer);
+    : status_(status), headers_(std::move(headers)), body_(std::make_shared<MemoryBody>()) {
+  body_->write(std::move(body));
 }
 
 routine::http::Response::Response(Status status, Headers headers, const std::vector<uint8_t>& body)
-    : status_(status), headers_(headers), body_(std::make_shared<MemoryBody>()) {
+    : status_(status), headers_(std::move(headers)), body_(std::make_shared<MemoryBody>()) {
   body_->write(body);
 }
 
@@ -37,28 +35,94 @@ routine::http::Headers& routine::http::Response::headers() {
   return headers_;
 }
 
-std::string routine::http::Response::prepare_response() {
-  {
-    if (!headers_.contains("server")) headers_.insert("server", "RoutineHttpLibrary");
-
-    headers_.insert("date", routine::http::utils::get_current_http_date());
+std::string routine::http::Response::prepare_response() const {
+  std::string buffer;
+  serialize(buffer);
+  return buffer;
+}
 
-    if (body_) {
-      // TODO # content-type = body_.get_type();
-      if (!headers_.contains("content-type")) headers_.insert("content-type", "text/plain");
-    }
-    headers_["content-length"] = body_ ? std::to_string(body_->size()) : "0";
+void routine::http::Response::serialize(std::string& buffer) const {
+  if (is_static()) {
+    serialize_head(buffer);
+    buffer.append(encoded_body());
+    return;
   }
 
-  {
-    std::ostringstream stream;
-    stream << "HTTP/1.1 " << utils::to_string(status_) << "\r\n";
-    for (auto& header : headers_)
-      stream << header.as_string() << "\r\n";
+  serialize_head(buffer, body_ ? body_->size() : external_body_.size(), false);
+  if (body_) body_->append_to(buffer);
+}
 
-    stream << "\r\n";
-    if (body_) stream << body_->as_string();
+void routine::http::Response::serialize_stream_head(std::string& buffer,
+                                                    const I_BodyChunks& chunks) const {
+  auto size = chunks.size();
+  serialize_head(buffer, size.value_or(0), !size, false);
+}
 
-    return stream.str();
-  }
+void routine::http::Response::serialize_head(std::string& buffer, size_t body_size,
+                                             bool is_chunked, bool is_body_appended) const {
+  Serializer writer(buffer);
+  writer.reserve(Serializer::estimate(headers_) + 160 + (is_body_appended ? body_size : 0));
+  writer.append(utils::status_line(status_));
+
+  // date and content-length are always written by the serializer
+  for (const auto& header : headers_)
+    if (header.id() != Header::Date && header.id() != Header::Content_Length &&
+        (!is_chunked || header.id() != Header::Transfer_Encoding))
+      writer.header(header);
+
+  if (!headers_.contains(Header::Server)) writer.append(Serializer::default_server);
+  writer.header(Header::Date, utils::cached_http_date());
+
+  // TODO # content-type = body_.get_type();
+  if (body_ && !headers_.contains(Header::Content_Type))
+    writer.header(Header::Content_Type, "text/plain");
+  if (is_chunked)
+    writer.header(Header::Transfer_Encoding, "chunked");
+  // RFC 7230 3.3.2: no Content-Length in 204 and 304
+  else if (status_ != Status::No_Content && status_ != Status::Not_Modified)
+    writer.header(Header::Content_Length, body_size);
+
+  writer.append(Serializer::crlf);
+}
+
+routine::http::Response_ptr routine::http::Response::make_static(Status status, Headers headers,
+                                                                 std::string body) {
+  auto response = body.empty() ? std::make_shared<Response>(status, std::move(headers))
+                               : std::make_shared<Response>(status, std::move(headers), body);
+
+  std::string encoded;
+  response->serialize(encoded);
+  size_t head_size = encoded.size() - body.size();
+  response->set_encoded(std::move(encoded), head_size);
+  return response;
+}
+
+routine::http::Response_ptr
+routine::http::Response::make_static(Status status, Headers headers, std::string_view body,
+                                     std::shared_ptr<const void> owner) {
+  auto response = std::make_shared<Response>(status, std::move(headers));
+  response->external_body_ = body;
+  response->external_owner_ = std::move(owner);
+
+  // the body is not a part of the encoded bytes
+  std::string encoded;
+  response->serialize(encoded);
+  size_t head_size = encoded.size();
+  response->set_encoded(std::move(encoded), head_size);
+  return response;
+}
+
+void routine::http::Response::set_encoded(std::string encoded, size_t head_size) {
+  constexpr std::string_view date_prefix{"\r\ndate: "};
+  date_offset_ =
+      std::string_view(encoded).substr(0, head_size).find(date_prefix) + date_prefix.size();
+  encoded_head_size_ = head_size;
+  encoded_ = std::move(encoded);
+}
+
+void routine::http::Response::serialize_head(std::string& buffer) const {
+  size_t offset = buffer.size();
+  buffer.append(std::string_view(encoded_).substr(0, encoded_head_size_));
+  std::memcpy(buffer.data() + offset + date_offset_, utils::cached_http_date().data(),
+              utils::http_date_size);
 }
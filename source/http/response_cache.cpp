@@ -0,0 +1,260 @@
+#include "http/response_cache.hpp"
+#include "http/body_storage.hpp"
+#include "http/serializer.hpp"
+#include "utils/perfect_hash.hpp"
+#include "utils/utils.hpp"
+#include <cstring>
+#include <utility>
+
+namespace {
+
+  // Fast non-cryptographic hash of the body for ETag, 8 bytes per step
+  uint64_t body_hash(std::string_view data) noexcept {
+    constexpr uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+    uint64_t hash = 0xCBF29CE484222325ull ^ (data.size() * multiplier);
+
+    auto mix = [&hash](uint64_t word) {
+      hash = (hash ^ word) * multiplier;
+      hash ^= hash >> 29;
+    };
+
+    size_t i = 0;
+    for (; i + 8 <= data.size(); i += 8) {
+      uint64_t word;
+      std::memcpy(&word, data.data() + i, 8);
+      mix(word);
+    }
+    if (i < data.size()) {
+      uint64_t word = 0;
+      std::memcpy(&word, data.data() + i, data.size() - i);
+      mix(word);
+    }
+
+    hash ^= hash >> 32;
+    return hash * multiplier;
+  }
+
+  std::string make_etag(std::string_view body) {
+    static constexpr char digits[] = "0123456789abcdef";
+    uint64_t hash = body_hash(body);
+
+    std::string etag(18, '"');
+    for (size_t i = 16; i > 0; --i, hash >>= 4)
+      etag[i] = digits[hash & 0xF];
+    return etag;
+  }
+
+  // Opaque part of entity tag, W/ prefix and spaces removed
+  std::string_view opaque_tag(std::string_view tag) noexcept {
+    while (!tag.empty() && tag.front() == ' ')
+      tag.remove_prefix(1);
+    while (!tag.empty() && tag.back() == ' ')
+      tag.remove_suffix(1);
+    if (tag.starts_with("W/")) tag.remove_prefix(2);
+    return tag;
+  }
+
+  // Cache-Control of the headers has 'directive', with or without an argument
+  bool has_directive(const routine::http::Headers& headers, std::string_view directive) {
+    bool is_found = false;
+    for (const auto& header : headers) {
+      if (header.id() != routine::http::Header::Cache_Control) continue;
+      routine::utils::for_each_part(header.value(), ',', [&](std::string_view part) {
+        part = opaque_tag(part.substr(0, part.find('=')));
+        if (routine::utils::iequals(part, directive)) is_found = true;
+      });
+    }
+    return is_found;
+  }
+
+} // namespace
+
+std::string routine::http::ResponseCache::make_key(Request& request, const CachePolicy& policy) {
+  std::string key;
+  key.reserve(request.path().size() + 16 * (policy.query.size() + policy.vary.size()));
+  key.append(request.path());
+
+  // '\0' separates present values, '\1' marks absent ones
+  for (const auto& name : policy.query)
+    if (auto field = request.query_params().find(name))
+      key.append(1, '\0').append(field->value());
+    else
+      key.push_back('\1');
+
+  for (const auto& name : policy.vary)
+    if (auto field = request.headers().find(name))
+      key.append(1, '\0').append(field->value());
+    else
+      key.push_back('\1');
+
+  return key;
+}
+
+routine::http::Response_ptr routine::http::ResponseCache::find(std::string_view key,
+                                                               Request& request) {
+  Shard& shard = this->shard(key);
+  std::lock_guard lock(shard.mutex);
+
+  auto it = shard.index.find(key);
+  if (it == shard.index.end()) return nullptr;
+
+  auto entry = it->second;
+  if (Clock::now() >= entry->expires) {
+    shard.erase(entry);
+    return nullptr;
+  }
+
+  shard.entries.splice(shard.entries.begin(), shard.entries, entry);
+  return select(*entry->cached, request);
+}
+
+routine::http::ResponseCache::Cached_ptr
+routine::http::ResponseCache::insert(std::string key, const Response_ptr& response,
+                                     const CachePolicy& policy, Request& request) {
+  if (!response || response->status() != Status::Ok || !is_shareable(*response, request))
+    return nullptr;
+
+  std::string body;
+  if (response->is_static())
+    body = response->encoded_body();
+  else if (response->body())
+    body = response->body()->as_string();
+
+  Headers headers = response->headers();
+  if (!headers.contains(Header::ETag)) headers.insert(Header::ETag, make_etag(body));
+  if (!policy.vary.empty() && !headers.contains(Header::Vary)) {
+    std::string vary;
+    for (const auto& name : policy.vary)
+      vary.append(vary.empty() ? "" : ", ").append(name);
+    headers.insert(Header::Vary, vary);
+  }
+
+  size_t head_size = Serializer::estimate(headers);
+  auto cached = std::make_shared<Cached>();
+  cached->representations =
+      make_representations(std::move(headers), std::move(body), compression_,
+                           {Header::Cache_Control, Header::Vary});
+
+  Entry entry;
+  entry.bytes = sizeof(Entry) + sizeof(Cached) + 2 * key.size();
+  for (const auto& representation : cached->representations)
+    if (representation.response)
+      entry.bytes += representation.response->encoded_body().size() + 2 * head_size + 256;
+  entry.cached = cached;
+  entry.expires = Clock::now() + policy.ttl;
+  entry.key = std::move(key);
+
+  size_t capacity = shard_capacity_.load(std::memory_order_relaxed);
+  if (policy.ttl.count() <= 0 || entry.bytes > capacity) return cached;
+
+  Shard& shard = this->shard(entry.key);
+  std::lock_guard lock(shard.mutex);
+
+  if (auto it = shard.index.find(entry.key); it != shard.index.end()) shard.erase(it->second);
+
+  shard.bytes += entry.bytes;
+  shard.entries.push_front(std::move(entry));
+  shard.index.emplace(shard.entries.front().key, shard.entries.begin());
+
+  // least recently used entries go first
+  while (shard.bytes > capacity)
+    shard.erase(std::prev(shard.entries.end()));
+
+  return cached;
+}
+
+const routine::http::Response_ptr& routine::http::ResponseCache::select(const Cached& cached,
+                                                                        Request& request) {
+  const auto& representation = select_representation(cached.representations, request);
+  return is_not_modified(request, representation.etag) ? representation.not_modified
+                                                       : representation.response;
+}
+
+bool routine::http::ResponseCache::join(const std::string& key, Request_ptr request,
+                                        Waiter_callback callback) {
+  Shard& shard = this->shard(key);
+  std::lock_guard lock(shard.mutex);
+
+  auto [it, is_first] = shard.flights.try_emplace(key);
+  if (is_first) return false;
+
+  it->second.push_back({std::move(request), std::move(callback)});
+  return true;
+}
+
+void routine::http::ResponseCache::complete(const std::string& key, const Cached_ptr& cached,
+                                            const Response_ptr& response, Request& request) {
+  std::vector<Waiter> waiters;
+  {
+    Shard& shard = this->shard(key);
+    std::lock_guard lock(shard.mutex);
+    auto it = shard.flights.find(key);
+    if (it == shard.flights.end()) return;
+    waiters = std::move(it->second);
+    shard.flights.erase(it);
+  }
+  if (waiters.empty()) return;
+
+  // not cacheable response is serialized once for all waiters, a private one is not shared
+  Response_ptr shared = response;
+  if (!cached && response && !is_shareable(*response, request)) {
+    shared = nullptr;
+  } else if (!cached && response && !response->is_static()) {
+    auto body = response->body() ? response->body()->as_string() : std::string{};
+    shared = Response::make_static(response->status(), response->headers(), std::move(body));
+  }
+
+  for (auto& waiter : waiters)
+    waiter.callback(cached ? select(*cached, *waiter.request) : shared);
+}
+
+size_t routine::http::ResponseCache::size() const {
+  size_t bytes = 0;
+  for (const auto& shard : shards_) {
+    std::lock_guard lock(shard.mutex);
+    bytes += shard.bytes;
+  }
+  return bytes;
+}
+
+void routine::http::ResponseCache::clear() {
+  for (auto& shard : shards_) {
+    std::lock_guard lock(shard.mutex);
+    shard.index.clear();
+    shard.entries.clear();
+    shard.bytes = 0;
+  }
+}
+
+void routine::http::ResponseCache::Shard::erase(std::list<Entry>::iterator it) {
+  bytes -= it->bytes;
+  index.erase(it->key);
+  entries.erase(it);
+}
+
+routine::http::ResponseCache::Shard&
+routine::http::ResponseCache::shard(std::string_view key) noexcept {
+  return shards_[routine::utils::fnv1a(key) & (shard_count - 1)];
+}
+
+bool routine::http::ResponseCache::is_shareable(Response& response, Request& request) {
+  const auto& headers = response.headers();
+  if (headers.contains(Header::Set_Cookie)) return false;
+  if (has_directive(headers, "no-store") || has_directive(headers, "private")) return false;
+  return !request.headers().contains(Header::Authorization) || has_directive(headers, "public");
+}
+
+bool routine::http::ResponseCache::is_not_modified(Request& request, std::string_view etag) {
+  auto field = request.headers().find(Header::If_None_Match);
+  if (!field) return false;
+
+  std::string_view value = opaque_tag(field->value());
+  if (value == "*") return true;
+
+  bool is_matched = false;
+  etag = opaque_tag(etag);
+  routine::utils::for_each_part(value, ',', [&](std::string_view tag) {
+    if (opaque_tag(tag) == etag) is_matched = true;
+  });
+  return is_matched;
+}
@@ -0,0 +1,320 @@
+#include "http/route_handler.hpp"
+#include "utils/simd.hpp"
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+#include <string>
+
+void routine::http::RouteHandler::add_handler(std::string_view path, Handler_creator creator) {
+  add_handler(path, Method::None, std::move(creator));
+}
+
+void routine::http::RouteHandler::add_handler(std::string_view path, Method method,
+                                              Handler_creator creator, RoutePolicy policy) {
+  // routing threads read the compiled tree without locks
+  if (is_compiled_)
+    throw std::logic_error(std::format("Route '{}' added after the router was compiled", path));
+
+  std::string_view formatted = paths_.emplace_front(routine::utils::format_path(path));
+
+  uint32_t node = 0;
+  size_t parameters = 0;
+  bool is_tail = false;
+  std::string current_path;
+
+  routine::utils::for_each_part(formatted, '/', [&](std::string_view segment) {
+    if (is_tail)
+      throw std::invalid_argument(
+          std::format("The path '{}' has segments after the rest parameter", path));
+    current_path.append("/").append(segment);
+
+    if (segment.starts_with("{*")) {
+      if (++parameters > max_path_params)
+        throw std::invalid_argument(std::format("The path '{}' has more than {} parameters",
+                                                path, max_path_params));
+
+      std::string_view name = segment.substr(2, segment.size() - 3);
+      if (builder_[node].tail == npos) {
+        builder_[node].tail = builder_.size();
+        builder_.emplace_back().parameter_name = name;
+      } else if (builder_[builder_[node].tail].parameter_name != name) {
+        throw std::invalid_argument(
+            std::format("The path '{}' already has a another parameter '{{*{}}}' on it.",
+                        current_path, builder_[builder_[node].tail].parameter_name));
+      }
+      node = builder_[node].tail;
+      is_tail = true;
+      return;
+    }
+
+    if (segment.front() == '{') {
+      if (++parameters > max_path_params)
+        throw std::invalid_argument(std::format("The path '{}' has more than {} parameters",
+                                                path, max_path_params));
+
+      std::string_view name = segment.substr(1, segment.size() - 2);
+      if (builder_[node].parameter == npos) {
+        builder_[node].parameter = builder_.size();
+        builder_[node].parameter_name = name;
+        builder_.emplace_back();
+      } else if (builder_[node].parameter_name != name) {
+        // if current level already have parameter AND it is not equal to the current one
+        throw std::invalid_argument(
+            std::format("The path '{}' already has a another parameter '{{{}}}' on it.",
+                        current_path, builder_[node].parameter_name));
+      }
+      node = builder_[node].parameter;
+      return;
+    }
+
+    auto& children = builder_[node].children;
+    auto it = std::find_if(children.begin(), children.end(),
+                           [segment](const auto& child) { return child.first == segment; });
+    if (it != children.end()) {
+      node = it->second;
+    } else {
+      uint32_t child = builder_.size();
+      children.emplace_back(segment, child);
+      builder_.emplace_back();
+      node = child;
+    }
+  });
+
+  if (builder_[node].leaf == npos) {
+    builder_[node].leaf = leaves_.size();
+    leaves_.emplace_back().handlers.fill(npos);
+  }
+
+  uint32_t& handler = leaves_[builder_[node].leaf].handlers[static_cast<size_t>(method)];
+  if (handler != npos) {
+    warn("Handler for '{} {}' was replaced", utils::to_string(method), path);
+    handlers_[handler] = std::move(creator);
+    policies_[handler] = policy;
+  } else {
+    handler = handlers_.size();
+    handlers_.push_back(std::move(creator));
+    policies_.push_back(policy);
+  }
+
+  info("Successfully added a {} handler for '{} {}'", parameters ? "dynamic" : "static",
+       method == Method::None ? "*" : utils::to_string(method), path);
+}
+
+void routine::http::RouteHandler::add_static(std::string_view prefix,
+                                             std::shared_ptr<StaticFiles> files) {
+  std::string path = "/" + routine::utils::format_path(prefix);
+  Handler_creator creator = [files = std::move(files)] { return files; };
+
+  // the prefix itself is the index of the root directory
+  add_handler(path, Method::Get, creator);
+  add_handler(std::format("{}/{{*{}}}", path, StaticFiles::parameter), Method::Get,
+              std::move(creator));
+}
+
+uint32_t routine::http::RouteHandler::find_built(std::string_view path) const {
+  uint32_t node = 0;
+  routine::utils::for_each_part(path, '/', [this, &node](std::string_view segment) {
+    if (node == npos) return;
+    if (segment.starts_with("{*")) {
+      node = builder_[node].tail;
+    } else if (segment.front() == '{') {
+      node = builder_[node].parameter;
+    } else {
+      auto& children = builder_[node].children;
+      auto it = std::find_if(children.begin(), children.end(),
+                             [segment](const auto& child) { return child.first == segment; });
+      node = it != children.end() ? it->second : npos;
+    }
+  });
+  return node;
+}
+
+void routine::http::RouteHandler::compile() {
+  // the table is looked up first, a runtime route on its path would be shadowed or get 405
+  for (std::string_view path : table_paths_) {
+    uint32_t node = find_built(path);
+    if (node != npos && builder_[node].leaf != npos)
+      throw std::logic_error(
+          std::format("Route '/{}' is both in the route table and added at runtime", path));
+  }
+
+  nodes_.clear();
+  labels_.clear();
+  nodes_.reserve(builder_.size());
+
+  // breadth-first, so children of each node are emitted next to each other
+  std::vector<std::pair<uint32_t, uint32_t>> queue{{0, 0}}; // compiled node, build node
+  nodes_.emplace_back();
+
+  for (size_t i = 0; i < queue.size(); ++i) {
+    auto [index, source] = queue[i];
+    const BuildNode& build = builder_[source];
+    nodes_[index].leaf = build.leaf;
+
+    auto children = build.children;
+    std::sort(children.begin(), children.end(), [](const auto& left, const auto& right) {
+      return segment_less(left.first, right.first);
+    });
+
+    nodes_[index].children_begin = nodes_.size();
+    for (auto [segment, child] : children) {
+      // merge chain of static segments without handlers and parameters into one label
+      std::string merged;
+      while (builder_[child].children.size() == 1 && builder_[child].parameter == npos &&
+             builder_[child].tail == npos && builder_[child].leaf == npos) {
+        if (merged.empty()) merged = segment;
+        merged.append("/").append(builder_[child].children.front().first);
+        child = builder_[child].children.front().second;
+      }
+
+      Node node;
+      node.label = merged.empty() ? segment : std::string_view(labels_.emplace_front(merged));
+      node.first = segment;
+      queue.emplace_back(nodes_.size(), child);
+      nodes_.push_back(node);
+    }
+    nodes_[index].children_end = nodes_.size();
+
+    if (build.parameter != npos) {
+      Node node;
+      node.label = node.first = build.parameter_name;
+      nodes_[index].parameter = nodes_.size();
+      queue.emplace_back(nodes_.size(), build.parameter);
+      nodes_.push_back(node);
+    }
+
+    if (build.tail != npos) {
+      Node node;
+      node.label = node.first = builder_[build.tail].parameter_name;
+      nodes_[index].tail = nodes_.size();
+      queue.emplace_back(nodes_.size(), build.tail);
+      nodes_.push_back(node);
+    }
+  }
+
+  // 405 and OPTIONS answers are shared by paths with the same methods
+  method_responses_.clear();
+  for (auto& leaf : leaves_) {
+    leaf.allowed = allowed_methods(leaf.handlers);
+    method_responses_.try_emplace(leaf.allowed, make_method_responses(leaf.allowed));
+  }
+  for (uint16_t allowed : table_allowed_)
+    if (allowed != 0) method_responses_.try_emplace(allowed, make_method_responses(allowed));
+
+  is_compiled_ = true;
+  debug("Compiled {} routes into {} nodes", handlers_.size(), nodes_.size());
+}
+
+bool routine::http::RouteHandler::match(uint32_t index, std::string_view path,
+                                        Captures& captures, uint32_t& leaf) const {
+  const Node& node = nodes_[index];
+  if (path.empty()) {
+    leaf = node.leaf;
+    return leaf != npos;
+  }
+
+  size_t segment_end = routine::utils::simd::find_char(path.data(), path.size(), '/');
+  std::string_view segment = path.substr(0, segment_end);
+
+  auto begin = nodes_.begin() + node.children_begin;
+  auto end = nodes_.begin() + node.children_end;
+  auto child = std::lower_bound(begin, end, segment, [](const Node& node, std::string_view key) {
+    return segment_less(node.first, key);
+  });
+
+  if (child != end && child->first == segment) {
+    std::string_view label = child->label;
+    if (path.starts_with(label) && (path.size() == label.size() || path[label.size()] == '/') &&
+        match(child - nodes_.begin(), path.substr(std::min(label.size() + 1, path.size())),
+              captures, leaf))
+      return true;
+  }
+
+  // static branch did not match, try parameter of this level
+  if (node.parameter != npos && captures.size < max_path_params) {
+    captures.params[captures.size++] = {nodes_[node.parameter].label, segment};
+    if (match(node.parameter, path.substr(std::min(segment_end + 1, path.size())), captures,
+              leaf))
+      return true;
+    --captures.size;
+  }
+
+  // the rest of the path, at least one segment
+  if (node.tail != npos && captures.size < max_path_params &&
+      nodes_[node.tail].leaf != npos) {
+    captures.params[captures.size++] = {nodes_[node.tail].label, path};
+    leaf = nodes_[node.tail].leaf;
+    return true;
+  }
+
+  return false;
+}
+
+routine::http::RouteHandler::Route routine::http::RouteHandler::route(Request& request) {
+  Method method = request.method();
+  bool is_preflight = cors_ && method == Method::Options &&
+                      request.headers().contains(Header::Origin) &&
+                      request.headers().contains(Header::Access_Control_Request_Method);
+
+  if (!is_compiled_) throw std::logic_error("Routing with a router which is not compiled");
+
+  if (table_) {
+    auto match = table_(request, is_preflight);
+    if (match.handler) return {std::move(match.handler), nullptr, match.policy};
+    if (match.allowed != 0) return {nullptr, method_response(request, match.allowed, is_preflight)};
+  }
+
+  Captures captures;
+  uint32_t leaf = npos;
+  if (!match(0, request.path(), captures, leaf)) return {nullptr, not_found_};
+
+  uint32_t handler = select_handler(leaves_[leaf].handlers, method, is_preflight);
+  if (handler == npos)
+    return {nullptr, method_response(request, leaves_[leaf].allowed, is_preflight)};
+
+  // names are owned by the router, values are views into the request path
+  auto& path_params = request.path_params();
+  for (size_t i = 0; i < captures.size; ++i)
+    path_params.emplace_view(captures.params[i].first, captures.params[i].second);
+
+  return {handlers_[handler](), nullptr, policies_[handler]};
+}
+
+routine::http::RouteHandler::MethodResponses
+routine::http::RouteHandler::make_method_responses(uint16_t allowed) {
+  MethodResponses responses;
+  for (size_t i = 1; i < method_count; ++i)
+    if (allowed & method_bit(static_cast<Method>(i))) {
+      if (!responses.allow.empty()) responses.allow.append(", ");
+      responses.allow.append(utils::to_string(static_cast<Method>(i)));
+    }
+
+  responses.options = Response::make_static(Status::No_Content, {{"Allow", responses.allow}});
+  responses.not_allowed =
+      Response::make_static(Status::Method_Not_Allowed, {{"Allow", responses.allow}});
+  return responses;
+}
+
+routine::http::Response_ptr routine::http::RouteHandler::method_response(Request& request,
+                                                                         uint16_t allowed,
+                                                                         bool is_preflight) const {
+  // every set of allowed methods is collected by compile()
+  auto it = method_responses_.find(allowed);
+  if (it == method_responses_.end()) return not_found_;
+  const MethodResponses& responses = it->second;
+
+  if (!is_preflight)
+    return request.method() == Method::Options ? responses.options : responses.not_allowed;
+
+  Headers headers{{"Allow", responses.allow}};
+  headers.insert(Header::Access_Control_Allow_Origin, cors_->allow_origin);
+  headers.insert(Header::Access_Control_Allow_Methods, responses.allow);
+  if (!cors_->allow_headers.empty())
+    headers.insert(Header::Access_Control_Allow_Headers, cors_->allow_headers);
+  else if (auto requested = request.headers().find(Header::Access_Control_Request_Headers))
+    headers.insert(Header::Access_Control_Allow_Headers, requested->value());
+  headers.insert(Header::Access_Control_Max_Age, std::to_string(cors_->max_age.count()));
+  if (cors_->allow_origin != "*") headers.insert(Header::Vary, "Origin");
+
+  return std::make_shared<Response>(Status::No_Content, std::move(headers));
+}
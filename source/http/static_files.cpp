@@ -0,0 +1,460 @@
+#include "http/static_files.hpp"
+#include "http/response_cache.hpp"
+#include "utils/utils.hpp"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <poll.h>
+#include <spdlog/spdlog.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
+
+namespace {
+
+  std::string_view content_type(std::string_view extension) {
+    static constexpr std::array<std::pair<std::string_view, std::string_view>, 29> types{{
+        {".html", "text/html; charset=utf-8"},
+        {".htm", "text/html; charset=utf-8"},
+        {".css", "text/css; charset=utf-8"},
+        {".js", "text/javascript; charset=utf-8"},
+        {".mjs", "text/javascript; charset=utf-8"},
+        {".json", "application/json"},
+        {".map", "application/json"},
+        {".txt", "text/plain; charset=utf-8"},
+        {".xml", "application/xml"},
+        {".svg", "image/svg+xml"},
+        {".png", "image/png"},
+        {".jpg", "image/jpeg"},
+        {".jpeg", "image/jpeg"},
+        {".gif", "image/gif"},
+        {".webp", "image/webp"},
+        {".avif", "image/avif"},
+        {".ico", "image/x-icon"},
+        {".woff", "font/woff"},
+        {".woff2", "font/woff2"},
+        {".ttf", "font/ttf"},
+        {".otf", "font/otf"},
+        {".wasm", "application/wasm"},
+        {".pdf", "application/pdf"},
+        {".zip", "application/zip"},
+        {".gz", "application/gzip"},
+        {".mp4", "video/mp4"},
+        {".webm", "video/webm"},
+        {".mp3", "audio/mpeg"},
+        {".wav", "audio/wav"},
+    }};
+
+    for (auto [known, type] : types)
+      if (known == extension) return type;
+    return "application/octet-stream";
+  }
+
+  // Decoded path relative to the root without "." and ".." segments, false if it is invalid
+  bool make_key(std::string_view path, std::string& key) {
+    std::string decoded;
+    decoded.reserve(path.size());
+    for (size_t i = 0; i < path.size(); ++i) {
+      char c = path[i];
+      if (c == '%') {
+        unsigned value = 0;
+        if (i + 2 >= path.size() ||
+            std::from_chars(path.data() + i + 1, path.data() + i + 3, value, 16).ptr !=
+                path.data() + i + 3)
+          return false;
+        c = static_cast<char>(value);
+        i += 2;
+      }
+      if (c == '\0' || c == '\\') return false;
+      decoded.push_back(c);
+    }
+
+    bool is_valid = true;
+    key.clear();
+    routine::utils::for_each_part(decoded, '/', [&](std::string_view segment) {
+      if (segment == "." || segment == "..") is_valid = false;
+      if (!key.empty()) key.push_back('/');
+      key.append(segment);
+    });
+    return is_valid;
+  }
+
+  bool parse_offset(std::string_view string, size_t& value) {
+    auto end = string.data() + string.size();
+    return !string.empty() && std::from_chars(string.data(), end, value).ptr == end;
+  }
+
+  const routine::http::Response_ptr& not_found() {
+    static const routine::http::Response_ptr response = routine::http::Response::make_static(
+        routine::http::Status::Not_Found, routine::http::Headers{}, "File not found");
+    return response;
+  }
+
+} // namespace
+
+routine::http::StaticFiles::StaticFiles(std::filesystem::path root)
+    : StaticFiles(std::move(root), Options{}) {}
+
+routine::http::StaticFiles::StaticFiles(std::filesystem::path root, Options options)
+    : spdlog::logger(*spdlog::get("Http")), root_(std::filesystem::canonical(root)),
+      options_(std::move(options)) {
+#ifdef __linux__
+  inotify_fd_ = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+  stop_fd_ = eventfd(0, EFD_CLOEXEC);
+  if (inotify_fd_ >= 0 && stop_fd_ >= 0) {
+    is_watching_ = true;
+    watch("");
+  }
+  if (is_watching_) {
+    watcher_ = std::thread(&StaticFiles::run_watcher, this);
+    return;
+  }
+#endif
+  warn("Files of '{}' are revalidated by stat, inotify is not available", root_.string());
+}
+
+routine::http::StaticFiles::~StaticFiles() {
+#ifdef __linux__
+  if (watcher_.joinable()) {
+    uint64_t value = 1;
+    [[maybe_unused]] auto written = ::write(stop_fd_, &value, sizeof(value));
+    watcher_.join();
+  }
+  if (inotify_fd_ >= 0) ::close(inotify_fd_);
+  if (stop_fd_ >= 0) ::close(stop_fd_);
+#endif
+}
+
+routine::http::Response_ptr routine::http::StaticFiles::process_request(Request_ptr request) {
+  auto field = request->path_params().find(parameter);
+  std::string key;
+  if (!make_key(field ? field->value() : std::string_view{}, key)) return not_found();
+
+  auto file = find(key);
+  return file ? respond(file, *request) : not_found();
+}
+
+void routine::http::StaticFiles::clear() {
+  std::lock_guard lock(mutex_);
+  index_.clear();
+  entries_.clear();
+  bytes_ = 0;
+  open_ = 0;
+}
+
+routine::http::StaticFiles::File_ptr routine::http::StaticFiles::find(const std::string& key,
+                                                                      bool is_index) {
+  if (auto file = lookup(key)) return file;
+
+  uint64_t generation = generation_.load(std::memory_order_acquire);
+  bool is_directory = false;
+  auto file = load(key, is_directory);
+  if (file) {
+    insert(key, file, generation);
+    return file;
+  }
+
+  if (!is_directory || is_index || options_.index.empty()) return nullptr;
+  return find(key.empty() ? options_.index : key + '/' + options_.index, true);
+}
+
+routine::http::StaticFiles::File_ptr routine::http::StaticFiles::lookup(const std::string& key) {
+  File_ptr file;
+  {
+    std::lock_guard lock(mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end()) return nullptr;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    file = it->second->file;
+  }
+  if (is_watching_.load(std::memory_order_relaxed)) return file;
+
+  struct stat info;
+  if (::stat((root_ / key).c_str(), &info) != 0) return nullptr;
+  int64_t modified_ns = info.st_mtim.tv_sec * 1'000'000'000ll + info.st_mtim.tv_nsec;
+  if (modified_ns != file->modified_ns || static_cast<size_t>(info.st_size) != file->size)
+    return nullptr;
+  return file;
+}
+
+routine::http::StaticFiles::File_ptr
+routine::http::StaticFiles::load(const std::string& key, bool& is_directory) {
+  std::error_code ec;
+  auto path = std::filesystem::canonical(root_ / key, ec);
+  if (ec) return nullptr;
+
+  // symlinks must not lead out of the root
+  auto [root_end, path_end] = std::mismatch(root_.begin(), root_.end(), path.begin(), path.end());
+  if (root_end != root_.end()) return nullptr;
+
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return nullptr;
+
+  struct stat info {};
+  if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+    is_directory = S_ISDIR(info.st_mode);
+    ::close(fd);
+    return nullptr;
+  }
+
+  auto file = std::make_shared<File>();
+  file->size = info.st_size;
+  file->modified = info.st_mtim.tv_sec;
+  file->modified_ns = info.st_mtim.tv_sec * 1'000'000'000ll + info.st_mtim.tv_nsec;
+  file->is_cacheable = path == root_ / key;
+  file->etag = std::format("\"{:x}-{:x}\"", file->size, file->modified_ns);
+  file->last_modified.resize(utils::http_date_size);
+  utils::format_http_date(file->modified, file->last_modified.data());
+
+  Headers headers{{"Content-Type", content_type(path.extension().native())},
+                  {"ETag", file->etag},
+                  {"Last-Modified", file->last_modified},
+                  {"Accept-Ranges", "bytes"}};
+  if (!options_.cache_control.empty())
+    headers.insert(Header::Cache_Control, options_.cache_control);
+  file->headers = headers;
+
+  auto& identity = file->representations[static_cast<size_t>(Encoding::Identity)];
+
+  if (file->size <= options_.max_cached_size) {
+    std::string body(file->size, '\0');
+    size_t read = 0;
+    while (read < body.size()) {
+      ssize_t count = ::pread(fd, body.data() + read, body.size() - read, read);
+      if (count < 0 && errno == EINTR) continue;
+      if (count <= 0) break;
+      read += count;
+    }
+    body.resize(read);
+    file->size = read;
+
+    file->representations =
+        make_representations(std::move(headers), std::move(body), options_.compression,
+                             {Header::Last_Modified, Header::Cache_Control, Header::Vary});
+    file->bytes = identity.response->encoded_body();
+    file->owner = identity.response;
+    file->cost = sizeof(File) + 2 * key.size();
+    for (const auto& representation : file->representations)
+      if (representation.response)
+        file->cost += representation.response->encoded_body().size() + 1024;
+    ::close(fd);
+  } else {
+    // unlike a mapping, reads of a file truncated in place cannot fault the server
+    file->fd = FileRangeBody::share_descriptor(fd);
+    identity.etag = file->etag;
+    identity.response = std::make_shared<Response>(
+        Status::Ok, std::move(headers), std::make_shared<FileRangeBody>(file->fd, 0, file->size));
+    Headers not_modified{{"ETag", file->etag}, {"Last-Modified", file->last_modified}};
+    if (!options_.cache_control.empty())
+      not_modified.insert(Header::Cache_Control, options_.cache_control);
+    identity.not_modified = Response::make_static(Status::Not_Modified, std::move(not_modified));
+    file->cost = sizeof(File) + 2 * key.size() + 1024;
+    file->is_open = true;
+  }
+  return file;
+}
+
+void routine::http::StaticFiles::insert(const std::string& key, const File_ptr& file,
+                                        uint64_t generation) {
+  if (!file->is_cacheable || file->cost > options_.cache_capacity) return;
+
+  std::lock_guard lock(mutex_);
+  // the file changed while it was loaded, the next request loads it again
+  if (generation_.load(std::memory_order_acquire) != generation) return;
+
+  if (auto it = index_.find(key); it != index_.end()) remove(it->second);
+
+  entries_.push_front({key, file});
+  index_.emplace(entries_.front().key, entries_.begin());
+  bytes_ += file->cost;
+  open_ += file->is_open;
+
+  // least recently used files go first
+  while (bytes_ > options_.cache_capacity || open_ > options_.max_open_files)
+    remove(std::prev(entries_.end()));
+}
+
+void routine::http::StaticFiles::erase(std::string_view key, bool is_directory) {
+  std::lock_guard lock(mutex_);
+  if (!is_directory) {
+    if (auto it = index_.find(key); it != index_.end()) remove(it->second);
+    return;
+  }
+
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    std::string_view entry = it->key;
+    bool is_inside = key.empty() || (entry.starts_with(key) && entry.size() > key.size() &&
+                                     entry[key.size()] == '/');
+    if (is_inside)
+      remove(it++);
+    else
+      ++it;
+  }
+}
+
+void routine::http::StaticFiles::remove(std::list<Entry>::iterator it) {
+  bytes_ -= it->file->cost;
+  open_ -= it->file->is_open;
+  index_.erase(it->key);
+  entries_.erase(it);
+}
+
+routine::http::Response_ptr routine::http::StaticFiles::respond(const File_ptr& file,
+                                                                Request& request) const {
+  // ranges are served from the identity only
+  auto range = request.headers().find(Header::Range);
+  bool is_partial = range && file->size > 0;
+
+  // RFC 7233 3.2: the range applies only to the representation named by If-Range
+  if (auto if_range = request.headers().find(Header::If_Range); is_partial && if_range)
+    is_partial = if_range->value() == file->etag || if_range->value() == file->last_modified;
+
+  const auto& representation =
+      is_partial ? file->representations[static_cast<size_t>(Encoding::Identity)]
+                 : select_representation(file->representations, request);
+  if (is_not_modified(*file, representation.etag, request)) return representation.not_modified;
+  return is_partial ? partial(file, range->value()) : representation.response;
+}
+
+routine::http::Response_ptr routine::http::StaticFiles::partial(const File_ptr& file,
+                                                                std::string_view range) const {
+  const auto& full = file->representations[static_cast<size_t>(Encoding::Identity)].response;
+
+  // one range only, the full file is a valid answer to any other Range
+  if (!range.starts_with("bytes=") || range.find(',') != std::string_view::npos)
+    return full;
+  range.remove_prefix(6);
+
+  size_t dash = range.find('-');
+  if (dash == std::string_view::npos) return full;
+  std::string_view first_part = range.substr(0, dash);
+  std::string_view last_part = range.substr(dash + 1);
+
+  size_t first = 0;
+  size_t last = file->size - 1;
+  bool is_satisfiable = true;
+  if (first_part.empty()) {
+    // suffix: the last N bytes
+    size_t length = 0;
+    if (!parse_offset(last_part, length)) return full;
+    is_satisfiable = length > 0;
+    first = file->size - std::min(length, file->size);
+  } else {
+    if (!parse_offset(first_part, first)) return full;
+    if (!last_part.empty()) {
+      if (!parse_offset(last_part, last) || last < first) return full;
+      last = std::min(last, file->size - 1);
+    }
+    is_satisfiable = first < file->size;
+  }
+
+  if (!is_satisfiable)
+    return Response::make_static(Status::Range_Not_Satisfiable,
+                                 Headers{{"Content-Range", std::format("bytes */{}", file->size)}});
+
+  Headers headers = file->headers;
+  headers.insert(Header::Content_Range, std::format("bytes {}-{}/{}", first, last, file->size));
+  if (file->fd)
+    return std::make_shared<Response>(
+        Status::Partial_Content, std::move(headers),
+        std::make_shared<FileRangeBody>(file->fd, first, last - first + 1));
+  return Response::make_static(Status::Partial_Content, std::move(headers),
+                               file->bytes.substr(first, last - first + 1), file->owner);
+}
+
+bool routine::http::StaticFiles::is_not_modified(const File& file, std::string_view etag,
+                                                 Request& request) {
+  // RFC 7232 6: If-Modified-Since is ignored when If-None-Match is present
+  if (request.headers().contains(Header::If_None_Match))
+    return ResponseCache::is_not_modified(request, etag);
+
+  auto since = request.headers().find(Header::If_Modified_Since);
+  if (!since) return false;
+  auto time = utils::parse_http_date(since->value());
+  return time && file.modified <= *time;
+}
+
+void routine::http::StaticFiles::watch(const std::string& relative) {
+#ifdef __linux__
+  constexpr uint32_t mask = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE |
+                            IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF |
+                            IN_ONLYDIR;
+
+  auto directory = relative.empty() ? root_ : root_ / relative;
+  int descriptor = inotify_add_watch(inotify_fd_, directory.c_str(), mask);
+  if (descriptor < 0) {
+    warn("Files of '{}' are revalidated by stat, cannot watch '{}': {}", root_.string(),
+         directory.string(), std::strerror(errno));
+    is_watching_ = false;
+    return;
+  }
+  watches_[descriptor] = relative;
+
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::directory_iterator(
+           directory, std::filesystem::directory_options::skip_permission_denied, ec))
+    if (entry.is_directory(ec) && !entry.is_symlink(ec)) {
+      std::string name = entry.path().filename().string();
+      watch(relative.empty() ? name : relative + '/' + name);
+    }
+#endif
+}
+
+void routine::http::StaticFiles::run_watcher() {
+#ifdef __linux__
+  alignas(inotify_event) char buffer[16 * 1024];
+  std::array<pollfd, 2> descriptors{{{inotify_fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}}};
+
+  while (true) {
+    if (::poll(descriptors.data(), descriptors.size(), -1) < 0) {
+      if (errno == EINTR) continue;
+      error("Watching of '{}' stopped: {}", root_.string(), std::strerror(errno));
+      is_watching_ = false;
+      return;
+    }
+    if (descriptors[1].revents) return;
+
+    ssize_t size = ::read(inotify_fd_, buffer, sizeof(buffer));
+    for (ssize_t offset = 0; offset < size;) {
+      const auto& event = *reinterpret_cast<const inotify_event*>(buffer + offset);
+      offset += sizeof(inotify_event) + event.len;
+
+      generation_.fetch_add(1, std::memory_order_acq_rel);
+      if (event.mask & IN_Q_OVERFLOW) {
+        clear();
+        continue;
+      }
+
+      auto it = watches_.find(event.wd);
+      if (it == watches_.end()) continue;
+      if (event.mask & IN_IGNORED) {
+        watches_.erase(it);
+        continue;
+      }
+      if (event.mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+        erase(it->second, true);
+        inotify_rm_watch(inotify_fd_, event.wd);
+        continue;
+      }
+
+      std::string path = it->second;
+      if (event.len > 0) {
+        if (!path.empty()) path.push_back('/');
+        path.append(event.name);
+      }
+
+      bool is_directory = event.mask & IN_ISDIR;
+      erase(path, is_directory);
+      if (is_directory && (event.mask & (IN_CREATE | IN_MOVED_TO))) watch(path);
+    }
+  }
+#endif
+}
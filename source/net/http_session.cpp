@@ -1,21 +1,83 @@
 #include "net/http_session.hpp"
 #include "http/body_storage.hpp"
+#include "http/compression.hpp"
 #include "http/headers.hpp"
+#include "http/rate_limiter.hpp"
 #include "http/request.hpp"
 #include "http/response.hpp"
+#include "http/response_cache.hpp"
 #include "http/types.hpp"
+#include "utils/perfect_hash.hpp"
+#include "utils/simd.hpp"
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cstring>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <spdlog/spdlog.h>
 #include <system_error>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+
+namespace {
+  using Buffer_iterator = asio::buffers_iterator<asio::streambuf::const_buffers_type>;
+
+  // Match condition for asio::async_read_until. Searches the end of message head ("\r\n\r\n")
+  // with SIMD kernels instead of byte-by-byte comparison. Streambuf data is contiguous
+  std::pair<Buffer_iterator, bool> match_header_end(Buffer_iterator begin, Buffer_iterator end) {
+    size_t size = end - begin;
+    if (size < 4) return {begin, false};
+
+    size_t index = routine::utils::simd::find_header_end(&*begin, size);
+    if (index == size) return {end - 3, false}; // delimiter may be split between reads
+    return {begin + index + 4, true};
+  }
+
+  // Body of unrouted and answered requests. It is read from the socket, so the next request
+  // starts at its head, and dropped
+  class DiscardedBody final : public routine::http::I_BodyStorage {
+  public:
+    void operator=(const std::string&) override {}
+    void write(const std::vector<uint8_t>&) override {}
+    void write(asio::streambuf& buffer) override { buffer.consume(buffer.size()); }
+    void write(const std::string&) override {}
+    void write(std::string&&) override {}
+    void write(std::span<const uint8_t>) override {}
+    std::vector<uint8_t> read() const override { return {}; }
+    size_t size() const override { return 0; }
+    std::string as_string() const override { return {}; }
+  };
+
+  // 503 for a connection whose next request cannot be read within the memory budget
+  const routine::http::Response_ptr& out_of_memory_response() {
+    static const routine::http::Response_ptr response = routine::http::Response::make_static(
+        routine::http::Status::Service_Unavailable,
+        routine::http::Headers{{"Connection", "close"}, {"Retry-After", "1"}},
+        "Server is out of memory for the request");
+    return response;
+  }
+
+  // 500 for handlers which did not return a response
+  routine::http::Response_ptr missing_response(std::string_view path) {
+    return std::make_shared<routine::http::Response>(
+        routine::http::Status::Internal_Server_Error, routine::http::Headers{},
+        fmt::format("Resource handler '{}' did not return a response", path));
+  }
+} // namespace
 
 routine::net::HttpSession::HttpSession(routine::Scheduler_ptr scheduler,
                                        asio::ip::tcp::socket socket)
     : spdlog::logger(*spdlog::get("Http")), scheduler_(std::move(scheduler)),
-      socket_(std::move(socket)), timeout_timer_(scheduler_->get_context()),
-      timeout_(std::chrono::milliseconds(1000)) {
+      socket_(std::move(socket)), strand_(asio::make_strand(scheduler_->get_context())),
+      timeout_timer_(scheduler_->get_context()),
+      timeout_(std::chrono::milliseconds(1000)), budget_timer_(scheduler_->get_context()),
+      read_buffer_(std::make_shared<asio::streambuf>()) {
+  write_buffer_.reserve(output_buffer_size);
+  pending_buffer_.reserve(output_buffer_size);
+
   address_ = socket_.is_open()
                  ? std::format("{}:{}", socket_.remote_endpoint().address().to_string(),
                                socket_.remote_endpoint().port())
@@ -25,8 +87,13 @@ routine::net::HttpSession::HttpSession(routine::Scheduler_ptr scheduler,
 routine::net::HttpSession::HttpSession(routine::Scheduler_ptr scheduler,
                                        const std::string& endpoint)
     : spdlog::logger(*spdlog::get("Http")), scheduler_(std::move(scheduler)),
-      socket_(scheduler_->get_context()), timeout_timer_(scheduler_->get_context()),
-      timeout_(std::chrono::milliseconds(1000)) {
+      socket_(scheduler_->get_context()), strand_(asio::make_strand(scheduler_->get_context())),
+      timeout_timer_(scheduler_->get_context()),
+      timeout_(std::chrono::milliseconds(1000)), budget_timer_(scheduler_->get_context()),
+      read_buffer_(std::make_shared<asio::streambuf>()) {
+  write_buffer_.reserve(output_buffer_size);
+  pending_buffer_.reserve(output_buffer_size);
+
   asio::ip::tcp::resolver resolver(scheduler_->get_context());
 
   trace("Connecting to {}", endpoint);
@@ -41,36 +108,143 @@ routine::net::HttpSession::HttpSession(routine::Scheduler_ptr scheduler,
 
 void routine::net::HttpSession::run_process() {
   timeout_timer_.cancel();
+
+  // the next request is not read while the memory budget is exhausted. After 'max_wait' the
+  // connection is answered with 503 and closed
+  if (!routine::utils::MemoryBudget::global().has_room(head_reserve)) {
+    wait_for_memory([] { return routine::utils::MemoryBudget::global().has_room(head_reserve); },
+                    std::chrono::steady_clock::now() + scheduler_->memory_budget().max_wait,
+                    [self = shared_from_this()](bool has_room) {
+                      if (has_room) {
+                        self->read_next_request();
+                        return;
+                      }
+                      self->debug("Session {}. Next request rejected by the memory budget",
+                                  self->address_);
+                      self->send_response(out_of_memory_response(),
+                                          [self](const std::error_code&) { self->close({}); });
+                    });
+    return;
+  }
+  read_next_request();
+}
+
+void routine::net::HttpSession::read_next_request() {
   read_request(
       [self = shared_from_this()](const std::error_code& ec, routine::http::Request_ptr request) {
         if (self->is_errors(ec)) return;
 
-        self->scheduler_->prepare_task([self = std::move(self), req = std::move(request)]() {
-          auto handler = self->scheduler_->route_request(req);
-          if (handler) {
-            auto response = handler->process_request(req);
-            if (response) {
-              self->send_response(response, [self](const std::error_code& ec) {});
-            } else {
-              self->send_response(std::make_shared<http::Response>(
-                  http::Status::Internal_Server_Error, http::Headers{},
-                  fmt::format("Resource handler '{}' did not return a response", req->path())));
-            }
-          } else {
-            self->send_response(std::make_shared<http::Response>(
-                http::Status::Not_Found, http::Headers{},
-                fmt::format("Requested resource '{}' handler not found", req->path())));
-          }
-          if (req->headers().contains(http::Header::Connection) &&
-              (req->headers().at(http::Header::Connection) == "close" ||
-               req->headers().at(http::Header::Connection) == "Close"))
-            self->close({});
-          else
-            self->run_process();
+        // routed once on the IO thread, requests with body are routed before reading it.
+        // 404, 405, OPTIONS, 429 and answers of prepare_request() skip the queue
+        auto handler = self->route_request(request);
+        auto response = std::exchange(self->prepared_response_, nullptr);
+        if (!handler && !response)
+          response = request->route_response() ? request->route_response()
+                                               : self->scheduler_->not_found_response();
+
+        // cached GET responses and 304 are sent from the IO thread as well
+        std::string cache_key;
+        auto cache_policy = request->route_policy().cache;
+        auto& cache = self->scheduler_->response_cache();
+        if (!response && cache_policy && request->method() == http::Method::Get) {
+          cache_key = http::ResponseCache::make_key(*request, *cache_policy);
+          response = cache.find(cache_key, *request);
+
+          // the same request is in flight, its response is sent when it completes. A response
+          // which cannot be shared leaves the request to its own handler call
+          if (!response && cache_policy->coalesce &&
+              cache.join(cache_key, request,
+                         [self, request, handler, cache_key](const http::Response_ptr& result) {
+                           if (result) {
+                             self->send_response(result);
+                             self->continue_or_close(*request);
+                             return;
+                           }
+                           self->scheduler_->prepare_task([self, request, handler, cache_key] {
+                             self->run_handler(request, handler, cache_key, false);
+                           });
+                         }))
+            return;
+        }
+
+        if (response) {
+          self->send_response(std::move(response));
+          self->continue_or_close(*request);
+          return;
+        }
+
+        bool is_coalesced = cache_policy && cache_policy->coalesce && !cache_key.empty();
+        self->scheduler_->prepare_task([self = std::move(self), req = std::move(request),
+                                        handler = std::move(handler),
+                                        cache_key = std::move(cache_key), is_coalesced]() {
+          self->run_handler(req, handler, cache_key, is_coalesced);
         });
       });
 }
 
+void routine::net::HttpSession::run_handler(routine::http::Request_ptr request,
+                                            routine::http::RequestHandler_ptr handler,
+                                            const std::string& cache_key, bool is_coalesced) {
+  auto response = http::local_handler(handler, request->route_policy())->process_request(request);
+  if (!cache_key.empty()) {
+    auto& cache = scheduler_->response_cache();
+    auto& policy = *request->route_policy().cache;
+    auto cached = cache.insert(cache_key, response, policy, *request);
+    if (is_coalesced) cache.complete(cache_key, cached, response, *request);
+    if (cached) response = http::ResponseCache::select(*cached, *request);
+  }
+  // cached responses carry their codings already
+  response = http::compress_response(response, *request, scheduler_->compression());
+  send_response(response ? response : missing_response(request->path()));
+  continue_or_close(*request);
+}
+
+routine::http::RequestHandler_ptr
+routine::net::HttpSession::route_request(const routine::http::Request_ptr& request) {
+  bool is_routed = request->is_routed();
+  auto handler = scheduler_->route_request(request);
+  if (is_routed || !handler) return handler;
+
+  auto limit = request->route_policy().rate_limit;
+  if (!limit) return handler;
+
+  // the header of 'limit' is limited in addition to the client IP, rotating its values does
+  // not lift the limit of the client
+  std::string_view key;
+  if (!limit->header().empty())
+    if (auto field = request->headers().find(limit->header())) key = field->value();
+  if (!scheduler_->rate_limiter().try_acquire(*limit, client_ip(), key)) {
+    request->set_handler(nullptr, limit->rejected_response());
+    return nullptr;
+  }
+  return handler;
+}
+
+std::string_view routine::net::HttpSession::client_ip() const {
+  // "ip:port", IPv6 addresses contain ':' as well
+  std::string_view address = address_;
+  return address.substr(0, address.rfind(':'));
+}
+
+void routine::net::HttpSession::continue_or_close(routine::http::Request& request) {
+  if (std::exchange(is_body_skipped_, false) ||
+      (request.headers().contains(http::Header::Connection) &&
+       (request.headers().at(http::Header::Connection) == "close" ||
+        request.headers().at(http::Header::Connection) == "Close"))) {
+    {
+      // streamed and large responses are still being written
+      std::lock_guard lock(write_mutex_);
+      if (is_writing_) {
+        is_closing_ = true;
+        return;
+      }
+    }
+    close({});
+  } else {
+    run_process();
+  }
+}
+
 void routine::net::HttpSession::set_timeout(std::chrono::milliseconds timeout) {
   timeout_ = timeout;
 }
@@ -99,9 +273,31 @@ void routine::net::HttpSession::close(const std::error_code& ec) {
 
 void routine::net::HttpSession::run_timeout_timer() {
   timeout_timer_.expires_after(timeout_);
-  timeout_timer_.async_wait([self = shared_from_this()](const std::error_code& ec) {
-    if (!ec) self->close(std::make_error_code(std::errc::timed_out));
-  });
+  timeout_timer_.async_wait(
+      asio::bind_executor(strand_, [self = shared_from_this()](const std::error_code& ec) {
+        if (!ec) self->close(std::make_error_code(std::errc::timed_out));
+      }));
+}
+
+void routine::net::HttpSession::wait_for_memory(std::function<bool()> has_room,
+                                                std::chrono::steady_clock::time_point deadline,
+                                                std::function<void(bool)> callback) {
+  if (has_room()) {
+    callback(true);
+    return;
+  }
+  if (std::chrono::steady_clock::now() >= deadline) {
+    callback(false);
+    return;
+  }
+
+  budget_timer_.expires_after(scheduler_->memory_budget().retry_interval);
+  budget_timer_.async_wait(asio::bind_executor(
+      strand_, [self = shared_from_this(), has_room = std::move(has_room), deadline,
+                cb = std::move(callback)](const std::error_code& ec) mutable {
+        if (ec || !self->socket_.is_open()) return;
+        self->wait_for_memory(std::move(has_room), deadline, std::move(cb));
+      }));
 }
 
 bool routine::net::HttpSession::is_errors(const std::error_code& ec) {
@@ -126,12 +322,12 @@ void routine::net::HttpSession::send_response(
     return;
   }
 
-  std::string buffer = response->prepare_response();
-  socket_.async_write_some(asio::buffer(buffer),
-                           [self = shared_from_this(), cb = std::move(callback),
-                            response](const std::error_code& ec, size_t) {
-                             if (cb) cb(ec);
-                           });
+  if (response->is_static() && response->encoded_body().size() >= external_body_size)
+    enqueue_static(std::move(response), std::move(callback));
+  else if (auto chunks = response->body() ? response->body()->make_chunks() : nullptr)
+    enqueue_stream(std::move(response), std::move(chunks), std::move(callback));
+  else
+    enqueue_write(*response, std::move(callback));
   run_timeout_timer();
 }
 
@@ -147,12 +343,209 @@ void routine::net::HttpSession::send_request(
     return;
   }
 
-  std::string buffer = request->prepare_request();
-  socket_.async_write_some(asio::buffer(buffer),
-                           [self = shared_from_this(), cb = std::move(callback),
-                            request](const std::error_code& ec, size_t) {
-                             if (cb) self->read_response(std::move(cb));
-                           });
+  enqueue_write(*request, [self = shared_from_this(), cb = std::move(callback)](
+                              const std::error_code& ec) mutable {
+    if (!cb) return;
+    if (ec)
+      cb(ec, nullptr);
+    else
+      self->read_response(std::move(cb));
+  });
+}
+
+template <typename T>
+void routine::net::HttpSession::enqueue_write(const T& message, Write_callback callback) {
+  std::lock_guard lock(write_mutex_);
+  if (stream_) {
+    std::string bytes;
+    message.serialize(bytes);
+    waiting_.push_back({nullptr, nullptr, std::move(bytes), std::move(callback)});
+    return;
+  }
+  message.serialize(pending_buffer_);
+  pending_callbacks_.push_back(std::move(callback));
+  if (!is_writing_) do_write();
+}
+
+void routine::net::HttpSession::enqueue_bytes(std::string_view bytes, Write_callback callback) {
+  std::lock_guard lock(write_mutex_);
+  if (stream_) {
+    waiting_.push_back({nullptr, nullptr, std::string(bytes), std::move(callback)});
+    return;
+  }
+  pending_buffer_.append(bytes);
+  pending_callbacks_.push_back(std::move(callback));
+  if (!is_writing_) do_write();
+}
+
+void routine::net::HttpSession::enqueue_static(routine::http::Response_ptr response,
+                                               Write_callback callback) {
+  std::lock_guard lock(write_mutex_);
+  if (stream_) {
+    waiting_.push_back({std::move(response), nullptr, {}, std::move(callback)});
+    return;
+  }
+  response->serialize_head(pending_buffer_);
+  std::string_view body = response->encoded_body();
+  pending_external_.push_back({pending_buffer_.size(), body, std::move(response)});
+  pending_callbacks_.push_back(std::move(callback));
+  if (!is_writing_) do_write();
+}
+
+void routine::net::HttpSession::enqueue_stream(routine::http::Response_ptr response,
+                                               std::unique_ptr<routine::http::I_BodyChunks> chunks,
+                                               Write_callback callback) {
+  std::lock_guard lock(write_mutex_);
+  if (stream_) {
+    waiting_.push_back({std::move(response), std::move(chunks), {}, std::move(callback)});
+    return;
+  }
+  start_stream(std::move(response), std::move(chunks), std::move(callback));
+  if (!is_writing_) do_write();
+}
+
+void routine::net::HttpSession::start_stream(routine::http::Response_ptr response,
+                                             std::unique_ptr<routine::http::I_BodyChunks> chunks,
+                                             Write_callback callback) {
+  response->serialize_stream_head(pending_buffer_, *chunks);
+  auto remaining = chunks->size();
+  stream_.emplace(std::move(response), std::move(chunks), std::move(callback), remaining);
+  append_chunk();
+}
+
+void routine::net::HttpSession::append_chunk() {
+  bool is_more = false;
+  if (stream_->remaining) {
+    // bytes beyond the Content-Length would be read as the next message
+    size_t position = pending_buffer_.size();
+    size_t hint = std::min<uint64_t>(stream_chunk_size, *stream_->remaining);
+    is_more = stream_->chunks->next(pending_buffer_, hint);
+    size_t size = std::min<uint64_t>(pending_buffer_.size() - position, *stream_->remaining);
+    pending_buffer_.resize(position + size);
+    *stream_->remaining -= size;
+    is_more = is_more && *stream_->remaining > 0;
+
+    if (!is_more && *stream_->remaining > 0) {
+      // the body ended short, e.g. its file was truncated. The client cannot find the end of
+      // it, so the connection is closed after the sent bytes and later messages are dropped
+      warn("Session {}. Streamed body ended {} bytes short, closing", address_,
+           *stream_->remaining);
+      is_closing_ = true;
+      pending_callbacks_.push_back(std::move(stream_->callback));
+      for (auto& output : waiting_)
+        pending_callbacks_.push_back(std::move(output.callback));
+      stream_.reset();
+      waiting_.clear();
+      return;
+    }
+  } else {
+    // chunk size is patched after the chunk is written, leading zeros are allowed
+    constexpr std::string_view size_placeholder{"00000000\r\n"};
+    size_t position = pending_buffer_.size();
+    pending_buffer_.append(size_placeholder);
+    is_more = stream_->chunks->next(pending_buffer_, stream_chunk_size);
+
+    size_t size = pending_buffer_.size() - position - size_placeholder.size();
+    if (size == 0) {
+      pending_buffer_.resize(position);
+    } else {
+      char* digits = pending_buffer_.data() + position;
+      for (size_t i = 8; i-- > 0; size >>= 4)
+        digits[i] = "0123456789abcdef"[size & 0xF];
+      pending_buffer_.append("\r\n");
+    }
+    if (!is_more) pending_buffer_.append("0\r\n\r\n");
+  }
+  if (is_more) return;
+
+  pending_callbacks_.push_back(std::move(stream_->callback));
+  stream_.reset();
+
+  // messages enqueued during the stream, up to the next streamed one
+  auto waiting = std::move(waiting_);
+  waiting_.clear();
+  for (auto& output : waiting) {
+    if (is_closing_) {
+      // a stream before it ended short
+      pending_callbacks_.push_back(std::move(output.callback));
+    } else if (stream_) {
+      waiting_.push_back(std::move(output));
+    } else if (output.chunks) {
+      start_stream(std::move(output.response), std::move(output.chunks),
+                   std::move(output.callback));
+    } else if (output.response) {
+      output.response->serialize_head(pending_buffer_);
+      std::string_view body = output.response->encoded_body();
+      pending_external_.push_back({pending_buffer_.size(), body, std::move(output.response)});
+      pending_callbacks_.push_back(std::move(output.callback));
+    } else {
+      pending_buffer_.append(output.bytes);
+      pending_callbacks_.push_back(std::move(output.callback));
+    }
+  }
+}
+
+void routine::net::HttpSession::do_write() {
+  is_writing_ = true;
+  write_buffer_.swap(pending_buffer_);
+  write_external_.swap(pending_external_);
+  write_callbacks_.swap(pending_callbacks_);
+  write_charge_.resize(write_buffer_.capacity() + pending_buffer_.capacity());
+
+  // output buffer split by external bytes
+  write_sequence_.clear();
+  size_t position = 0;
+  for (const auto& external : write_external_) {
+    if (external.position > position)
+      write_sequence_.push_back(
+          asio::buffer(write_buffer_.data() + position, external.position - position));
+    write_sequence_.push_back(asio::buffer(external.bytes.data(), external.bytes.size()));
+    position = external.position;
+  }
+  if (position < write_buffer_.size())
+    write_sequence_.push_back(
+        asio::buffer(write_buffer_.data() + position, write_buffer_.size() - position));
+
+  asio::async_write(
+      socket_, write_sequence_,
+      [self = shared_from_this()](const std::error_code& ec, size_t) {
+        bool is_closing = false;
+        std::vector<Write_callback> completed;
+        {
+          std::lock_guard lock(self->write_mutex_);
+          self->write_buffer_.clear();
+          self->write_external_.clear();
+          completed.swap(self->write_callbacks_);
+
+          // pending messages are dropped on error, their callbacks receive the error
+          if (ec) {
+            self->pending_buffer_.clear();
+            self->pending_external_.clear();
+            for (auto& callback : self->pending_callbacks_)
+              completed.push_back(std::move(callback));
+            self->pending_callbacks_.clear();
+            if (self->stream_) completed.push_back(std::move(self->stream_->callback));
+            for (auto& output : self->waiting_)
+              completed.push_back(std::move(output.callback));
+            self->stream_.reset();
+            self->waiting_.clear();
+          } else if (self->stream_) {
+            self->append_chunk(); // produced only when the previous chunk is sent
+          }
+
+          if (!self->pending_buffer_.empty() || !self->pending_external_.empty()) {
+            self->do_write();
+          } else {
+            self->is_writing_ = false;
+            is_closing = self->is_closing_;
+          }
+        }
+
+        // callbacks may send the next message, so they are called without the lock
+        for (auto& callback : completed)
+          if (callback) callback(ec);
+        if (is_closing) self->close({});
+      });
 }
 
 void routine::net::HttpSession::read_response(
@@ -177,22 +570,30 @@ void routine::net::HttpSession::do_read_headers(
     return;
   }
 
-  auto buffer = std::make_shared<asio::streambuf>();
+  auto buffer = read_buffer_;
   asio::async_read_until(
-      socket_, *buffer, "\r\n\r\n",
+      socket_, *buffer, match_header_end,
       [self = shared_from_this(), buffer, cb = std::move(callback)](const std::error_code& ec,
                                                                     size_t bytes) {
         if (self->is_errors(ec)) {
           cb(ec, nullptr);
           return;
         }
-        std::string str;
-        str.resize_and_overwrite(bytes - 2, [&buffer](char* data, size_t size) {
-          std::memcpy(data, buffer->data().data(), size);
-          return size;
-        });
+        std::shared_ptr<T> object;
+        if constexpr (std::is_same_v<T, http::Request>) {
+          // requests are parsed into a pooled arena
+          object = http::make_request(
+              std::string_view(static_cast<const char*>(buffer->data().data()), bytes - 2));
+        } else {
+          std::string str;
+          str.resize_and_overwrite(bytes - 2, [&buffer](char* data, size_t size) {
+            std::memcpy(data, buffer->data().data(), size);
+            return size;
+          });
+          object = std::make_shared<T>(std::move(str));
+        }
         buffer->consume(bytes);
-        auto object = std::make_shared<T>(str);
+        self->read_charge_.resize(buffer->capacity());
 
         bool is_content_length_have = object->headers().contains(http::Header::Content_Length);
         bool is_chunked_body = !is_content_length_have &&
@@ -205,6 +606,22 @@ void routine::net::HttpSession::do_read_headers(
           return;
         }
 
+        // a body without a valid length cannot be told apart from the next message
+        if (is_content_length_have && !http::parse_content_length(object->headers())) {
+          self->warn("Session {}. Invalid Content-Length '{}'", self->address_,
+                     object->headers()[http::Header::Content_Length].value());
+          if constexpr (std::is_same_v<T, http::Request>) {
+            self->is_body_skipped_ = true;
+            self->prepared_response_ = std::make_shared<http::Response>(
+                http::Status::Bad_Request, http::Headers{{"Connection", "close"}},
+                "Invalid Content-Length");
+            cb(std::error_code{}, object);
+          } else {
+            cb(std::make_error_code(std::errc::protocol_error), object);
+          }
+          return;
+        }
+
         if (is_content_length_have) {
           self->do_prepare_and_read_body(std::move(object), buffer, std::move(cb));
         } else {
@@ -221,20 +638,81 @@ template void routine::net::HttpSession::do_read_headers<routine::http::Response
 void routine::net::HttpSession::do_prepare_and_read_body(
     routine::http::Request_ptr request, Buffer_ptr buffer,
     std::function<void(const std::error_code&, routine::http::Request_ptr)> callback) {
-  auto handler = scheduler_->route_request(request);
-  if (handler) {
-    handler->prepare_request(request);
-  } else {
-    if (request->headers().contains(http::Header::Content_Type) &&
-        request->headers().at(http::Header::Content_Type) == "application/json")
-      request->body() = std::make_unique<http::JsonBody>();
-    else
-      request->body() = std::make_unique<http::MemoryBody>();
+  auto handler = route_request(request);
+  if (handler) prepared_response_ = handler->prepare_request(request);
+
+  // bodies which are only drained take no memory, they are not charged to the budget
+  if (!handler || prepared_response_) {
+    request->body() = std::make_unique<DiscardedBody>();
+    do_read_body(request, buffer, std::move(callback));
+    return;
+  }
+
+  // bodies kept in memory are charged to the budget before they are read. Pieces for the
+  // handler are charged as they are queued
+  if (!request->route_policy().body_chunks) {
+    size_t content_length = *http::parse_content_length(request->headers());
+
+    if (request->body() && !request->body()->reserve(content_length)) {
+      size_t limit = routine::utils::MemoryBudget::global().limit();
+      if (content_length > limit) {
+        reject_unread_body(http::Status::Payload_Too_Large);
+        callback(std::error_code(), std::move(request));
+        return;
+      }
+      auto& body = *request->body();
+      wait_for_memory(
+          [&body, content_length] { return body.reserve(content_length); },
+          std::chrono::steady_clock::now() + scheduler_->memory_budget().max_wait,
+          [self = shared_from_this(), request, buffer, handler,
+           cb = std::move(callback)](bool has_room) mutable {
+            if (has_room) {
+              self->do_read_request_body(std::move(request), std::move(buffer),
+                                         std::move(handler), std::move(cb));
+              return;
+            }
+            self->reject_unread_body(http::Status::Service_Unavailable);
+            cb(std::error_code(), std::move(request));
+          });
+      return;
+    }
+  }
+
+  do_read_request_body(std::move(request), std::move(buffer), std::move(handler),
+                       std::move(callback));
+}
+
+void routine::net::HttpSession::do_read_request_body(
+    routine::http::Request_ptr request, Buffer_ptr buffer,
+    routine::http::RequestHandler_ptr handler,
+    std::function<void(const std::error_code&, routine::http::Request_ptr)> callback) {
+  auto decompressor = make_decompressor(*request);
+  if (request->route_policy().body_chunks && !prepared_response_) {
+    do_read_body_chunks(std::move(request), std::move(buffer), std::move(handler),
+                        std::move(decompressor), std::move(callback));
+    return;
+  }
+  if (decompressor) {
+    do_read_encoded_body(std::move(request), std::move(buffer), std::move(decompressor),
+                         std::move(callback));
+    return;
   }
 
   do_read_body(request, buffer, std::move(callback));
 }
 
+void routine::net::HttpSession::reject_unread_body(routine::http::Status status) {
+  debug("Session {}. Request body over the memory budget rejected with status {}", address_,
+        static_cast<int>(status));
+  is_body_skipped_ = true;
+  http::Headers headers{{"Connection", "close"}};
+  if (status == http::Status::Service_Unavailable) headers.insert("Retry-After", "1");
+  prepared_response_ = std::make_shared<http::Response>(
+      status, std::move(headers),
+      status == http::Status::Payload_Too_Large ? "Body exceeds the memory budget"
+                                                : "Server is out of memory for the body");
+}
+
 void routine::net::HttpSession::do_prepare_and_read_body(
     routine::http::Response_ptr response, Buffer_ptr buffer,
     std::function<void(const std::error_code&, routine::http::Response_ptr)> callback) {
@@ -251,24 +729,50 @@ template <typename T>
 void routine::net::HttpSession::do_read_body(
     std::shared_ptr<T> message, Buffer_ptr buffer,
     std::function<void(const std::error_code&, std::shared_ptr<T>)> callback) {
-  size_t content_length = std::stoull(message->headers().at(http::Header::Content_Length));
-  size_t body_not_loaded = content_length - buffer->size();
+  // validated with the head by do_read_headers()
+  size_t content_length = *http::parse_content_length(message->headers());
+  auto& body = *message->body();
 
-  if (body_not_loaded > 0) {
+  // bytes which came with the head, pipelined bytes of the next message stay in the buffer
+  size_t buffered = std::min(buffer->size(), content_length);
+  body.write(std::span<const uint8_t>(static_cast<const uint8_t*>(buffer->data().data()),
+                                      buffered));
+  buffer->consume(buffered);
+
+  size_t body_not_loaded = content_length - buffered;
+  while (body_not_loaded > 0) {
 #ifdef USE_BOOST_ASIO
     boost::system::error_code error_code;
 #else
     std::error_code error_code;
 #endif
     run_timeout_timer();
-    asio::read(socket_, *buffer, asio::transfer_exactly(body_not_loaded), error_code);
+    // the rest is read straight into the storage if it has space for it. Storages which
+    // parse the body as it comes give a window and get it piece by piece
+    size_t bytes = 0;
+    auto space = body.prepare(body_not_loaded);
+    if (!space.empty()) {
+      size_t size = std::min(space.size(), body_not_loaded);
+      bytes = asio::read(socket_, asio::buffer(space.data(), size), asio::transfer_exactly(size),
+                         error_code);
+      body.commit(bytes);
+    } else {
+      size_t size = std::min(body_not_loaded, body_chunk_size);
+      bytes = asio::read(socket_, *buffer, asio::transfer_exactly(size), error_code);
+      if (!error_code) {
+        body.write(
+            std::span<const uint8_t>(static_cast<const uint8_t*>(buffer->data().data()), size));
+        buffer->consume(size);
+      }
+    }
     if (is_errors(error_code)) {
       callback(error_code, std::move(message));
       return;
     }
+    body_not_loaded -= bytes;
   }
 
-  message->body()->write(*buffer);
+  if constexpr (std::is_same_v<T, http::Request>) finish_body(*message);
   callback(std::error_code(), message);
 }
 
@@ -279,3 +783,290 @@ template void routine::net::HttpSession::do_read_body<routine::http::Request>(
 template void routine::net::HttpSession::do_read_body<routine::http::Response>(
     std::shared_ptr<http::Response>, Buffer_ptr,
     std::function<void(const std::error_code&, std::shared_ptr<http::Response>)>);
+
+std::unique_ptr<routine::http::Decompressor>
+routine::net::HttpSession::make_decompressor(routine::http::Request& request) {
+  auto coding = request.headers().find(http::Header::Content_Encoding);
+  const auto& policy = scheduler_->decompression();
+  if (!coding || policy.encodings == http::encoding_bit(http::Encoding::Identity)) return nullptr;
+
+  auto encoding = http::parse_encoding(coding->value());
+  if (encoding == http::Encoding::Identity) return nullptr;
+  if (encoding && (policy.encodings & http::encoding_bit(*encoding)))
+    return std::make_unique<http::Decompressor>(*encoding, policy);
+
+  // RFC 7694 3: 415 lists the codings the server accepts
+  std::string accepted;
+  for (size_t i = 1; i < http::encoding_count; ++i)
+    if (policy.encodings & http::encoding_bit(static_cast<http::Encoding>(i)))
+      accepted.append(accepted.empty() ? "" : ", ")
+          .append(http::to_string(static_cast<http::Encoding>(i)));
+  prepared_response_ = std::make_shared<http::Response>(
+      http::Status::Unsupported_Media_Type,
+      http::Headers{{"Accept-Encoding", accepted.empty() ? "identity" : accepted}},
+      fmt::format("Unsupported Content-Encoding '{}'", coding->value()));
+  return nullptr;
+}
+
+void routine::net::HttpSession::do_read_encoded_body(
+    routine::http::Request_ptr request, Buffer_ptr buffer,
+    std::unique_ptr<routine::http::Decompressor> decompressor,
+    std::function<void(const std::error_code&, routine::http::Request_ptr)> callback) {
+  size_t remaining = *http::parse_content_length(request->headers());
+
+  if (!request->body()) request->body() = std::make_unique<http::MemoryBody>();
+  auto& body = *request->body();
+
+  auto output = [&body](std::string_view bytes) {
+    body.write(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(bytes.data()),
+                                        bytes.size()));
+  };
+
+  bool is_decoding = true;
+  while (remaining > 0) {
+    if (buffer->size() == 0) {
+#ifdef USE_BOOST_ASIO
+      boost::system::error_code error_code;
+#else
+      std::error_code error_code;
+#endif
+      run_timeout_timer();
+      asio::read(socket_, *buffer,
+                 asio::transfer_exactly(std::min(remaining, encoded_chunk_size)), error_code);
+      if (is_errors(error_code)) {
+        callback(error_code, std::move(request));
+        return;
+      }
+    }
+
+    // pipelined bytes of the next request stay in the buffer
+    size_t size = std::min(buffer->size(), remaining);
+    std::string_view chunk(static_cast<const char*>(buffer->data().data()), size);
+    if (is_decoding) is_decoding = decompressor->write(chunk, output);
+    buffer->consume(size);
+    remaining -= size;
+  }
+
+  if (!is_decoding || !decompressor->finish()) {
+    reject_encoded_body(decompressor->status());
+  } else {
+    // the handler gets the decoded body
+    request->erase_header(http::Header::Content_Encoding);
+    finish_body(*request);
+  }
+  callback(std::error_code(), std::move(request));
+}
+
+void routine::net::HttpSession::reject_encoded_body(routine::http::Status status) {
+  debug("Session {}. Request body dropped by decoding with status {}", address_,
+        static_cast<int>(status));
+  prepared_response_ = std::make_shared<http::Response>(
+      status, http::Headers{},
+      status == http::Status::Payload_Too_Large ? "Decoded body exceeds the limit"
+                                                : "Malformed Content-Encoding of the body");
+}
+
+struct routine::net::HttpSession::Body_chunks {
+  http::Request_ptr request;
+  http::RequestHandler_ptr handler;
+  const http::BodyChunkPolicy* policy{nullptr};
+  std::unique_ptr<http::Decompressor> decompressor;
+  std::function<void(const std::error_code&, http::Request_ptr)> callback;
+  size_t remaining{0};          // bytes of the body still on the socket, IO thread only
+  std::string reading;          // piece being read, IO thread only
+  routine::utils::MemoryCharge reading_charge; // of the piece being read, IO thread only
+
+  std::mutex mutex;
+  std::deque<std::string> queue;       // pieces waiting for the handler
+  bool is_delivering{false};           // a CPU task takes the queue
+  bool is_paused{false};               // reading waits for the queue to shrink
+  bool is_read{false};                 // the whole body is read
+  routine::utils::MemoryCharge charge; // of the queued pieces
+
+  std::atomic<bool> is_accepted{true}; // false once the handler or the decoder refused it
+  std::atomic<bool> is_completed{false};
+};
+
+void routine::net::HttpSession::do_read_body_chunks(
+    routine::http::Request_ptr request, Buffer_ptr buffer,
+    routine::http::RequestHandler_ptr handler,
+    std::unique_ptr<routine::http::Decompressor> decompressor,
+    std::function<void(const std::error_code&, routine::http::Request_ptr)> callback) {
+  size_t content_length = *http::parse_content_length(request->headers());
+
+  auto chunks = std::make_shared<Body_chunks>();
+  chunks->policy = request->route_policy().body_chunks;
+  chunks->request = std::move(request);
+  chunks->handler = std::move(handler);
+  chunks->decompressor = std::move(decompressor);
+  chunks->callback = std::move(callback);
+  // pieces reach the handler decoded
+  if (chunks->decompressor) chunks->request->erase_header(http::Header::Content_Encoding);
+
+  // bytes which came with the head, pipelined bytes of the next message stay in the buffer
+  size_t buffered = std::min(buffer->size(), content_length);
+  if (buffered > 0)
+    push_body_chunk(chunks,
+                    std::string(static_cast<const char*>(buffer->data().data()), buffered));
+  buffer->consume(buffered);
+  chunks->remaining = content_length - buffered;
+
+  // a client which waits for "100 Continue" sends the body after it. It goes behind the
+  // responses to earlier pipelined requests, so it cannot split one of them
+  auto expect = chunks->request->headers().find("expect");
+  if (chunks->remaining > 0 && expect && routine::utils::iequals(expect->value(), "100-continue"))
+    enqueue_bytes("HTTP/1.1 100 Continue\r\n\r\n", nullptr);
+
+  read_body_chunk(std::move(chunks));
+}
+
+void routine::net::HttpSession::read_body_chunk(Body_chunks_ptr chunks) {
+  if (chunks->remaining == 0) {
+    chunks->reading_charge.resize(0);
+    if (chunks->decompressor && chunks->is_accepted.load(std::memory_order_relaxed) &&
+        !chunks->decompressor->finish()) {
+      chunks->is_accepted.store(false, std::memory_order_relaxed);
+      reject_encoded_body(chunks->decompressor->status());
+    }
+
+    bool is_delivered = false;
+    {
+      std::lock_guard lock(chunks->mutex);
+      chunks->is_read = true;
+      is_delivered = !chunks->is_delivering;
+    }
+    // otherwise the delivery task completes the body after the last piece
+    if (is_delivered) complete_body_chunks(chunks, std::error_code());
+    return;
+  }
+
+  {
+    std::lock_guard lock(chunks->mutex);
+    if (chunks->queue.size() >= chunks->policy->max_queued) {
+      // the delivery task resumes reading when the handler takes a piece, the session does
+      // not time out while the handler works
+      chunks->is_paused = true;
+      timeout_timer_.cancel();
+      return;
+    }
+  }
+
+  // queued pieces wait in memory, so a piece is charged to the budget before it is read and
+  // reading pauses while the budget cannot hold it. A body still waiting after 'max_wait'
+  // is answered with 503, the rest of it is not read
+  size_t size = std::min(chunks->remaining, chunks->policy->chunk_size);
+  if (!chunks->reading_charge.try_resize(size)) {
+    timeout_timer_.cancel();
+    wait_for_memory(
+        [chunks, size] { return chunks->reading_charge.try_resize(size); },
+        std::chrono::steady_clock::now() + scheduler_->memory_budget().max_wait,
+        [self = shared_from_this(), chunks](bool has_room) {
+          if (!has_room) {
+            chunks->is_accepted.store(false, std::memory_order_relaxed);
+            self->reject_unread_body(http::Status::Service_Unavailable);
+            chunks->remaining = 0;
+          }
+          self->read_body_chunk(chunks);
+        });
+    return;
+  }
+
+  chunks->reading.resize_and_overwrite(size, [](char*, size_t size) { return size; });
+  run_timeout_timer();
+  socket_.async_read_some(
+      asio::buffer(chunks->reading.data(), size),
+      asio::bind_executor(strand_, [self = shared_from_this(),
+                                    chunks](const std::error_code& ec, size_t bytes) {
+        if (self->is_errors(ec)) {
+          chunks->reading_charge.resize(0);
+          self->complete_body_chunks(chunks, ec);
+          return;
+        }
+        chunks->remaining -= bytes;
+        chunks->reading.resize(bytes);
+        // the queue takes the charge of the piece over
+        self->push_body_chunk(chunks, std::move(chunks->reading));
+        chunks->reading_charge.resize(0);
+        self->read_body_chunk(chunks);
+      }));
+}
+
+void routine::net::HttpSession::push_body_chunk(const Body_chunks_ptr& chunks,
+                                                std::string chunk) {
+  // the rest of a refused body is read and dropped
+  if (!chunks->is_accepted.load(std::memory_order_relaxed)) return;
+
+  if (chunks->decompressor) {
+    std::string decoded;
+    if (!chunks->decompressor->write(
+            chunk, [&decoded](std::string_view bytes) { decoded.append(bytes); })) {
+      chunks->is_accepted.store(false, std::memory_order_relaxed);
+      reject_encoded_body(chunks->decompressor->status());
+      return;
+    }
+    chunk = std::move(decoded);
+  }
+  if (chunk.empty()) return;
+
+  bool is_starting = false;
+  {
+    std::lock_guard lock(chunks->mutex);
+    chunks->charge.resize(chunks->charge.bytes() + chunk.size());
+    chunks->queue.push_back(std::move(chunk));
+    is_starting = !std::exchange(chunks->is_delivering, true);
+  }
+  if (is_starting)
+    scheduler_->prepare_task(
+        [self = shared_from_this(), chunks] { self->deliver_body_chunks(chunks); });
+}
+
+void routine::net::HttpSession::deliver_body_chunks(const Body_chunks_ptr& chunks) {
+  auto handler = http::local_handler(chunks->handler, chunks->request->route_policy());
+  while (true) {
+    std::string chunk;
+    bool is_resumed = false;
+    {
+      std::lock_guard lock(chunks->mutex);
+      if (chunks->queue.empty()) {
+        chunks->is_delivering = false;
+        if (!chunks->is_read) return;
+        break;
+      }
+      chunk = std::move(chunks->queue.front());
+      chunks->queue.pop_front();
+      chunks->charge.resize(chunks->charge.bytes() - chunk.size());
+      is_resumed = std::exchange(chunks->is_paused, false);
+    }
+
+    if (is_resumed)
+      asio::post(strand_, [self = shared_from_this(), chunks] { self->read_body_chunk(chunks); });
+
+    if (chunks->is_accepted.load(std::memory_order_relaxed) &&
+        !handler->on_body_chunk(
+            chunks->request,
+            std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(chunk.data()),
+                                     chunk.size())))
+      chunks->is_accepted.store(false, std::memory_order_relaxed);
+  }
+  complete_body_chunks(chunks, std::error_code());
+}
+
+void routine::net::HttpSession::complete_body_chunks(const Body_chunks_ptr& chunks,
+                                                     const std::error_code& ec) {
+  if (chunks->is_completed.exchange(true)) return;
+  // the callback goes on with the request on the IO thread, serialized with the timers
+  asio::post(strand_, [chunks, ec] { chunks->callback(ec, chunks->request); });
+}
+
+void routine::net::HttpSession::finish_body(routine::http::Request& request) {
+  auto status = request.body() ? request.body()->finish() : http::Status::Ok;
+  if (status == http::Status::Ok || prepared_response_) return;
+
+  debug("Session {}. Request body rejected by its storage with status {}", address_,
+        static_cast<int>(status));
+  prepared_response_ = std::make_shared<http::Response>(
+      status, http::Headers{},
+      status == http::Status::Payload_Too_Large ? "Body exceeds the limit"
+      : status == http::Status::Bad_Request     ? "Malformed body of the request"
+                                                : "Cannot store the body of the request");
+}
@@ -7,6 +7,7 @@ routine::Scheduler::Scheduler()
 
 void routine::Scheduler::set_router(std::unique_ptr<routine::http::RouteHandler> router) {
   router_ = std::move(router);
+  if (router_) router_->compile();
 }
 
 asio::io_context& routine::Scheduler::get_context() {
@@ -20,6 +21,16 @@ size_t routine::Scheduler::get_io_timeout() const {
   return io_timeout_ms_;
 }
 
+void routine::Scheduler::set_compression(const http::CompressionPolicy& policy) {
+  compression_ = policy;
+  response_cache_.set_compression(policy);
+}
+
+void routine::Scheduler::set_memory_budget(const utils::MemoryBudgetPolicy& policy) {
+  memory_budget_ = policy;
+  utils::MemoryBudget::global().set_limit(policy.limit);
+}
+
 void routine::Scheduler::run(size_t io_bound_threads, size_t cpu_bound_threads) {
   trace("Running {} IO threads...", io_bound_threads);
   io_thread_pool_.run(io_bound_threads);
@@ -41,9 +52,18 @@ void routine::Scheduler::join_threads() {
   cpu_thread_pool_.join();
 }
 
-routine::http::RequestHandler_ptr routine::Scheduler::route_request(http::Request_ptr request) {
+routine::http::RequestHandler_ptr
+routine::Scheduler::route_request(const http::Request_ptr& request) {
   if (!request || !router_) return nullptr;
-  return router_->route(*request);
+  if (!request->is_routed()) {
+    auto route = router_->route(*request);
+    request->set_handler(std::move(route.handler), std::move(route.response), route.policy);
+  }
+  return request->handler();
+}
+
+routine::http::Response_ptr routine::Scheduler::not_found_response() const {
+  return router_ ? router_->not_found() : http::RouteHandler::default_not_found();
 }
 
 void routine::Scheduler::prepare_task(std::function<void()> lambda) {
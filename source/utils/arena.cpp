@@ -0,0 +1,105 @@
+#include "utils/arena.hpp"
+#include <mutex>
+#include <new>
+
+namespace routine::utils {
+
+  // Free arenas. Each thread keeps a few of them without locking, the rest is shared
+  class ArenaPool {
+  public:
+    static constexpr size_t local_capacity = 32;
+
+  public:
+    static RequestArena* pop() {
+      auto& local = local_list();
+      if (local.head) {
+        RequestArena* arena = local.head;
+        local.head = arena->next_;
+        --local.size;
+        return arena;
+      }
+
+      std::lock_guard lock(shared_mutex_);
+      RequestArena* arena = shared_head_;
+      if (arena) shared_head_ = arena->next_;
+      return arena;
+    }
+
+    static void push(RequestArena* arena) noexcept {
+      auto& local = local_list();
+      if (local.size < local_capacity) {
+        arena->next_ = local.head;
+        local.head = arena;
+        ++local.size;
+        return;
+      }
+
+      std::lock_guard lock(shared_mutex_);
+      arena->next_ = shared_head_;
+      shared_head_ = arena;
+    }
+
+  private:
+    struct LocalList {
+      RequestArena* head{nullptr};
+      size_t size{0};
+
+      ~LocalList() {
+        while (head) {
+          RequestArena* next = head->next_;
+          delete head;
+          head = next;
+        }
+      }
+    };
+
+    static LocalList& local_list() noexcept {
+      thread_local LocalList list;
+      return list;
+    }
+
+  private:
+    static inline std::mutex shared_mutex_;
+    static inline RequestArena* shared_head_{nullptr};
+  };
+
+} // namespace routine::utils
+
+routine::utils::ArenaStats& routine::utils::arena_stats() noexcept {
+  static ArenaStats stats;
+  return stats;
+}
+
+routine::utils::RequestArena::RequestArena()
+    : monotonic_(initial_.data(), initial_.size(), &upstream_) {}
+
+routine::utils::RequestArena* routine::utils::RequestArena::acquire() {
+  RequestArena* arena = ArenaPool::pop();
+  if (!arena) {
+    arena = new RequestArena();
+    arena_stats().created.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  arena_stats().acquired.fetch_add(1, std::memory_order_relaxed);
+  return arena;
+}
+
+void routine::utils::RequestArena::release() noexcept {
+  if (owners_.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+  // drop all blocks allocated after the initial one, the next owner starts from scratch
+  monotonic_.release();
+  ArenaPool::push(this);
+}
+
+void* routine::utils::RequestArena::CountingResource::do_allocate(size_t bytes,
+                                                                   size_t alignment) {
+  arena_stats().upstream_allocations.fetch_add(1, std::memory_order_relaxed);
+  arena_stats().upstream_bytes.fetch_add(bytes, std::memory_order_relaxed);
+  return ::operator new(bytes, std::align_val_t(alignment));
+}
+
+void routine::utils::RequestArena::CountingResource::do_deallocate(void* pointer, size_t bytes,
+                                                                   size_t alignment) {
+  ::operator delete(pointer, bytes, std::align_val_t(alignment));
+}
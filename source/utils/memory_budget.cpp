@@ -0,0 +1,47 @@
+#include "utils/memory_budget.hpp"
+
+routine::utils::MemoryBudget& routine::utils::MemoryBudget::global() noexcept {
+  static MemoryBudget budget;
+  return budget;
+}
+
+bool routine::utils::MemoryBudget::has_room(size_t bytes) const noexcept {
+  size_t limit = this->limit();
+  size_t used = this->used();
+  return limit == 0 || (used <= limit && bytes <= limit - used);
+}
+
+bool routine::utils::MemoryBudget::try_charge(size_t bytes) noexcept {
+  size_t used = used_.load(std::memory_order_relaxed);
+  do {
+    size_t limit = this->limit();
+    if (limit != 0 && (used > limit || bytes > limit - used)) return false;
+  } while (!used_.compare_exchange_weak(used, used + bytes, std::memory_order_relaxed));
+  return true;
+}
+
+//  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  // //  //  //  //  // //
+
+routine::utils::MemoryCharge&
+routine::utils::MemoryCharge::operator=(MemoryCharge&& other) noexcept {
+  if (this != &other) {
+    resize(0);
+    bytes_ = std::exchange(other.bytes_, 0);
+  }
+  return *this;
+}
+
+bool routine::utils::MemoryCharge::try_resize(size_t bytes) noexcept {
+  if (bytes > bytes_ && !MemoryBudget::global().try_charge(bytes - bytes_)) return false;
+  if (bytes < bytes_) MemoryBudget::global().release(bytes_ - bytes);
+  bytes_ = bytes;
+  return true;
+}
+
+void routine::utils::MemoryCharge::resize(size_t bytes) noexcept {
+  if (bytes > bytes_)
+    MemoryBudget::global().charge(bytes - bytes_);
+  else if (bytes < bytes_)
+    MemoryBudget::global().release(bytes_ - bytes);
+  bytes_ = bytes;
+}
@@ -0,0 +1,338 @@
+#include "utils/simd.hpp"
+#include <array>
+#include <atomic>
+#include <bit>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ROUTINE_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+  using routine::utils::simd::Level;
+
+  // RFC 7230: tchar = "!" / "#" / "$" / "%" / "&" / "'" / "*" / "+" / "-" / "." /
+  //                   "^" / "_" / "`" / "|" / "~" / DIGIT / ALPHA
+  constexpr bool is_tchar(uint8_t c) {
+    if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) return true;
+    return std::string_view{"!#$%&'*+-.^_`|~"}.find(static_cast<char>(c)) != std::string_view::npos;
+  }
+
+  constexpr std::array<bool, 256> tchar_table = []() {
+    std::array<bool, 256> table{};
+    for (size_t i = 0; i < table.size(); ++i)
+      table[i] = is_tchar(static_cast<uint8_t>(i));
+    return table;
+  }();
+
+  // Nibble tables for the pshufb classification: byte 'c' is a tchar if
+  // (low_nibble_table[c & 0xF] & high_nibble_table[c >> 4]) != 0
+  constexpr std::array<uint8_t, 16> low_nibble_table = []() {
+    std::array<uint8_t, 16> table{};
+    for (uint8_t low = 0; low < 16; ++low)
+      for (uint8_t high = 0; high < 8; ++high)
+        if (is_tchar(static_cast<uint8_t>(high << 4 | low))) table[low] |= 1 << high;
+    return table;
+  }();
+
+  constexpr std::array<uint8_t, 16> high_nibble_table{1, 2, 4, 8, 16, 32, 64, 128,
+                                                      0, 0, 0, 0, 0,  0,  0,  0};
+
+  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //
+
+  size_t scalar_find_char(const char* data, size_t size, char ch) {
+    for (size_t i = 0; i < size; ++i)
+      if (data[i] == ch) return i;
+    return size;
+  }
+
+  size_t scalar_find_any_of(const char* data, size_t size, char a, char b) {
+    for (size_t i = 0; i < size; ++i)
+      if (data[i] == a || data[i] == b) return i;
+    return size;
+  }
+
+  size_t scalar_find_header_end(const char* data, size_t size) {
+    for (size_t i = 0; i + 3 < size; ++i)
+      if (data[i] == '\r' && data[i + 1] == '\n' && data[i + 2] == '\r' && data[i + 3] == '\n')
+        return i;
+    return size;
+  }
+
+  size_t scalar_find_non_token(const char* data, size_t size) {
+    for (size_t i = 0; i < size; ++i)
+      if (!tchar_table[static_cast<uint8_t>(data[i])]) return i;
+    return size;
+  }
+
+  void scalar_to_lower(char* data, size_t size) {
+    for (size_t i = 0; i < size; ++i)
+      if (data[i] >= 'A' && data[i] <= 'Z') data[i] |= 0x20;
+  }
+
+  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //
+
+#ifdef ROUTINE_SIMD_X86
+
+  // Unaligned vector pointer shifted by 'bytes'
+  template <typename VectorT>
+  inline const VectorT* offset_by(const VectorT* pointer, size_t bytes) {
+    return reinterpret_cast<const VectorT*>(reinterpret_cast<const char*>(pointer) + bytes);
+  }
+
+  __attribute__((target("sse4.2"))) size_t sse42_find_char(const char* data, size_t size,
+                                                           char ch) {
+    const __m128i needle = _mm_set1_epi8(ch);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+      __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+      if (int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)))
+        return i + std::countr_zero(static_cast<unsigned>(mask));
+    }
+    return i + scalar_find_char(data + i, size - i, ch);
+  }
+
+  __attribute__((target("sse4.2"))) size_t sse42_find_any_of(const char* data, size_t size,
+                                                             char a, char b) {
+    const __m128i needles = _mm_setr_epi8(a, b, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    constexpr int mode = _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT;
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+      __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+      if (int index = _mm_cmpestri(needles, 2, chunk, 16, mode); index < 16) return i + index;
+    }
+    return i + scalar_find_any_of(data + i, size - i, a, b);
+  }
+
+  __attribute__((target("sse4.2"))) size_t sse42_find_header_end(const char* data, size_t size) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 19 <= size; i += 16) {
+      const auto* chunk = reinterpret_cast<const __m128i*>(data + i);
+      __m128i match = _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(chunk), cr),
+                                    _mm_cmpeq_epi8(_mm_loadu_si128(offset_by(chunk, 1)), lf));
+      match = _mm_and_si128(match, _mm_cmpeq_epi8(_mm_loadu_si128(offset_by(chunk, 2)), cr));
+      match = _mm_and_si128(match, _mm_cmpeq_epi8(_mm_loadu_si128(offset_by(chunk, 3)), lf));
+      if (int mask = _mm_movemask_epi8(match))
+        return i + std::countr_zero(static_cast<unsigned>(mask));
+    }
+    size_t tail = scalar_find_header_end(data + i, size - i);
+    return tail == size - i ? size : i + tail;
+  }
+
+  __attribute__((target("sse4.2"))) size_t sse42_find_non_token(const char* data, size_t size) {
+    const __m128i low_table =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(low_nibble_table.data()));
+    const __m128i high_table =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(high_nibble_table.data()));
+    const __m128i nibble_mask = _mm_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+      __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+      __m128i low = _mm_shuffle_epi8(low_table, _mm_and_si128(chunk, nibble_mask));
+      __m128i high = _mm_shuffle_epi8(high_table,
+                                      _mm_and_si128(_mm_srli_epi16(chunk, 4), nibble_mask));
+      __m128i invalid = _mm_cmpeq_epi8(_mm_and_si128(low, high), _mm_setzero_si128());
+      if (int mask = _mm_movemask_epi8(invalid))
+        return i + std::countr_zero(static_cast<unsigned>(mask));
+    }
+    return i + scalar_find_non_token(data + i, size - i);
+  }
+
+  __attribute__((target("sse4.2"))) void sse42_to_lower(char* data, size_t size) {
+    const __m128i before_upper = _mm_set1_epi8('A' - 1);
+    const __m128i after_upper = _mm_set1_epi8('Z' + 1);
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+      __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+      __m128i is_upper = _mm_and_si128(_mm_cmpgt_epi8(chunk, before_upper),
+                                       _mm_cmplt_epi8(chunk, after_upper));
+      chunk = _mm_or_si128(chunk, _mm_and_si128(is_upper, case_bit));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), chunk);
+    }
+    scalar_to_lower(data + i, size - i);
+  }
+
+  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //
+
+  __attribute__((target("avx2"))) size_t avx2_find_char(const char* data, size_t size, char ch) {
+    const __m256i needle = _mm256_set1_epi8(ch);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+      __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+      if (unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle)))
+        return i + std::countr_zero(mask);
+    }
+    _mm256_zeroupper(); // legacy SSE tail, avoid AVX-SSE transition penalty
+    return i + sse42_find_char(data + i, size - i, ch);
+  }
+
+  __attribute__((target("avx2"))) size_t avx2_find_any_of(const char* data, size_t size, char a,
+                                                          char b) {
+    const __m256i first = _mm256_set1_epi8(a);
+    const __m256i second = _mm256_set1_epi8(b);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+      __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+      __m256i match =
+          _mm256_or_si256(_mm256_cmpeq_epi8(chunk, first), _mm256_cmpeq_epi8(chunk, second));
+      if (unsigned mask = _mm256_movemask_epi8(match)) return i + std::countr_zero(mask);
+    }
+    _mm256_zeroupper();
+    return i + sse42_find_any_of(data + i, size - i, a, b);
+  }
+
+  __attribute__((target("avx2"))) size_t avx2_find_header_end(const char* data, size_t size) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 35 <= size; i += 32) {
+      const auto* chunk = reinterpret_cast<const __m256i*>(data + i);
+      __m256i match =
+          _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256(chunk), cr),
+                           _mm256_cmpeq_epi8(_mm256_loadu_si256(offset_by(chunk, 1)), lf));
+      match =
+          _mm256_and_si256(match, _mm256_cmpeq_epi8(_mm256_loadu_si256(offset_by(chunk, 2)), cr));
+      match =
+          _mm256_and_si256(match, _mm256_cmpeq_epi8(_mm256_loadu_si256(offset_by(chunk, 3)), lf));
+      if (unsigned mask = _mm256_movemask_epi8(match)) return i + std::countr_zero(mask);
+    }
+    _mm256_zeroupper();
+    size_t tail = sse42_find_header_end(data + i, size - i);
+    return tail == size - i ? size : i + tail;
+  }
+
+  __attribute__((target("avx2"))) size_t avx2_find_non_token(const char* data, size_t size) {
+    const __m256i low_table = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(low_nibble_table.data())));
+    const __m256i high_table = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(high_nibble_table.data())));
+    const __m256i nibble_mask = _mm256_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+      __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+      __m256i low = _mm256_shuffle_epi8(low_table, _mm256_and_si256(chunk, nibble_mask));
+      __m256i high = _mm256_shuffle_epi8(
+          high_table, _mm256_and_si256(_mm256_srli_epi16(chunk, 4), nibble_mask));
+      __m256i invalid = _mm256_cmpeq_epi8(_mm256_and_si256(low, high), _mm256_setzero_si256());
+      if (unsigned mask = _mm256_movemask_epi8(invalid)) return i + std::countr_zero(mask);
+    }
+    _mm256_zeroupper();
+    return i + sse42_find_non_token(data + i, size - i);
+  }
+
+  __attribute__((target("avx2"))) void avx2_to_lower(char* data, size_t size) {
+    const __m256i before_upper = _mm256_set1_epi8('A' - 1);
+    const __m256i after_upper = _mm256_set1_epi8('Z' + 1);
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+      __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+      __m256i is_upper = _mm256_and_si256(_mm256_cmpgt_epi8(chunk, before_upper),
+                                          _mm256_cmpgt_epi8(after_upper, chunk));
+      chunk = _mm256_or_si256(chunk, _mm256_and_si256(is_upper, case_bit));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), chunk);
+    }
+    _mm256_zeroupper();
+    sse42_to_lower(data + i, size - i);
+  }
+
+#endif // ROUTINE_SIMD_X86
+
+  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //  //
+
+  struct Kernels {
+    Level level;
+    size_t (*find_char)(const char*, size_t, char);
+    size_t (*find_any_of)(const char*, size_t, char, char);
+    size_t (*find_header_end)(const char*, size_t);
+    size_t (*find_non_token)(const char*, size_t);
+    void (*to_lower)(char*, size_t);
+  };
+
+  constexpr Kernels scalar_kernels{Level::Scalar,         scalar_find_char,
+                                   scalar_find_any_of,    scalar_find_header_end,
+                                   scalar_find_non_token, scalar_to_lower};
+
+#ifdef ROUTINE_SIMD_X86
+  constexpr Kernels sse42_kernels{Level::Sse42,         sse42_find_char,
+                                  sse42_find_any_of,    sse42_find_header_end,
+                                  sse42_find_non_token, sse42_to_lower};
+
+  constexpr Kernels avx2_kernels{Level::Avx2,         avx2_find_char,
+                                 avx2_find_any_of,    avx2_find_header_end,
+                                 avx2_find_non_token, avx2_to_lower};
+#endif
+
+  bool is_supported(Level level) {
+#ifdef ROUTINE_SIMD_X86
+    switch (level) {
+      case Level::Avx2:
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("sse4.2");
+      case Level::Sse42:
+        return __builtin_cpu_supports("sse4.2");
+      case Level::Scalar:
+        return true;
+    }
+#endif
+    return level == Level::Scalar;
+  }
+
+  const Kernels* kernels_for(Level level) {
+#ifdef ROUTINE_SIMD_X86
+    if (level == Level::Avx2) return &avx2_kernels;
+    if (level == Level::Sse42) return &sse42_kernels;
+#endif
+    return &scalar_kernels;
+  }
+
+  const Kernels* select_kernels() {
+#ifdef ROUTINE_SIMD_X86
+    __builtin_cpu_init();
+#endif
+    for (Level level : {Level::Avx2, Level::Sse42})
+      if (is_supported(level)) return kernels_for(level);
+    return &scalar_kernels;
+  }
+
+  std::atomic<const Kernels*> active_kernels{select_kernels()};
+
+  inline const Kernels& kernels() {
+    return *active_kernels.load(std::memory_order_relaxed);
+  }
+
+} // namespace
+
+routine::utils::simd::Level routine::utils::simd::level() noexcept {
+  return kernels().level;
+}
+
+bool routine::utils::simd::force_level(Level level) noexcept {
+  if (!is_supported(level)) return false;
+  active_kernels.store(kernels_for(level), std::memory_order_relaxed);
+  return true;
+}
+
+size_t routine::utils::simd::find_char(const char* data, size_t size, char ch) noexcept {
+  return kernels().find_char(data, size, ch);
+}
+
+size_t routine::utils::simd::find_any_of(const char* data, size_t size, char a, char b) noexcept {
+  return kernels().find_any_of(data, size, a, b);
+}
+
+size_t routine::utils::simd::find_header_end(const char* data, size_t size) noexcept {
+  return kernels().find_header_end(data, size);
+}
+
+size_t routine::utils::simd::find_non_token(const char* data, size_t size) noexcept {
+  return kernels().find_non_token(data, size);
+}
+
+void routine::utils::simd::to_lower(char* data, size_t size) noexcept {
+  kernels().to_lower(data, size);
+}